@@ -0,0 +1,328 @@
+#include "Analyzer.h"
+#include "Tokenizer.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace {
+
+// Нижний регистр для символов U+0000-U+07FF, 0 - пунктуация, символ выбрасывается
+constexpr std::array<uint16_t, 0x800> makeFoldTable() {
+    std::array<uint16_t, 0x800> table {};
+    for (uint32_t c = 0; c < table.size(); ++c) {
+        table[c] = static_cast<uint16_t>(c);
+    }
+    auto shiftRange = [&](uint32_t first, uint32_t last, uint32_t shift) {
+        for (uint32_t c = first; c <= last; ++c) {
+            table[c] = static_cast<uint16_t>(c + shift);
+        }
+    };
+    // Пары "заглавная, строчная" подряд: заглавная на четном или нечетном месте
+    auto foldPairs = [&](uint32_t first, uint32_t last) {
+        for (uint32_t c = first; c < last; c += 2) {
+            table[c] = static_cast<uint16_t>(c + 1);
+        }
+    };
+
+    // Latin-1: пунктуация и знаки, кроме букв и цифр (ª ² ³ µ ¹ º ¼ ½ ¾)
+    for (uint32_t c = 0xA0; c <= 0xBF; ++c) {
+        if (c != 0xAA && c != 0xB2 && c != 0xB3 && c != 0xB5 && c != 0xB9 && c != 0xBA &&
+            (c < 0xBC || c > 0xBE)) {
+            table[c] = 0;
+        }
+    }
+    table[0xB5] = 0x3BC;
+    shiftRange(0xC0, 0xD6, 0x20);
+    table[0xD7] = 0;
+    shiftRange(0xD8, 0xDE, 0x20);
+    table[0xF7] = 0;
+
+    // Latin Extended-A
+    foldPairs(0x100, 0x12F);
+    table[0x130] = 'i';
+    foldPairs(0x132, 0x137);
+    foldPairs(0x139, 0x148);
+    foldPairs(0x14A, 0x177);
+    table[0x178] = 0xFF;
+    foldPairs(0x179, 0x17E);
+
+    // Греческий
+    table[0x386] = 0x3AC;
+    shiftRange(0x388, 0x38A, 0x25);
+    table[0x38C] = 0x3CC;
+    shiftRange(0x38E, 0x38F, 0x3F);
+    shiftRange(0x391, 0x3A1, 0x20);
+    shiftRange(0x3A3, 0x3AB, 0x20);
+    table[0x3C2] = 0x3C3;
+
+    // Кириллица
+    shiftRange(0x400, 0x40F, 0x50);
+    shiftRange(0x410, 0x42F, 0x20);
+    foldPairs(0x460, 0x481);
+    foldPairs(0x48A, 0x4BF);
+    table[0x4C0] = 0x4CF;
+    foldPairs(0x4C1, 0x4CE);
+    foldPairs(0x4D0, 0x52F);
+
+    // Армянский
+    shiftRange(0x531, 0x556, 0x30);
+    return table;
+}
+
+constexpr std::array<uint16_t, 0x800> FOLD_TABLE = makeFoldTable();
+
+void appendUtf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out.push_back(static_cast<char>(code));
+    } else {
+        out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+inline bool isContinuation(const char* c) {
+    return (static_cast<unsigned char>(*c) & 0xC0) == 0x80;
+}
+
+// Перемешивание битов (финализатор splitmix64)
+inline uint64_t mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+// FNV-1a по байтам отпечатка настроек
+uint32_t fingerprintOf(std::string_view text) {
+    uint32_t hash = 2166136261u;
+    for (char c : text) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+}
+
+uint64_t StopWordTable::hashWord(std::string_view word) {
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : word) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t StopWordTable::slotHash(uint64_t hash, uint32_t displacement) {
+    return mix(hash ^ (displacement * 0x9E3779B97F4A7C15ull));
+}
+
+size_t StopWordTable::bucketOf(uint64_t hash) const {
+    return static_cast<size_t>(((hash >> 32) * displacements.size()) >> 32);
+}
+
+void StopWordTable::build(std::vector<std::string> words) {
+    words.erase(std::remove(words.begin(), words.end(), std::string()), words.end());
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+
+    pool.clear();
+    slots.clear();
+    displacements.clear();
+    maxLength = 0;
+    if (words.empty()) {
+        return;
+    }
+    std::vector<Slot> wordSlots;
+    std::vector<uint64_t> hashes;
+    for (const auto& word : words) {
+        wordSlots.push_back({static_cast<uint32_t>(pool.size()), static_cast<uint32_t>(word.size())});
+        hashes.push_back(hashWord(word));
+        pool += word;
+        maxLength = std::max(maxLength, word.size());
+    }
+
+    // Корзина - в среднем два слова, ячеек не меньше чем вдвое больше слов
+    displacements.assign(words.size() / 2 + 1, 0);
+    std::vector<std::vector<size_t>> buckets(displacements.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        buckets[bucketOf(hashes[i])].push_back(i);
+    }
+    std::vector<size_t> order(buckets.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    // Сначала большие корзины, пока свободных ячеек много
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    size_t slotCount = 2;
+    while (slotCount < words.size() * 2) {
+        slotCount *= 2;
+    }
+    while (true) {
+        slotMask = slotCount - 1;
+        slots.assign(slotCount, Slot {});
+        bool placed = true;
+        std::vector<size_t> taken;
+        for (size_t bucket : order) {
+            if (buckets[bucket].empty()) {
+                break;
+            }
+            bool found = false;
+            for (uint32_t displacement = 1; displacement < (1u << 16) && !found; ++displacement) {
+                taken.clear();
+                found = true;
+                for (size_t word : buckets[bucket]) {
+                    size_t slot = slotHash(hashes[word], displacement) & slotMask;
+                    if (slots[slot].length != 0 || std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+                        found = false;
+                        break;
+                    }
+                    taken.push_back(slot);
+                }
+                if (found) {
+                    displacements[bucket] = displacement;
+                    for (size_t k = 0; k < taken.size(); ++k) {
+                        slots[taken[k]] = wordSlots[buckets[bucket][k]];
+                    }
+                }
+            }
+            if (!found) {
+                placed = false;
+                break;
+            }
+        }
+        if (placed) {
+            return;
+        }
+        slotCount *= 2;
+    }
+}
+
+bool StopWordTable::contains(std::string_view word) const {
+    if (word.size() > maxLength || word.empty()) {
+        return false;
+    }
+    uint64_t hash = hashWord(word);
+    const Slot& slot = slots[slotHash(hash, displacements[bucketOf(hash)]) & slotMask];
+    return slot.length == word.size() && std::memcmp(pool.data() + slot.offset, word.data(), word.size()) == 0;
+}
+
+const std::vector<std::string>& Analyzer::defaultStopWords() {
+    static const std::vector<std::string> words = {
+            "the", "is", "at", "which", "on", "in", "and", "a", "to", "ah"
+    };
+    return words;
+}
+
+Analyzer::Analyzer() : Analyzer(defaultStopWords(), CaseFolding::Unicode, Stemmer::None) {}
+
+Analyzer::Analyzer(const std::vector<std::string>& stopWords, CaseFolding folding, Stemmer stemmer)
+        : folding(folding), stemmer(stemmer) {
+    // Стоп-слова проходят ту же нормализацию, что и текст, но без стеммера
+    if (!stopWords.empty()) {
+        Analyzer plain({}, folding, Stemmer::None);
+        Tokenizer tokenizer(plain);
+        std::string_view token;
+        for (const auto& word : stopWords) {
+            tokenizer.reset(word);
+            while (tokenizer.next(token)) {
+                stopWordList.emplace_back(token);
+            }
+        }
+        std::sort(stopWordList.begin(), stopWordList.end());
+        stopWordList.erase(std::unique(stopWordList.begin(), stopWordList.end()), stopWordList.end());
+        this->stopWords.build(stopWordList);
+    }
+
+    std::string settings = folding == CaseFolding::Unicode ? "unicode" : "ascii";
+    settings += stemmer == Stemmer::English ? "|english|" : "|none|";
+    for (const auto& word : stopWordList) {
+        settings += word;
+        settings.push_back('\0');
+    }
+    settingsFingerprint = fingerprintOf(settings);
+}
+
+std::shared_ptr<const Analyzer> Analyzer::standard() {
+    static const std::shared_ptr<const Analyzer> analyzer = std::make_shared<Analyzer>();
+    return analyzer;
+}
+
+void Analyzer::foldCharacter(const char*& position, const char* end, std::string& out) {
+    unsigned char lead = static_cast<unsigned char>(*position);
+    if ((lead & 0xE0) == 0xC0 && end - position >= 2 && isContinuation(position + 1)) {
+        uint32_t code = (lead & 0x1Fu) << 6 | (static_cast<unsigned char>(position[1]) & 0x3Fu);
+        if (code >= 0x80) {
+            if (FOLD_TABLE[code] != 0) {
+                appendUtf8(out, FOLD_TABLE[code]);
+            }
+            position += 2;
+            return;
+        }
+    } else if ((lead & 0xF0) == 0xE0 && end - position >= 3 && isContinuation(position + 1) &&
+               isContinuation(position + 2)) {
+        uint32_t code = (lead & 0x0Fu) << 12 | (static_cast<unsigned char>(position[1]) & 0x3Fu) << 6 |
+                        (static_cast<unsigned char>(position[2]) & 0x3Fu);
+        // Знаки общей пунктуации (тире, кавычки, многоточие) и пунктуация CJK
+        bool punctuation = (code >= 0x2000 && code <= 0x206F) || (code >= 0x3000 && code <= 0x303F);
+        if (!punctuation) {
+            out.append(position, 3);
+        }
+        position += 3;
+        return;
+    }
+    // Остальные символы и неверные последовательности копируются по байту
+    out.push_back(*position++);
+}
+
+// Правила S-stemmer: -ies -> -y, -es -> -e, -s снимается; -us, -ss и -aes/-ees/-oes/-ies не трогаются
+std::string_view Analyzer::stem(std::string_view word, std::string& buffer) const {
+    size_t length = word.size();
+    if (stemmer == Stemmer::None || length < 3 || word[length - 1] != 's') {
+        return word;
+    }
+    switch (word[length - 2]) {
+        case 'u':
+        case 's':
+            return word;
+        case 'e':
+            if (length > 3 && word[length - 3] == 'i' && word[length - 4] != 'a' && word[length - 4] != 'e') {
+                buffer.assign(word.data(), length - 3);
+                buffer.push_back('y');
+                return buffer;
+            }
+            if (word[length - 3] == 'i' || word[length - 3] == 'a' || word[length - 3] == 'o' ||
+                word[length - 3] == 'e') {
+                return word;
+            }
+            return word.substr(0, length - 1);
+        default:
+            return word.substr(0, length - 1);
+    }
+}
+
+bool Analyzer::parseCaseFolding(std::string_view name, CaseFolding& value) {
+    if (name == "ascii") {
+        value = CaseFolding::Ascii;
+    } else if (name == "unicode") {
+        value = CaseFolding::Unicode;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool Analyzer::parseStemmer(std::string_view name, Stemmer& value) {
+    if (name == "none") {
+        value = Stemmer::None;
+    } else if (name == "english") {
+        value = Stemmer::English;
+    } else {
+        return false;
+    }
+    return true;
+}
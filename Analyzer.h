@@ -0,0 +1,96 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Приведение к нижнему регистру: только ASCII или еще буквы UTF-8 до U+07FF
+// (латиница с диакритикой, греческий, кириллица, армянский)
+enum class CaseFolding {
+    Ascii,
+    Unicode
+};
+
+// Stemmer::English - легкий S-stemmer (Harman): снимает только окончания множественного числа
+enum class Stemmer {
+    None,
+    English
+};
+
+/*
+ Стоп-слова в совершенной хеш-таблице (hash and displace).
+
+ Слова раскладываются по корзинам, для каждой корзины подбирается сдвиг
+ хеша, при котором слова всех корзин попадают в разные ячейки. Проверка
+ слова - один хеш, чтение сдвига корзины и сравнение с единственной
+ ячейкой, без строк в куче.
+*/
+class StopWordTable {
+private:
+    struct Slot {
+        uint32_t offset = 0;
+        uint32_t length = 0;   // 0 - пустая ячейка
+    };
+
+    std::string pool;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> displacements;
+    uint64_t slotMask = 0;
+    size_t maxLength = 0;
+
+    static uint64_t hashWord(std::string_view word);
+    static uint64_t slotHash(uint64_t hash, uint32_t displacement);
+    size_t bucketOf(uint64_t hash) const;
+
+public:
+    // Слова уже нормализованы, повторы допускаются
+    void build(std::vector<std::string> words);
+    bool contains(std::string_view word) const;
+    bool empty() const { return maxLength == 0; }
+};
+
+/*
+ Настройки нормализации токенов, общие для индексации и запросов:
+ стоп-слова, приведение регистра и стеммер. Задаются в config.json,
+ неизменяемы после создания. Отпечаток настроек пишется в заголовок
+ сегмента, и индекс с другим отпечатком строится заново.
+*/
+class Analyzer {
+private:
+    StopWordTable stopWords;
+    std::vector<std::string> stopWordList;
+    CaseFolding folding = CaseFolding::Unicode;
+    Stemmer stemmer = Stemmer::None;
+    uint32_t settingsFingerprint = 0;
+
+public:
+    // Стоп-слова по умолчанию, если в config.json нет списка
+    static const std::vector<std::string>& defaultStopWords();
+
+    // Настройки по умолчанию
+    Analyzer();
+    Analyzer(const std::vector<std::string>& stopWords, CaseFolding folding, Stemmer stemmer);
+    static std::shared_ptr<const Analyzer> standard();
+
+    CaseFolding caseFolding() const { return folding; }
+    bool stems() const { return stemmer != Stemmer::None; }
+    bool isStopWord(std::string_view word) const { return stopWords.contains(word); }
+    uint32_t fingerprint() const { return settingsFingerprint; }
+
+    // Символ UTF-8 с первого байта *position (>= 0x80): в out дописывается он же
+    // в нижнем регистре или ничего для пунктуации, position сдвигается за символ
+    static void foldCharacter(const char*& position, const char* end, std::string& out);
+    // Основа слова: view на word или в buffer
+    std::string_view stem(std::string_view word, std::string& buffer) const;
+
+    // Значения из config.json, false - имя неизвестно
+    static bool parseCaseFolding(std::string_view name, CaseFolding& value);
+    static bool parseStemmer(std::string_view name, Stemmer& value);
+};
+
+#endif // ANALYZER_H
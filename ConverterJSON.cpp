@@ -1,4 +1,5 @@
 #include "ConverterJSON.h"
+#include "DocumentRegistry.h"
 
 std::string ConverterJSON::getName() {
     return name;
@@ -12,10 +13,38 @@ std::vector<std::string> ConverterJSON::GetTextDocuments() {
     return files;
 }
 
+const std::unordered_map<std::string, int>& ConverterJSON::getDocumentIds() const {
+    return documentIds;
+}
+
+void ConverterJSON::setThreadCount(unsigned count) {
+    scanner.setThreadCount(count);
+}
+
 int ConverterJSON::GetResponsesLimit() const {
     return maxResponses;
 }
 
+size_t ConverterJSON::getIndexMemoryLimit() const {
+    return static_cast<size_t>(indexMemory) * 1024 * 1024;
+}
+
+CodecType ConverterJSON::getIndexCodec() const {
+    return indexCodec;
+}
+
+size_t ConverterJSON::getQueryCacheLimit() const {
+    return static_cast<size_t>(queryCacheMemory) * 1024 * 1024;
+}
+
+std::shared_ptr<const Analyzer> ConverterJSON::getAnalyzer() const {
+    return analyzer;
+}
+
+bool ConverterJSON::getSnippets() const {
+    return snippets;
+}
+
 bool ConverterJSON::loadConfig() {
     std::ifstream configFile("../config.json");
 
@@ -76,37 +105,104 @@ bool ConverterJSON::loadConfig() {
             return false;
         }
 
-        files.clear();
-        std::string resourcesPath = "../resources";
+        // Необязательный параметр: сколько памяти занимать вхождениям при построении индекса
+        indexMemory = DEFAULT_INDEX_MEMORY;
+        if (configJson["config"].contains("index_memory_mb")) {
+            indexMemory = configJson["config"]["index_memory_mb"];
+            if (indexMemory <= 0) {
+                std::cerr << "Invalid index_memory_mb in config.json. It must be a positive integer." << std::endl;
+                return false;
+            }
+        }
 
-        if (!fs::exists(resourcesPath) || !fs::is_directory(resourcesPath)) {
-            std::cerr << "Error: Resources path does not exist or is not a directory." << std::endl;
+        // Необязательный параметр: кодек списков в новых сегментах (varint, group_varint, pfor)
+        indexCodec = DEFAULT_CODEC;
+        if (configJson["config"].contains("index_codec") &&
+            !IntegerCodec::parse(configJson["config"]["index_codec"].get<std::string>(), indexCodec)) {
+            std::cerr << "Invalid index_codec in config.json. It must be varint, group_varint or pfor." << std::endl;
             return false;
-        } else {
-            int nextDocID = 1;
-            configJson["document_id"] = json::object();
+        }
+
+        // Необязательный параметр: сколько памяти занимать кэшу ответов, 0 - не кэшировать
+        queryCacheMemory = DEFAULT_QUERY_CACHE_MEMORY;
+        if (configJson["config"].contains("query_cache_mb")) {
+            queryCacheMemory = configJson["config"]["query_cache_mb"];
+            if (queryCacheMemory < 0) {
+                std::cerr << "Invalid query_cache_mb in config.json. It must be a non-negative integer." << std::endl;
+                return false;
+            }
+        }
 
-            for (const auto& entry : fs::directory_iterator(resourcesPath)) {
-                if (entry.is_regular_file()) {
-                    std::string relativePath = fs::relative(entry.path(), fs::current_path()).string();
-                    std::replace(relativePath.begin(), relativePath.end(), '\\', '/');
-                    files.push_back(relativePath);
+        // Необязательный параметр: сниппеты с выделенными словами в ответах; индекс тогда
+        // хранит байтовые границы токенов, и при смене параметра строится заново
+        snippets = false;
+        if (configJson["config"].contains("snippets")) {
+            if (!configJson["config"]["snippets"].is_boolean()) {
+                std::cerr << "Invalid snippets in config.json. It must be true or false." << std::endl;
+                return false;
+            }
+            snippets = configJson["config"]["snippets"];
+        }
 
-                    configJson["document_id"][relativePath] = nextDocID++;
-                }
+        // Необязательный раздел: стоп-слова, приведение регистра (ascii, unicode) и стеммер (none, english)
+        analyzer = Analyzer::standard();
+        if (configJson["config"].contains("analyzer")) {
+            const json& settings = configJson["config"]["analyzer"];
+            std::vector<std::string> stopWords = Analyzer::defaultStopWords();
+            CaseFolding folding = CaseFolding::Unicode;
+            Stemmer stemmer = Stemmer::None;
+            if (settings.contains("stop_words")) {
+                stopWords = settings["stop_words"].get<std::vector<std::string>>();
+            }
+            if (settings.contains("case_folding") &&
+                !Analyzer::parseCaseFolding(settings["case_folding"].get<std::string>(), folding)) {
+                std::cerr << "Invalid analyzer.case_folding in config.json. It must be ascii or unicode." << std::endl;
+                return false;
+            }
+            if (settings.contains("stemmer") &&
+                !Analyzer::parseStemmer(settings["stemmer"].get<std::string>(), stemmer)) {
+                std::cerr << "Invalid analyzer.stemmer in config.json. It must be none or english." << std::endl;
+                return false;
             }
+            analyzer = std::make_shared<const Analyzer>(stopWords, folding, stemmer);
+        }
+
+        // Необязательные шаблоны файлов документов, см. CorpusScanner
+        std::vector<std::string> include;
+        std::vector<std::string> exclude;
+        if (configJson["config"].contains("include")) {
+            include = configJson["config"]["include"].get<std::vector<std::string>>();
+        }
+        if (configJson["config"].contains("exclude")) {
+            exclude = configJson["config"]["exclude"].get<std::vector<std::string>>();
+        }
+        scanner.setPatterns(std::move(include), std::move(exclude));
 
-            configJson["files"] = files;
+        std::string resourcesPath = "../resources";
+        if (!scanner.scan(resourcesPath, files)) {
+            std::cerr << "Error: Resources path does not exist or is not a directory." << std::endl;
+            return false;
         }
 
-        std::ofstream outputConfigFile("../config.json");
-        if (!outputConfigFile.is_open()) {
-            std::cerr << "Error: Unable to write to config file." << std::endl;
+        // id документов живут в реестре и не зависят от порядка обхода; config.json не переписывается.
+        // Реестра еще нет - берем id, которые прежние версии записывали в config.json
+        DocumentRegistry registry;
+        bool changed = !registry.load(DOCUMENT_REGISTRY_PATH);
+        if (changed && configJson.contains("document_id")) {
+            for (const auto& [filePath, documentId] : configJson["document_id"].items()) {
+                registry.assign(filePath, documentId.get<uint32_t>());
+            }
+        }
+        changed |= registry.update(files);
+        if (changed && !registry.save(DOCUMENT_REGISTRY_PATH)) {
             return false;
         }
 
-        outputConfigFile << configJson.dump(4);
-        outputConfigFile.close();
+        documentIds.clear();
+        documentIds.reserve(registry.size());
+        for (const auto& [filePath, documentId] : registry.documents()) {
+            documentIds.emplace(filePath, static_cast<int>(documentId));
+        }
 
     } catch (json::type_error& e) {
         std::cerr << "Error reading configuration: " << e.what() << std::endl;
@@ -115,93 +211,35 @@ bool ConverterJSON::loadConfig() {
     return true;
 }
 
-void ConverterJSON::saveIndex(const std::unordered_map<std::string, int>& termIdMap,
-                              const std::unordered_map<int, std::vector<std::pair<int, int>>>& invertedIndex,
-                              const std::unordered_map<int, std::unordered_map<int, std::vector<int>>>& positionalIndex) {
-    json indexJson;
-
-    // Создаем term_index
-    json termIndexJson;
-    json termToIdJson;
-    json idToTermJson;
-
-    for (const auto& [term, id] : termIdMap) {
-        termToIdJson[term] = id;
-        idToTermJson[std::to_string(id)] = term;
-    }
-
-    termIndexJson["term_to_id"] = termToIdJson;
-    termIndexJson["id_to_term"] = idToTermJson;
-    indexJson["term_index"] = termIndexJson;
-
-    // Создаем inverted_index
-    json invertedIndexJson;
-    for (const auto& [termId, docList] : invertedIndex) {
-        json docListJson;
-        for (const auto& [documentId, frequency] : docList) {
-            docListJson.push_back({{"document_id", documentId}, {"frequency", frequency}});
-        }
-        invertedIndexJson[std::to_string(termId)] = docListJson;
-    }
-    indexJson["inverted_index"] = invertedIndexJson;
-
-    // Создаем positional_index
-    json positionalIndexJson;
-    for (const auto& [termId, docMap] : positionalIndex) {
-        json docMapJson;
-        for (const auto& [documentId, positions] : docMap) {
-            docMapJson[std::to_string(documentId)] = {{"positions", positions}};
-        }
-        positionalIndexJson[std::to_string(termId)] = docMapJson;
-    }
-    indexJson["positional_index"] = positionalIndexJson;
-
-    // Сохраняем индекс в index.json
-    std::ofstream indexFile("../index.json");
-    if (!indexFile.is_open()) {
-        std::cerr << "Error: Unable to write to index file." << std::endl;
-        return;
-    }
-    indexFile << indexJson.dump(4);
-    indexFile.close();
-}
-
-//Преобразуем список запросов из JSON файла в вектор
+// Запросы из requests.json, а если его нет - из requests.jsonl (по запросу в строке)
 std::vector<std::string> ConverterJSON::GetRequests() {
     std::vector<std::string> listRequests;
-    objJson.clear();
-
-    std::ifstream requestsFile("../requests.json");
-    if (!requestsFile)
-        std::cerr << "File requests.json not found."<<std::endl;
-    requestsFile >> objJson;
-    requestsFile.close();
-    for (const auto &i: objJson["requests"])
-        listRequests.push_back(i);
+    RequestReader reader;
+    bool jsonLines = !fs::exists("../requests.json") && fs::exists("../requests.jsonl");
+    if (!reader.open(jsonLines ? "../requests.jsonl" : "../requests.json", jsonLines)) {
+        std::cerr << "File requests.json not found." << std::endl;
+        return listRequests;
+    }
+    std::string request;
+    while (reader.next(request)) {
+        listRequests.push_back(std::move(request));
+    }
     return listRequests;
 }
 
-/*
- Преобразуем вектор с результатами поиска в JSON файл
-void ConverterJSON::putAnswers(std::vector<std::vector<std::pair<int, float>>> answers)
+// Ответы пишутся в answers.json по мере сериализации, без дерева JSON
+void ConverterJSON::putAnswers(const std::vector<std::vector<std::pair<int, float>>>& answers,
+                               const std::vector<std::vector<std::string>>* snippets)
 {
-    fileInput.open("../../answers.json", std::ios::out);
-    objJson = {{"Answers:",{}}};
-    for(int i = 0; i < answers.size(); ++i)
-    {
-        objJson["Answers:"]["request"+ std::to_string(i)+":"];
-        if(answers[i].empty())
-        {
-            objJson["Answers:"]["request"+ std::to_string(i)+":"] ={{"result:", "false"}};
-            continue;
-        }
-        else
-            objJson["Answers:"]["request"+ std::to_string(i)+":"] ={{"result:", "true"}};
-        for(int j = 0; j < answers[i].size(); ++j)
-        {
-            objJson["Answers:"]["request"+ std::to_string(i)+":"]["relevance:"].push_back({{"docid:", answers[i][j].first},{"rank:", ceil(answers[i][j].second*1000)/1000}});
-        }
+    AnswersWriter writer;
+    if (!writer.open("../answers.json")) {
+        std::cerr << "Error: Unable to write to answers file." << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < answers.size(); ++i) {
+        writer.add(answers[i], snippets != nullptr && i < snippets->size() ? &(*snippets)[i] : nullptr);
     }
-    fileInput << objJson;
-    fileInput.close();
-}*/
\ No newline at end of file
+    if (!writer.close()) {
+        std::cerr << "Error: Unable to write to answers file." << std::endl;
+    }
+}
@@ -11,6 +11,11 @@
 #include <filesystem>
 #include <algorithm>
 #include <memory>
+#include <cmath>
+#include "Analyzer.h"
+#include "CorpusScanner.h"
+#include "JsonStream.h"
+#include "PostingCodec.h"
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
@@ -21,10 +26,21 @@ private:
     std::string version;
     int maxResponses;
     int timeUpdate;
+    int indexMemory = DEFAULT_INDEX_MEMORY;
+    CodecType indexCodec = DEFAULT_CODEC;
+    int queryCacheMemory = DEFAULT_QUERY_CACHE_MEMORY;
+    bool snippets = false;
+    std::shared_ptr<const Analyzer> analyzer = Analyzer::standard();
     std::vector<std::string> files;
-    nlohmann::json objJson;
+    std::unordered_map<std::string, int> documentIds;
+    CorpusScanner scanner;
 
 public:
+    // Память под вхождения при построении индекса по умолчанию, МБ
+    static constexpr int DEFAULT_INDEX_MEMORY = 512;
+    // Память под кэш ответов на запросы по умолчанию, МБ
+    static constexpr int DEFAULT_QUERY_CACHE_MEMORY = 64;
+
     ConverterJSON() = default;
     //значение имени движка из config
     std::string getName();
@@ -32,19 +48,30 @@ public:
     int getTimeUpdate();
     //список документов для поиска
     std::vector<std::string> GetTextDocuments();
+    //document_id файлов списка из реестра index.registry
+    const std::unordered_map<std::string, int>& getDocumentIds() const;
+    //число потоков обхода каталога документов (0 - по числу ядер)
+    void setThreadCount(unsigned count);
     //максимальное количество ответов на один запрос
     int GetResponsesLimit() const;
-    //список запросов
+    //память под построение индекса из config (index_memory_mb), в байтах
+    size_t getIndexMemoryLimit() const;
+    //кодек списков в сегментах индекса из config (index_codec)
+    CodecType getIndexCodec() const;
+    //память под кэш ответов из config (query_cache_mb), в байтах; 0 - кэш выключен
+    size_t getQueryCacheLimit() const;
+    //нормализация текста документов и запросов из config (analyzer)
+    std::shared_ptr<const Analyzer> getAnalyzer() const;
+    //сниппеты в ответах и границы токенов в индексе из config (snippets)
+    bool getSnippets() const;
+    //список запросов (requests.json или requests.jsonl)
     std::vector<std::string> GetRequests();
     /*Получаем вектор с данными по релеватности документов каждому запросу*/
-    void putAnswers(std::vector<std::vector<std::pair<int, float>>>answers);
+    void putAnswers(const std::vector<std::vector<std::pair<int, float>>>& answers,
+                    const std::vector<std::vector<std::string>>* snippets = nullptr);
 
     // Вспомогательные методы (проверка и парсинг config)
     bool loadConfig();
-    //создание базы термов
-    void saveIndex(const std::unordered_map<std::string, int>& termIdMap,
-                   const std::unordered_map<int, std::vector<std::pair<int, int>>>& invertedIndex,
-                   const std::unordered_map<int, std::unordered_map<int, std::vector<int>>>& positionalIndex);
 };
 
 #endif // CONVERTERJSON_H
@@ -0,0 +1,115 @@
+#include "CorpusScanner.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <iterator>
+
+namespace fs = std::filesystem;
+
+void CorpusScanner::setThreadCount(unsigned count) {
+    if (count != threadCount) {
+        threadCount = count;
+        pool.reset();
+    }
+}
+
+void CorpusScanner::setPatterns(std::vector<std::string> include, std::vector<std::string> exclude) {
+    includePatterns = std::move(include);
+    excludePatterns = std::move(exclude);
+}
+
+bool CorpusScanner::matchGlob(std::string_view pattern, std::string_view text) {
+    while (!pattern.empty() && pattern[0] != '*') {
+        if (text.empty() || (pattern[0] == '?' ? text[0] == '/' : pattern[0] != text[0])) {
+            return false;
+        }
+        pattern.remove_prefix(1);
+        text.remove_prefix(1);
+    }
+    if (pattern.empty()) {
+        return text.empty();
+    }
+
+    bool anyDepth = pattern.size() > 1 && pattern[1] == '*';
+    std::string_view rest = pattern.substr(anyDepth ? 2 : 1);
+    // "**/" совпадает и с пустым списком каталогов
+    if (anyDepth && !rest.empty() && rest[0] == '/' && matchGlob(rest.substr(1), text)) {
+        return true;
+    }
+    for (size_t skipped = 0; skipped <= text.size(); ++skipped) {
+        if (matchGlob(rest, text.substr(skipped))) {
+            return true;
+        }
+        if (skipped < text.size() && !anyDepth && text[skipped] == '/') {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool CorpusScanner::matchesAny(const std::vector<std::string>& patterns, std::string_view path,
+                               std::string_view name) {
+    for (const auto& pattern : patterns) {
+        bool withDirectories = pattern.find('/') != std::string::npos;
+        if (matchGlob(pattern, withDirectories ? path : name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CorpusScanner::scan(const std::string& root, std::vector<std::string>& files) {
+    PhaseTimer timer(Phase::Scan);
+    files.clear();
+    std::error_code error;
+    if (!fs::is_directory(root, error)) {
+        return false;
+    }
+    if (!pool) {
+        pool = std::make_unique<ThreadPool>(threadCount);
+    }
+
+    // Находки каждого потока отдельно, чтобы не делить вектора между потоками
+    struct Found {
+        std::vector<std::string> files;
+        std::vector<std::string> directories;
+    };
+    std::vector<std::string> level {""};
+    while (!level.empty()) {
+        std::vector<Found> found(pool->size());
+        pool->run(level.size(), [&](size_t index, unsigned worker) {
+            const std::string& relative = level[index];
+            std::string directory = relative.empty() ? root : root + "/" + relative;
+            std::error_code readError;
+            fs::directory_iterator it(directory, readError);
+            for (; !readError && it != fs::directory_iterator(); it.increment(readError)) {
+                std::string name = it->path().filename().string();
+                std::string path = relative.empty() ? name : relative + "/" + name;
+                std::error_code typeError;
+                // Ссылки на каталоги не обходятся, чтобы не зациклиться
+                if (it->is_directory(typeError) && !it->is_symlink(typeError)) {
+                    if (!matchesAny(excludePatterns, path, name)) {
+                        found[worker].directories.push_back(std::move(path));
+                    }
+                } else if (it->is_regular_file(typeError) &&
+                           (includePatterns.empty() || matchesAny(includePatterns, path, name)) &&
+                           !matchesAny(excludePatterns, path, name)) {
+                    found[worker].files.push_back(root + "/" + path);
+                }
+            }
+            if (readError) {
+                std::cerr << "Error: Unable to read directory " << directory << std::endl;
+            }
+        });
+
+        level.clear();
+        for (auto& workerFound : found) {
+            std::move(workerFound.files.begin(), workerFound.files.end(), std::back_inserter(files));
+            std::move(workerFound.directories.begin(), workerFound.directories.end(), std::back_inserter(level));
+        }
+    }
+
+    std::sort(files.begin(), files.end());
+    return true;
+}
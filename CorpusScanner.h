@@ -0,0 +1,42 @@
+#ifndef CORPUSSCANNER_H
+#define CORPUSSCANNER_H
+
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ThreadPool.h"
+
+/*
+ Рекурсивный поиск документов в каталоге.
+
+ Каталоги обходятся по уровням: все каталоги уровня читаются параллельно
+ на пуле потоков, найденные подкаталоги составляют следующий уровень.
+ Шаблоны include/exclude: "*" - любые символы кроме "/", "**" - любые,
+ "?" - один символ кроме "/". Шаблон с "/" сравнивается с путем от корня,
+ без "/" - с именем файла или каталога. Исключенный каталог не читается.
+ Список файлов сортируется и не зависит от порядка обхода и числа потоков.
+*/
+class CorpusScanner {
+private:
+    unsigned threadCount = 0;
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<std::string> includePatterns;
+    std::vector<std::string> excludePatterns;
+
+    static bool matchesAny(const std::vector<std::string>& patterns, std::string_view path, std::string_view name);
+
+public:
+    // 0 - по числу ядер
+    void setThreadCount(unsigned count);
+    // Пустой include - все файлы
+    void setPatterns(std::vector<std::string> include, std::vector<std::string> exclude);
+
+    // Файлы под root в виде "root/путь/от/корня", false - root не каталог
+    bool scan(const std::string& root, std::vector<std::string>& files);
+
+    static bool matchGlob(std::string_view pattern, std::string_view text);
+};
+
+#endif // CORPUSSCANNER_H
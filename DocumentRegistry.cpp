@@ -0,0 +1,128 @@
+#include "DocumentRegistry.h"
+#include "DurableFile.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <unordered_set>
+
+static constexpr char REGISTRY_MAGIC[4] = {'S', 'E', 'D', 'R'};
+static constexpr uint32_t REGISTRY_VERSION = 1;
+
+template <typename T>
+static void writeValue(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Файл читается целиком одним чтением и разбирается в памяти: на миллионе
+// файлов построчное чтение полей из потока заметно дольше
+bool DocumentRegistry::load(const std::string& path) {
+    clear();
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::string content(static_cast<size_t>(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(content.data(), static_cast<std::streamsize>(content.size()));
+
+    const char* position = content.data();
+    const char* end = content.data() + content.size();
+    auto readValue = [&](uint32_t& value) {
+        if (end - position < static_cast<std::ptrdiff_t>(sizeof(value))) {
+            return false;
+        }
+        std::memcpy(&value, position, sizeof(value));
+        position += sizeof(value);
+        return true;
+    };
+
+    uint32_t version = 0;
+    uint32_t recordCount = 0;
+    uint32_t storedNextId = 1;
+    bool valid = file && content.size() >= sizeof(REGISTRY_MAGIC) &&
+                 std::memcmp(position, REGISTRY_MAGIC, sizeof(REGISTRY_MAGIC)) == 0;
+    position += valid ? sizeof(REGISTRY_MAGIC) : 0;
+    valid = valid && readValue(version) && version == REGISTRY_VERSION &&
+            readValue(recordCount) && readValue(storedNextId);
+
+    ids.reserve(valid ? recordCount : 0);
+    for (uint32_t i = 0; valid && i < recordCount; ++i) {
+        uint32_t documentId = 0;
+        uint32_t pathLength = 0;
+        valid = readValue(documentId) && readValue(pathLength) && end - position >= pathLength;
+        if (valid) {
+            ids.emplace(std::string(position, pathLength), documentId);
+            position += pathLength;
+        }
+    }
+    if (!valid) {
+        std::cerr << "Error: " << path << " is damaged, document ids will be assigned again." << std::endl;
+        clear();
+        return false;
+    }
+    nextId = storedNextId;
+    return true;
+}
+
+bool DocumentRegistry::save(const std::string& path) const {
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Error: Unable to write to " << path << std::endl;
+        return false;
+    }
+
+    file.write(REGISTRY_MAGIC, sizeof(REGISTRY_MAGIC));
+    writeValue(file, REGISTRY_VERSION);
+    writeValue(file, static_cast<uint32_t>(ids.size()));
+    writeValue(file, nextId);
+    for (const auto& [documentPath, documentId] : ids) {
+        writeValue(file, documentId);
+        writeValue(file, static_cast<uint32_t>(documentPath.size()));
+        file.write(documentPath.data(), static_cast<std::streamsize>(documentPath.size()));
+    }
+    file.close();
+
+    if (!file) {
+        std::cerr << "Error: Unable to write to " << path << std::endl;
+        std::error_code error;
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return publishFile(temporaryPath, path);
+}
+
+void DocumentRegistry::clear() {
+    ids.clear();
+    nextId = 1;
+}
+
+void DocumentRegistry::assign(const std::string& filePath, uint32_t documentId) {
+    ids[filePath] = documentId;
+    nextId = std::max(nextId, documentId + 1);
+}
+
+bool DocumentRegistry::update(const std::vector<std::string>& files) {
+    bool changed = false;
+    std::unordered_set<std::string_view> present;
+    present.reserve(files.size());
+    for (const auto& filePath : files) {
+        present.insert(filePath);
+        if (ids.emplace(filePath, nextId).second) {
+            ++nextId;
+            changed = true;
+        }
+    }
+    for (auto it = ids.begin(); it != ids.end();) {
+        if (present.count(it->first) == 0) {
+            it = ids.erase(it);
+            changed = true;
+        } else {
+            ++it;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,45 @@
+#ifndef DOCUMENTREGISTRY_H
+#define DOCUMENTREGISTRY_H
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+inline const std::string DOCUMENT_REGISTRY_PATH = "../index.registry";
+
+/*
+ Реестр document_id (index.registry), отдельный от config.json.
+
+ Файл получает id при первом появлении и сохраняет его, пока существует;
+ id удаленных файлов больше не выдаются, поэтому id не зависят от порядка
+ обхода каталога и не меняются между запусками.
+
+ Формат (little-endian): магия, версия, число записей, следующий свободный id,
+ затем для каждой записи uint32 id, uint32 длина пути и байты пути.
+*/
+class DocumentRegistry {
+private:
+    std::unordered_map<std::string, uint32_t> ids;
+    uint32_t nextId = 1;
+
+public:
+    DocumentRegistry() = default;
+
+    bool load(const std::string& path);
+    // Запись во временный файл и переименование
+    bool save(const std::string& path) const;
+    void clear();
+
+    // Привязка файла к id (перенос id из старого config.json)
+    void assign(const std::string& filePath, uint32_t documentId);
+    // Id для всех файлов списка: новые файлы получают id по порядку списка,
+    // исчезнувшие удаляются. true - реестр изменился
+    bool update(const std::vector<std::string>& files);
+
+    const std::unordered_map<std::string, uint32_t>& documents() const { return ids; }
+    size_t size() const { return ids.size(); }
+};
+
+#endif // DOCUMENTREGISTRY_H
@@ -0,0 +1,125 @@
+#include "DocumentState.h"
+#include "DurableFile.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static constexpr char STATE_MAGIC[4] = {'S', 'E', 'D', 'S'};
+static constexpr uint32_t STATE_VERSION = 1;
+
+template <typename T>
+static void writeValue(std::ofstream& file, const T& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(std::ifstream& file, T& value) {
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+bool DocumentState::load(const std::string& path) {
+    clear();
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t recordCount = 0;
+    uint32_t deletedCount = 0;
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, STATE_MAGIC, sizeof(magic)) != 0 ||
+        !readValue(file, version) || version != STATE_VERSION ||
+        !readValue(file, recordCount) || !readValue(file, deletedCount)) {
+        std::cerr << "Error: " << path << " is damaged, index will be rebuilt." << std::endl;
+        return false;
+    }
+
+    for (uint32_t i = 0; i < recordCount; ++i) {
+        uint32_t pathLength = 0;
+        if (!readValue(file, pathLength)) {
+            clear();
+            return false;
+        }
+        std::string documentPath(pathLength, '\0');
+        DocumentRecord record;
+        uint8_t segment = 0;
+        if (!file.read(documentPath.data(), pathLength) ||
+            !readValue(file, record.documentId) || !readValue(file, segment) ||
+            !readValue(file, record.size) || !readValue(file, record.modified) ||
+            !readValue(file, record.contentHash)) {
+            clear();
+            return false;
+        }
+        record.segment = static_cast<DocumentSegment>(segment);
+        records.emplace(std::move(documentPath), record);
+    }
+
+    mainDeleted.resize(deletedCount);
+    if (!file.read(reinterpret_cast<char*>(mainDeleted.data()),
+                   static_cast<std::streamsize>(deletedCount * sizeof(uint32_t)))) {
+        clear();
+        return false;
+    }
+    return true;
+}
+
+// Пишется во временный файл и публикуется переименованием, чтобы после
+// сбоя не остаться с обрезанным состоянием
+bool DocumentState::save(const std::string& path) const {
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Error: Unable to write to " << path << std::endl;
+        return false;
+    }
+
+    file.write(STATE_MAGIC, sizeof(STATE_MAGIC));
+    writeValue(file, STATE_VERSION);
+    writeValue(file, static_cast<uint32_t>(records.size()));
+    writeValue(file, static_cast<uint32_t>(mainDeleted.size()));
+    for (const auto& [documentPath, record] : records) {
+        writeValue(file, static_cast<uint32_t>(documentPath.size()));
+        file.write(documentPath.data(), static_cast<std::streamsize>(documentPath.size()));
+        writeValue(file, record.documentId);
+        writeValue(file, static_cast<uint8_t>(record.segment));
+        writeValue(file, record.size);
+        writeValue(file, record.modified);
+        writeValue(file, record.contentHash);
+    }
+    file.write(reinterpret_cast<const char*>(mainDeleted.data()),
+               static_cast<std::streamsize>(mainDeleted.size() * sizeof(uint32_t)));
+    file.close();
+    if (!file) {
+        std::cerr << "Error: Unable to write to " << path << std::endl;
+        std::error_code error;
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return publishFile(temporaryPath, path);
+}
+
+void DocumentState::clear() {
+    records.clear();
+    mainDeleted.clear();
+}
+
+size_t DocumentState::deltaDocumentCount() const {
+    size_t count = 0;
+    for (const auto& [documentPath, record] : records) {
+        if (record.segment == DocumentSegment::Delta) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+uint64_t DocumentState::hashContent(std::string_view content, uint64_t hash) {
+    // FNV-1a, 64 бита
+    for (unsigned char c : content) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
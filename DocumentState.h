@@ -0,0 +1,56 @@
+#ifndef DOCUMENTSTATE_H
+#define DOCUMENTSTATE_H
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+// Сегмент, в котором сейчас лежат postings документа
+enum class DocumentSegment : uint8_t {
+    Main = 0,
+    Delta = 1
+};
+
+// Состояние проиндексированного документа
+struct DocumentRecord {
+    uint32_t documentId = 0;
+    DocumentSegment segment = DocumentSegment::Main;
+    uint64_t size = 0;
+    int64_t modified = 0;     // время изменения файла в тиках file_time_type
+    uint64_t contentHash = 0;
+};
+
+/*
+ Состояние индекса на диске (index.state): для каждого файла размер,
+ время изменения и хеш содержимого, а также id документов основного
+ сегмента, которые уже скрыты дельтой.
+*/
+class DocumentState {
+private:
+    std::unordered_map<std::string, DocumentRecord> records;
+    std::vector<uint32_t> mainDeleted;
+
+public:
+    DocumentState() = default;
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+    void clear();
+
+    std::unordered_map<std::string, DocumentRecord>& documents() { return records; }
+    const std::unordered_map<std::string, DocumentRecord>& documents() const { return records; }
+    std::vector<uint32_t>& deletedFromMain() { return mainDeleted; }
+
+    // Число документов, которые сейчас лежат в дельте
+    size_t deltaDocumentCount() const;
+
+    // FNV-1a, начальное значение хеша
+    static constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+    // Хеш содержимого; чтобы считать по частям, передается хеш предыдущей части
+    static uint64_t hashContent(std::string_view content, uint64_t hash = HASH_SEED);
+};
+
+#endif // DOCUMENTSTATE_H
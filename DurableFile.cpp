@@ -0,0 +1,66 @@
+#include "DurableFile.h"
+#include <filesystem>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+bool syncFile(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    bool synced = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return synced;
+#else
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        return false;
+    }
+    bool synced = ::fsync(descriptor) == 0;
+    ::close(descriptor);
+    return synced;
+#endif
+}
+
+bool syncDirectory(const std::string& directory) {
+#ifdef _WIN32
+    (void)directory;
+    return true;
+#else
+    int descriptor = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (descriptor < 0) {
+        return false;
+    }
+    bool synced = ::fsync(descriptor) == 0;
+    ::close(descriptor);
+    return synced;
+#endif
+}
+
+bool publishFile(const std::string& temporaryPath, const std::string& path) {
+    std::error_code error;
+    if (!syncFile(temporaryPath)) {
+        std::cerr << "Error: Unable to flush " << temporaryPath << " to disk" << std::endl;
+        fs::remove(temporaryPath, error);
+        return false;
+    }
+    fs::rename(temporaryPath, path, error);
+    if (error) {
+        std::cerr << "Error: Unable to replace " << path << ": " << error.message() << std::endl;
+        fs::remove(temporaryPath, error);
+        return false;
+    }
+    // Без сброса каталога после сбоя может остаться старое имя
+    syncDirectory(fs::path(path).parent_path().string());
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef DURABLEFILE_H
+#define DURABLEFILE_H
+
+#pragma once
+#include <string>
+
+/*
+ Запись файлов, которую не видно наполовину.
+
+ Файл пишется рядом во временный, сбрасывается на диск (fsync) и
+ переименовывается на место. Переименование атомарно: читатель видит
+ либо старый файл целиком, либо новый, а после сбоя на диске остается
+ один из них. Затем сбрасывается каталог, чтобы сохранилось само
+ переименование.
+*/
+
+// Сброс содержимого файла на диск, false - ошибка
+bool syncFile(const std::string& path);
+// Сброс записи каталога (на Windows не требуется и ничего не делает)
+bool syncDirectory(const std::string& directory);
+// fsync временного файла, переименование на место path и fsync каталога.
+// При ошибке временный файл удаляется
+bool publishFile(const std::string& temporaryPath, const std::string& path);
+
+#endif // DURABLEFILE_H
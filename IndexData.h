@@ -0,0 +1,185 @@
+#ifndef INDEXDATA_H
+#define INDEXDATA_H
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "PostingCodec.h"
+
+// Вхождение терма в документ
+struct IndexPosting {
+    uint32_t documentId;
+    uint32_t frequency;
+};
+
+/*
+ Байтовые границы токенов документов в их файлах, для сниппетов.
+ Запись документа:
+   uint64 размер пар
+   uint32 число контрольных точек n
+   n * (uint64 смещение пары от начала пар, uint64 конец предыдущего токена) -
+       перед токенами с позициями CHECKPOINT_INTERVAL, 2 * CHECKPOINT_INTERVAL, ...
+   пары varint в порядке позиций: отступ начала токена от конца предыдущего и длина токена
+ Токен с позицией p находится без повторного разбора текста и без чтения
+ записи с начала: от ближайшей контрольной точки читается меньше
+ CHECKPOINT_INTERVAL пар.
+*/
+struct TokenOffsets {
+    static constexpr uint32_t CHECKPOINT_INTERVAL = 128;
+    // Размер заголовка записи без контрольных точек и размер одной точки
+    static constexpr size_t RECORD_HEADER_SIZE = sizeof(uint64_t) + sizeof(uint32_t);
+    static constexpr size_t CHECKPOINT_SIZE = 2 * sizeof(uint64_t);
+
+    std::string records;
+    // Пары (документ, начало его записи в records)
+    std::vector<std::pair<uint32_t, uint64_t>> starts;
+    // Запись, которая сейчас строится: начало ее пар, контрольные точки и число токенов
+    size_t pairsStart = 0;
+    std::string checkpoints;
+    uint64_t previousEnd = 0;
+    uint32_t tokenCount = 0;
+
+    bool empty() const { return starts.empty(); }
+    // Запись документа строится по токенам: beginDocument, addToken по позициям, endDocument
+    void beginDocument(uint32_t documentId) {
+        starts.emplace_back(documentId, records.size());
+        pairsStart = records.size();
+        checkpoints.clear();
+        previousEnd = 0;
+        tokenCount = 0;
+    }
+    void addToken(uint64_t begin, uint64_t end) {
+        if (tokenCount > 0 && tokenCount % CHECKPOINT_INTERVAL == 0) {
+            uint64_t checkpoint[2] = {records.size() - pairsStart, previousEnd};
+            checkpoints.append(reinterpret_cast<const char*>(checkpoint), sizeof(checkpoint));
+        }
+        putVarint(records, static_cast<uint32_t>(begin - previousEnd));
+        putVarint(records, static_cast<uint32_t>(end - begin));
+        previousEnd = end;
+        ++tokenCount;
+    }
+    // Заголовок вставляется перед парами, когда известны их размер и контрольные точки
+    void endDocument() {
+        uint64_t pairsSize = records.size() - pairsStart;
+        uint32_t checkpointCount = static_cast<uint32_t>(checkpoints.size() / CHECKPOINT_SIZE);
+        std::string header(reinterpret_cast<const char*>(&pairsSize), sizeof(pairsSize));
+        header.append(reinterpret_cast<const char*>(&checkpointCount), sizeof(checkpointCount));
+        header += checkpoints;
+        records.insert(pairsStart, header);
+        checkpoints.clear();
+    }
+    // Размер готовой записи в байтах
+    static size_t recordSize(const uint8_t* record) {
+        uint64_t pairsSize = 0;
+        uint32_t checkpointCount = 0;
+        std::memcpy(&pairsSize, record, sizeof(pairsSize));
+        std::memcpy(&checkpointCount, record + sizeof(pairsSize), sizeof(checkpointCount));
+        return RECORD_HEADER_SIZE + checkpointCount * CHECKPOINT_SIZE + pairsSize;
+    }
+    // Готовая запись документа из другого сегмента, копируется как есть
+    void appendRecord(uint32_t documentId, const uint8_t* record) {
+        starts.emplace_back(documentId, records.size());
+        records.append(reinterpret_cast<const char*>(record), recordSize(record));
+    }
+    void append(const TokenOffsets& other) {
+        for (const auto& [documentId, start] : other.starts) {
+            starts.emplace_back(documentId, records.size() + start);
+        }
+        records += other.records;
+    }
+    size_t memoryUsage() const {
+        return records.capacity() + checkpoints.capacity() + starts.capacity() * sizeof(std::pair<uint32_t, uint64_t>);
+    }
+};
+
+// Чтение записи TokenOffsets с любой позиции
+class TokenOffsetReader {
+private:
+    const uint8_t* checkpoints;
+    const uint8_t* pairs;
+    uint32_t checkpointCount = 0;
+    const uint8_t* data;
+    uint64_t previousEnd = 0;
+
+public:
+    explicit TokenOffsetReader(const uint8_t* record) {
+        std::memcpy(&checkpointCount, record + sizeof(uint64_t), sizeof(checkpointCount));
+        checkpoints = record + TokenOffsets::RECORD_HEADER_SIZE;
+        pairs = checkpoints + checkpointCount * TokenOffsets::CHECKPOINT_SIZE;
+        data = pairs;
+    }
+
+    // Следующий next вернет токен с позицией position
+    void seek(uint32_t position) {
+        uint32_t checkpoint = std::min(position / TokenOffsets::CHECKPOINT_INTERVAL, checkpointCount);
+        data = pairs;
+        previousEnd = 0;
+        if (checkpoint > 0) {
+            uint64_t entry[2];
+            std::memcpy(entry, checkpoints + (checkpoint - 1) * TokenOffsets::CHECKPOINT_SIZE, sizeof(entry));
+            data = pairs + entry[0];
+            previousEnd = entry[1];
+        }
+        uint64_t begin = 0;
+        uint64_t end = 0;
+        for (uint32_t skipped = checkpoint * TokenOffsets::CHECKPOINT_INTERVAL; skipped < position; ++skipped) {
+            next(begin, end);
+        }
+    }
+    // Границы следующего токена [begin, end) от начала файла документа
+    void next(uint64_t& begin, uint64_t& end) {
+        begin = previousEnd + getVarint(data);
+        end = begin + getVarint(data);
+        previousEnd = end;
+    }
+};
+
+/*
+ Индекс в памяти в компактном виде (CSR), id термов 32-битные и начинаются с 1.
+
+ Списки всех термов лежат подряд в одном массиве postings: список терма id -
+ [postingOffsets[id], postingOffsets[id + 1]), документы в нем по возрастанию.
+ Позиции всех вхождений лежат в одном массиве positions в том же порядке:
+ позиции терма начинаются с positionOffsets[id], у каждого вхождения их frequency штук.
+ Строки термов записаны подряд в termText.
+*/
+struct IndexData {
+    std::string termText;
+    std::vector<uint32_t> termTextOffsets;
+    std::vector<uint32_t> postingOffsets;
+    std::vector<IndexPosting> postings;
+    std::vector<uint64_t> positionOffsets;
+    std::vector<uint32_t> positions;
+    // Хеши содержимого в порядке списка файлов
+    std::vector<uint64_t> contentHashes;
+    // Границы токенов, если индекс строится с ними
+    TokenOffsets tokenOffsets;
+
+    // Число id, включая пустой id 0
+    uint32_t idCount() const {
+        return postingOffsets.empty() ? 0 : static_cast<uint32_t>(postingOffsets.size() - 1);
+    }
+    std::string_view term(uint32_t termId) const {
+        return std::string_view(termText).substr(termTextOffsets[termId],
+                                                 termTextOffsets[termId + 1] - termTextOffsets[termId]);
+    }
+    const IndexPosting* postingsBegin(uint32_t termId) const { return postings.data() + postingOffsets[termId]; }
+    const IndexPosting* postingsEnd(uint32_t termId) const { return postings.data() + postingOffsets[termId + 1]; }
+    const uint32_t* positionsBegin(uint32_t termId) const { return positions.data() + positionOffsets[termId]; }
+
+    // Байты, занятые массивами индекса
+    size_t memoryUsage() const {
+        return termText.capacity() + termTextOffsets.capacity() * sizeof(uint32_t) +
+               postingOffsets.capacity() * sizeof(uint32_t) + postings.capacity() * sizeof(IndexPosting) +
+               positionOffsets.capacity() * sizeof(uint64_t) + positions.capacity() * sizeof(uint32_t) +
+               contentHashes.capacity() * sizeof(uint64_t) + tokenOffsets.memoryUsage();
+    }
+};
+
+#endif // INDEXDATA_H
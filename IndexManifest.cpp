@@ -0,0 +1,226 @@
+#include "IndexManifest.h"
+#include "DurableFile.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static constexpr char MANIFEST_MAGIC[4] = {'S', 'E', 'M', 'F'};
+static constexpr uint32_t MANIFEST_VERSION = 1;
+
+template <typename T>
+static void appendValue(std::string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Имя файла рядом с манифестом
+static std::string besideManifest(const std::string& manifestPath, const std::string& name) {
+    return (fs::path(manifestPath).parent_path() / name).string();
+}
+
+static std::string generationPath(uint64_t generation, const char* suffix) {
+    return besideManifest(INDEX_MANIFEST_PATH, "index." + std::to_string(generation) + suffix);
+}
+
+std::string IndexManifest::segmentPath(uint64_t generation) {
+    return generationPath(generation, ".bin");
+}
+
+std::string IndexManifest::deltaPath(uint64_t generation) {
+    return generationPath(generation, ".delta.bin");
+}
+
+std::string IndexManifest::statePath(uint64_t generation) {
+    return generationPath(generation, ".state");
+}
+
+static inline uint64_t rotateLeft(uint64_t value, int shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+uint64_t IndexManifest::checksum(std::string_view content) {
+    constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    const char* data = content.data();
+    size_t size = content.size();
+    uint64_t lanes[4] = {PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1};
+
+    // Четыре цепочки не зависят друг от друга, поэтому умножения идут параллельно
+    size_t offset = 0;
+    for (; offset + 32 <= size; offset += 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            uint64_t word;
+            std::memcpy(&word, data + offset + lane * 8, sizeof(word));
+            lanes[lane] = rotateLeft(lanes[lane] + word * PRIME2, 31) * PRIME1;
+        }
+    }
+    // Хвост дополняется нулями до целых слов
+    for (int lane = 0; offset < size; offset += 8, ++lane) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + offset, std::min<size_t>(8, size - offset));
+        lanes[lane] = rotateLeft(lanes[lane] + word * PRIME2, 31) * PRIME1;
+    }
+
+    uint64_t hash = size * PRIME1;
+    for (uint64_t lane : lanes) {
+        hash = rotateLeft(hash ^ lane, 27) * PRIME1 + PRIME2;
+    }
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+bool IndexManifest::describe(ManifestFile& file, const std::string& path) {
+    file = ManifestFile();
+    if (path.empty()) {
+        return true;
+    }
+    MappedFile content;
+    if (!content.open(path)) {
+        std::cerr << "Error: Unable to read " << path << std::endl;
+        return false;
+    }
+    file.path = path;
+    file.size = content.view().size();
+    file.checksum = checksum(content.view());
+    return true;
+}
+
+bool IndexManifest::load(const std::string& path) {
+    *this = IndexManifest();
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    if (!input.is_open()) {
+        return false;
+    }
+    std::string content(static_cast<size_t>(input.tellg()), '\0');
+    input.seekg(0);
+    input.read(content.data(), static_cast<std::streamsize>(content.size()));
+
+    const char* position = content.data();
+    const char* end = content.data() + content.size();
+    auto readBytes = [&](void* value, size_t size) {
+        if (static_cast<size_t>(end - position) < size) {
+            return false;
+        }
+        std::memcpy(value, position, size);
+        position += size;
+        return true;
+    };
+    auto readFile = [&](ManifestFile& file) {
+        uint32_t nameLength = 0;
+        if (!readBytes(&nameLength, sizeof(nameLength)) || static_cast<size_t>(end - position) < nameLength) {
+            return false;
+        }
+        std::string name(position, nameLength);
+        position += nameLength;
+        file.path = name.empty() ? std::string() : besideManifest(path, name);
+        return readBytes(&file.size, sizeof(file.size)) && readBytes(&file.checksum, sizeof(file.checksum));
+    };
+
+    // Последние 8 байт - контрольная сумма всего, что перед ними
+    uint64_t stored = 0;
+    bool valid = input && content.size() > sizeof(MANIFEST_MAGIC) + sizeof(stored) &&
+                 std::memcmp(content.data(), MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) == 0;
+    if (valid) {
+        end -= sizeof(stored);
+        std::memcpy(&stored, end, sizeof(stored));
+        valid = stored == checksum(std::string_view(content.data(), content.size() - sizeof(stored)));
+        position += sizeof(MANIFEST_MAGIC);
+    }
+    uint32_t version = 0;
+    valid = valid && readBytes(&version, sizeof(version)) && version == MANIFEST_VERSION &&
+            readBytes(&number, sizeof(number)) &&
+            readFile(mainSegment) && readFile(deltaSegment) && readFile(documentState) &&
+            position == end && !mainSegment.path.empty() && !documentState.path.empty();
+    if (!valid) {
+        std::cerr << "Error: " << path << " is damaged, index will be rebuilt." << std::endl;
+        *this = IndexManifest();
+        return false;
+    }
+    return true;
+}
+
+bool IndexManifest::save(const std::string& path) const {
+    std::string buffer(MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+    appendValue(buffer, MANIFEST_VERSION);
+    appendValue(buffer, number);
+    for (const ManifestFile* file : {&mainSegment, &deltaSegment, &documentState}) {
+        std::string name = file->path.empty() ? std::string() : fs::path(file->path).filename().string();
+        appendValue(buffer, static_cast<uint32_t>(name.size()));
+        buffer += name;
+        appendValue(buffer, file->size);
+        appendValue(buffer, file->checksum);
+    }
+    appendValue(buffer, checksum(buffer));
+
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    file.close();
+    if (!file) {
+        std::cerr << "Error: Unable to write to " << path << std::endl;
+        std::error_code error;
+        fs::remove(temporaryPath, error);
+        return false;
+    }
+    return publishFile(temporaryPath, path);
+}
+
+bool IndexManifest::verify(bool full) const {
+    for (const ManifestFile* file : {&mainSegment, &deltaSegment, &documentState}) {
+        if (file->path.empty()) {
+            continue;
+        }
+        std::error_code error;
+        bool valid = fs::file_size(file->path, error) == file->size && !error;
+        if (valid && full) {
+            MappedFile content;
+            valid = content.open(file->path) && checksum(content.view()) == file->checksum;
+        }
+        if (!valid) {
+            std::cerr << "Error: " << file->path << " does not match index.manifest, index will be rebuilt."
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IndexManifest::sameSegments(const IndexManifest& other) const {
+    return mainSegment.path == other.mainSegment.path && mainSegment.checksum == other.mainSegment.checksum &&
+           deltaSegment.path == other.deltaSegment.path && deltaSegment.checksum == other.deltaSegment.checksum;
+}
+
+// Файлы прошлых поколений и файлы, недописанные до сбоя. Открытые снимки
+// держат отображение удаленного файла до закрытия; где удалить открытый файл
+// нельзя, он останется до следующей публикации
+void IndexManifest::removeStale(const std::string& path) const {
+    fs::path directory = fs::path(path).parent_path();
+    std::error_code error;
+    fs::directory_iterator it(directory.empty() ? fs::path(".") : directory, error);
+    for (; !error && it != fs::directory_iterator(); it.increment(error)) {
+        std::string name = it->path().filename().string();
+        auto endsWith = [&name](std::string_view suffix) {
+            return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        // Временные файлы остаются от записи, прерванной сбоем
+        bool indexFile = name.rfind("index.", 0) == 0 &&
+                         (endsWith(".bin") || endsWith(".state") || endsWith(".tmp"));
+        if (!indexFile) {
+            continue;
+        }
+        bool referenced = false;
+        for (const ManifestFile* file : {&mainSegment, &deltaSegment, &documentState}) {
+            referenced = referenced || (!file->path.empty() && fs::path(file->path).filename() == name);
+        }
+        if (!referenced) {
+            std::error_code removeError;
+            fs::remove(it->path(), removeError);
+        }
+    }
+}
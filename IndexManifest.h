@@ -0,0 +1,74 @@
+#ifndef INDEXMANIFEST_H
+#define INDEXMANIFEST_H
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Манифест опубликованного индекса рядом с config.json
+inline const std::string INDEX_MANIFEST_PATH = "../index.manifest";
+
+// Файл поколения: путь, размер и контрольная сумма содержимого
+struct ManifestFile {
+    std::string path;      // пустой путь - файла в поколении нет
+    uint64_t size = 0;
+    uint64_t checksum = 0;
+};
+
+/*
+ Манифест (index.manifest) - единственная точка фиксации индекса.
+
+ Каждое поколение пишет новые файлы index.<N>.bin, index.<N>.delta.bin и
+ index.<N>.state, уже существующие файлы не переписываются. Когда файлы
+ поколения сброшены на диск, манифест со списком файлов, их размерами и
+ контрольными суммами публикуется атомарным переименованием. До этого
+ момента читатели и следующий запуск видят предыдущее поколение целиком,
+ после - новое; недописанные файлы после сбоя в манифест не попадают и
+ удаляются при следующей публикации.
+*/
+class IndexManifest {
+private:
+    uint64_t number = 0;
+    ManifestFile mainSegment;
+    ManifestFile deltaSegment;
+    ManifestFile documentState;
+
+public:
+    IndexManifest() = default;
+
+    bool load(const std::string& path);
+    // Сохранение через временный файл, fsync и переименование
+    bool save(const std::string& path) const;
+    // Проверка размеров файлов, а при full - и контрольных сумм содержимого
+    bool verify(bool full) const;
+    // Удаление файлов индекса рядом с манифестом, которые в нем не упомянуты
+    void removeStale(const std::string& path) const;
+
+    uint64_t generation() const { return number; }
+    void setGeneration(uint64_t generation) { number = generation; }
+    const ManifestFile& main() const { return mainSegment; }
+    const ManifestFile& delta() const { return deltaSegment; }
+    const ManifestFile& state() const { return documentState; }
+    bool hasDelta() const { return !deltaSegment.path.empty(); }
+    // Запись файла в манифест: размер и контрольная сумма считаются по диску.
+    // Пустой путь убирает файл из поколения
+    bool setMain(const std::string& path) { return describe(mainSegment, path); }
+    bool setDelta(const std::string& path) { return describe(deltaSegment, path); }
+    bool setState(const std::string& path) { return describe(documentState, path); }
+    // Сегменты те же, что в другом манифесте: снимок переоткрывать не нужно
+    bool sameSegments(const IndexManifest& other) const;
+
+    // Пути файлов поколения рядом с манифестом
+    static std::string segmentPath(uint64_t generation);
+    static std::string deltaPath(uint64_t generation);
+    static std::string statePath(uint64_t generation);
+
+    // Быстрая 64-битная контрольная сумма, читает по 8 байт в четыре независимые цепочки
+    static uint64_t checksum(std::string_view content);
+
+private:
+    static bool describe(ManifestFile& file, const std::string& path);
+};
+
+#endif // INDEXMANIFEST_H
@@ -0,0 +1,714 @@
+#include "IndexSegment.h"
+#include "DurableFile.h"
+#include "TermDictionary.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+PostingList::PostingList(CodecType codecType, const uint8_t* postingsBegin, const uint8_t* positionsBegin,
+                         const SkipEntry* skips, uint32_t skipCount, uint32_t documentCount,
+                         uint32_t maxFrequency)
+        : codec(&IntegerCodec::get(codecType)), postingsBegin(postingsBegin), positionsBegin(positionsBegin),
+          skips(skips), skipCount(skipCount), documentCount(documentCount), maxFrequency(maxFrequency) {}
+
+// Блоки после первого есть только у списков с указателями пропуска, их начала берутся оттуда
+bool PostingList::loadBlock(uint32_t number) {
+    block = number;
+    index = 0;
+    blockSize = 0;
+    if (static_cast<uint64_t>(number) * SEGMENT_BLOCK_SIZE >= documentCount || (number > 0 && number >= skipCount)) {
+        freq = 0;
+        return false;
+    }
+    blockSize = std::min(SEGMENT_BLOCK_SIZE, documentCount - number * SEGMENT_BLOCK_SIZE);
+    const uint8_t* data = postingsBegin + (number > 0 ? skips[number].postingsOffset : 0);
+    data = codec->decode(data, blockSize, documents);
+    codec->decode(data, blockSize, frequencies);
+
+    uint32_t documentId = number > 0 ? skips[number - 1].lastDocumentId : 0;
+    for (uint32_t i = 0; i < blockSize; ++i) {
+        documentId += documents[i];
+        documents[i] = documentId;
+        ++frequencies[i];
+    }
+    blockPositions = positionsBegin + (number > 0 ? skips[number].positionsOffset : 0);
+    positionsDecoded = false;
+    return true;
+}
+
+bool PostingList::next() {
+    if (started && index + 1 < blockSize) {
+        ++index;
+    } else if (!loadBlock(started ? block + 1 : 0)) {
+        started = true;
+        return false;
+    }
+    started = true;
+    docId = documents[index];
+    freq = frequencies[index];
+    return true;
+}
+
+bool PostingList::advance(uint32_t target) {
+    if (started && freq > 0 && docId >= target) {
+        return true;
+    }
+
+    // Галоп по блокам: шаг удваивается, пока последний документ блока меньше target
+    uint32_t from = started ? block : 0;
+    if (skipCount > 0 && from < skipCount && skips[from].lastDocumentId < target) {
+        uint32_t low = from;
+        uint32_t step = 1;
+        uint32_t high = from + 1;
+        while (high < skipCount && skips[high].lastDocumentId < target) {
+            low = high;
+            step *= 2;
+            high = std::min(skipCount, high + step);
+        }
+        if (high >= skipCount) {
+            if (skips[skipCount - 1].lastDocumentId < target) {
+                // Все документы списка меньше target
+                started = true;
+                loadBlock(skipCount);
+                return false;
+            }
+            high = skipCount - 1;
+        }
+        // Двоичный поиск первого блока, где последний документ >= target
+        while (low + 1 < high) {
+            uint32_t middle = low + (high - low) / 2;
+            if (skips[middle].lastDocumentId < target) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        loadBlock(high);
+    } else if (!started) {
+        loadBlock(0);
+    }
+    started = true;
+
+    // Внутри блока документы уже раскодированы и отсортированы
+    while (true) {
+        const uint32_t* found = std::lower_bound(documents + index, documents + blockSize, target);
+        if (found != documents + blockSize) {
+            index = static_cast<uint32_t>(found - documents);
+            docId = *found;
+            freq = frequencies[index];
+            return true;
+        }
+        if (!loadBlock(block + 1)) {
+            return false;
+        }
+    }
+}
+
+bool PostingList::blockBound(uint32_t target, SkipEntry& bound) const {
+    if (started && freq == 0) {
+        return false; // список закончился
+    }
+    if (skipCount == 0) {
+        bound = SkipEntry {};
+        bound.lastDocumentId = std::numeric_limits<uint32_t>::max();
+        bound.maxFrequency = maxFrequency;
+        bound.maxImpact = static_cast<float>(bm25Impact(maxFrequency, 0, 1));
+        bound.maxImpact = std::nextafter(bound.maxImpact, std::numeric_limits<float>::infinity());
+        return true;
+    }
+    // Блоки до текущего уже пройдены, поиск идет от него
+    const SkipEntry* found = std::partition_point(skips + (started ? block : 0), skips + skipCount,
+                                                  [target](const SkipEntry& skip) {
+                                                      return skip.lastDocumentId < target;
+                                                  });
+    if (found == skips + skipCount) {
+        return false;
+    }
+    bound = *found;
+    return true;
+}
+
+std::vector<uint32_t> PostingList::positions() {
+    std::vector<uint32_t> result;
+    readPositions(result);
+    return result;
+}
+
+void PostingList::readPositions(std::vector<uint32_t>& result) {
+    result.clear();
+    if (!started || freq == 0) {
+        return;
+    }
+    if (!positionsDecoded) {
+        uint32_t total = 0;
+        for (uint32_t i = 0; i < blockSize; ++i) {
+            positionStarts[i] = total;
+            total += frequencies[i];
+        }
+        positionStarts[blockSize] = total;
+        positionDeltas.resize(total);
+        codec->decode(blockPositions, total, positionDeltas.data());
+        positionsDecoded = true;
+    }
+    result.reserve(freq);
+    uint32_t position = 0;
+    for (uint32_t i = positionStarts[index]; i < positionStarts[index + 1]; ++i) {
+        position += positionDeltas[i];
+        result.push_back(position);
+    }
+}
+
+IndexSegment::~IndexSegment() {
+    close();
+}
+
+bool IndexSegment::open(const std::string& path) {
+    close();
+    if (!file.open(path)) {
+        return false;
+    }
+    size_t size = file.size();
+    if (size < sizeof(SegmentHeader)) {
+        std::cerr << "Error: " << path << " is not a valid index segment." << std::endl;
+        file.close();
+        return false;
+    }
+    data = file.bytes();
+
+    header = reinterpret_cast<const SegmentHeader*>(data);
+    bool valid = std::memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) == 0 &&
+                 header->version == SEGMENT_VERSION &&
+                 header->fileSize == size &&
+                 header->dictionaryOffset + static_cast<uint64_t>(header->termCount) * sizeof(TermEntry) <= size &&
+                 header->stringsOffset <= size &&
+                 header->postingsOffset <= size &&
+                 header->positionsOffset <= size &&
+                 header->deletedOffset + static_cast<uint64_t>(header->deletedCount) * sizeof(uint32_t) <= size &&
+                 header->lengthsOffset + static_cast<uint64_t>(header->lengthsCount) * sizeof(uint32_t) <= size &&
+                 header->skipsOffset + static_cast<uint64_t>(header->skipCount) * sizeof(SkipEntry) <= size &&
+                 header->automatonOffset + header->automatonSize <= size &&
+                 header->offsetsOffset + header->offsetsSize <= size && header->offsetsOffset % 8 == 0 &&
+                 (header->offsetsSize == 0 ||
+                  header->offsetsSize >= static_cast<uint64_t>(header->lengthsCount) * sizeof(uint64_t)) &&
+                 header->blockSize == SEGMENT_BLOCK_SIZE &&
+                 header->codec <= static_cast<uint32_t>(CodecType::PFor);
+    if (!valid) {
+        std::cerr << "Error: " << path << " is not a valid index segment." << std::endl;
+        close();
+        return false;
+    }
+
+    dictionary = reinterpret_cast<const TermEntry*>(data + header->dictionaryOffset);
+    strings = reinterpret_cast<const char*>(data + header->stringsOffset);
+    automaton = TermAutomaton(header->automatonSize > 0 ? data + header->automatonOffset : nullptr,
+                              header->automatonSize);
+    buildLookup();
+    return true;
+}
+
+// Открытая адресация с линейным пробированием, заполнение не больше половины
+void IndexSegment::buildLookup() {
+    size_t capacity = 16;
+    while (capacity < static_cast<size_t>(header->termCount) * 2) {
+        capacity *= 2;
+    }
+    lookup.assign(capacity, LookupSlot{0, 0});
+    lookupMask = capacity - 1;
+    for (uint32_t i = 0; i < header->termCount; ++i) {
+        uint64_t hash = TermDictionary::hashTerm(termString(dictionary[i]));
+        size_t slot = hash & lookupMask;
+        while (lookup[slot].entry != 0) {
+            slot = (slot + 1) & lookupMask;
+        }
+        lookup[slot] = {i + 1, static_cast<uint32_t>(hash >> 32)};
+    }
+}
+
+void IndexSegment::close() {
+    file.close();
+    data = nullptr;
+    header = nullptr;
+    dictionary = nullptr;
+    strings = nullptr;
+    automaton = TermAutomaton();
+    lookup.clear();
+    lookup.shrink_to_fit();
+    lookupMask = 0;
+}
+
+uint32_t IndexSegment::termCount() const {
+    return header ? header->termCount : 0;
+}
+
+uint32_t IndexSegment::documentCount() const {
+    return header ? header->documentCount : 0;
+}
+
+const uint32_t* IndexSegment::deletedDocuments() const {
+    return header ? reinterpret_cast<const uint32_t*>(data + header->deletedOffset) : nullptr;
+}
+
+uint32_t IndexSegment::deletedCount() const {
+    return header ? header->deletedCount : 0;
+}
+
+uint32_t IndexSegment::documentLength(uint32_t documentId) const {
+    if (!header || documentId >= header->lengthsCount) {
+        return 0;
+    }
+    return reinterpret_cast<const uint32_t*>(data + header->lengthsOffset)[documentId];
+}
+
+uint32_t IndexSegment::lengthCount() const {
+    return header ? header->lengthsCount : 0;
+}
+
+uint64_t IndexSegment::totalLength() const {
+    return header ? header->totalLength : 0;
+}
+
+double IndexSegment::averageLength() const {
+    return std::max(1.0, documentCount() > 0 ? static_cast<double>(totalLength()) / documentCount() : 0.0);
+}
+
+CodecType IndexSegment::codec() const {
+    return header ? static_cast<CodecType>(header->codec) : DEFAULT_CODEC;
+}
+
+uint32_t IndexSegment::analyzer() const {
+    return header ? header->analyzer : 0;
+}
+
+const uint8_t* IndexSegment::tokenOffsets(uint32_t documentId) const {
+    if (!hasTokenOffsets() || documentId >= header->lengthsCount) {
+        return nullptr;
+    }
+    uint64_t start = reinterpret_cast<const uint64_t*>(data + header->offsetsOffset)[documentId];
+    uint64_t tableSize = static_cast<uint64_t>(header->lengthsCount) * sizeof(uint64_t);
+    if (start >= header->offsetsSize - tableSize) {
+        return nullptr;
+    }
+    return data + header->offsetsOffset + tableSize + start;
+}
+
+bool IndexSegment::hasTokenOffsets() const {
+    return header && header->offsetsSize > 0;
+}
+
+uint64_t IndexSegment::postingsBytes() const {
+    return header ? header->positionsOffset - header->postingsOffset : 0;
+}
+
+uint64_t IndexSegment::positionsBytes() const {
+    return header ? header->deletedOffset - header->positionsOffset : 0;
+}
+
+const SkipEntry* IndexSegment::skips(const TermEntry& entry) const {
+    return reinterpret_cast<const SkipEntry*>(data + header->skipsOffset) + entry.skipOffset;
+}
+
+uint32_t IndexSegment::skipCount(const TermEntry& entry) const {
+    if (entry.documentFrequency <= SEGMENT_BLOCK_SIZE) {
+        return 0;
+    }
+    return (entry.documentFrequency + SEGMENT_BLOCK_SIZE - 1) / SEGMENT_BLOCK_SIZE;
+}
+
+const TermEntry* IndexSegment::begin() const {
+    return dictionary;
+}
+
+const TermEntry* IndexSegment::end() const {
+    return header ? dictionary + header->termCount : dictionary;
+}
+
+std::string_view IndexSegment::termString(const TermEntry& entry) const {
+    return {strings + entry.stringOffset, entry.stringLength};
+}
+
+const TermEntry* IndexSegment::findTerm(std::string_view term) const {
+    return findTerm(term, TermDictionary::hashTerm(term));
+}
+
+const TermEntry* IndexSegment::findTerm(std::string_view term, uint64_t hash) const {
+    if (!header) {
+        return nullptr;
+    }
+    uint32_t tag = static_cast<uint32_t>(hash >> 32);
+    for (size_t slot = hash & lookupMask; lookup[slot].entry != 0; slot = (slot + 1) & lookupMask) {
+        if (lookup[slot].tag != tag) {
+            continue;
+        }
+        const TermEntry* entry = dictionary + (lookup[slot].entry - 1);
+        if (termString(*entry) == term) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+PostingList IndexSegment::postings(const TermEntry& entry) const {
+    return {codec(), data + header->postingsOffset + entry.postingsOffset,
+            data + header->positionsOffset + entry.positionsOffset, skips(entry), skipCount(entry),
+            entry.documentFrequency, entry.maxFrequency};
+}
+
+bool IndexSegment::write(const std::string& path, const IndexData& index,
+                         const std::vector<uint32_t>& deletedDocuments, CodecType codec, uint32_t analyzer) {
+    // Словарь сортируется по байтам терма для двоичного поиска
+    std::vector<uint32_t> termIds;
+    for (uint32_t termId = 1; termId < index.idCount(); ++termId) {
+        if (index.postingsBegin(termId) != index.postingsEnd(termId)) {
+            termIds.push_back(termId);
+        }
+    }
+    std::sort(termIds.begin(), termIds.end(), [&](uint32_t a, uint32_t b) {
+        return index.term(a) < index.term(b);
+    });
+
+    // Длины документов нужны блокам до записи списков
+    std::vector<uint32_t> lengths;
+    for (const IndexPosting& posting : index.postings) {
+        if (posting.documentId >= lengths.size()) {
+            lengths.resize(posting.documentId + 1, 0);
+        }
+        lengths[posting.documentId] += posting.frequency;
+    }
+
+    SegmentWriter writer(path, codec, analyzer);
+    writer.setDocumentLengths(std::move(lengths));
+    writer.setTokenOffsets(index.tokenOffsets);
+    for (uint32_t termId : termIds) {
+        writer.addTerm(index.term(termId), termId, index.postingsBegin(termId), index.postingsEnd(termId),
+                       index.positionsBegin(termId));
+    }
+
+    writer.setDeletedDocuments(deletedDocuments);
+    return writer.finish();
+}
+
+bool IndexSegment::merge(const IndexSegment& base, const IndexSegment& delta, const std::string& path,
+                         CodecType codec) {
+    // Документы, удаленные или переписанные дельтой, в новый сегмент не попадают
+    const uint32_t* deletedBegin = delta.deletedDocuments();
+    const uint32_t* deletedEnd = deletedBegin + delta.deletedCount();
+    auto isDeleted = [&](uint32_t documentId) {
+        return std::binary_search(deletedBegin, deletedEnd, documentId);
+    };
+
+    struct MergedPosting {
+        uint32_t documentId;
+        std::vector<uint32_t> positions;
+    };
+
+    // Длины и границы токенов документов нового сегмента: из дельты, остальные - из основного
+    std::vector<uint32_t> lengths(std::max(base.lengthCount(), delta.lengthCount()), 0);
+    TokenOffsets offsets;
+    for (uint32_t documentId = 0; documentId < lengths.size(); ++documentId) {
+        uint32_t deltaLength = delta.documentLength(documentId);
+        bool fromDelta = deltaLength > 0 || isDeleted(documentId);
+        lengths[documentId] = fromDelta ? deltaLength : base.documentLength(documentId);
+        const uint8_t* record = (fromDelta ? delta : base).tokenOffsets(documentId);
+        if (record != nullptr && lengths[documentId] > 0) {
+            offsets.appendRecord(documentId, record);
+        }
+    }
+
+    SegmentWriter writer(path, codec, base.analyzer());
+    writer.setDocumentLengths(std::move(lengths));
+    writer.setTokenOffsets(std::move(offsets));
+    std::vector<MergedPosting> merged;
+    std::vector<IndexPosting> documents;
+    std::vector<uint32_t> positions;
+    uint32_t nextTermId = 1;
+
+    // Словари обоих сегментов отсортированы, поэтому сливаются одним проходом
+    const TermEntry* baseIt = base.begin();
+    const TermEntry* deltaIt = delta.begin();
+    while (baseIt != base.end() || deltaIt != delta.end()) {
+        std::string_view term;
+        bool fromBase = false;
+        bool fromDelta = false;
+        if (deltaIt == delta.end() ||
+            (baseIt != base.end() && base.termString(*baseIt) <= delta.termString(*deltaIt))) {
+            term = base.termString(*baseIt);
+            fromBase = true;
+            fromDelta = deltaIt != delta.end() && delta.termString(*deltaIt) == term;
+        } else {
+            term = delta.termString(*deltaIt);
+            fromDelta = true;
+        }
+
+        merged.clear();
+        if (fromBase) {
+            PostingList list = base.postings(*baseIt++);
+            while (list.next()) {
+                if (!isDeleted(list.documentId())) {
+                    merged.push_back({list.documentId(), list.positions()});
+                }
+            }
+        }
+        if (fromDelta) {
+            PostingList list = delta.postings(*deltaIt++);
+            while (list.next()) {
+                merged.push_back({list.documentId(), list.positions()});
+            }
+        }
+        if (merged.empty()) {
+            continue;
+        }
+        std::sort(merged.begin(), merged.end(), [](const MergedPosting& a, const MergedPosting& b) {
+            return a.documentId < b.documentId;
+        });
+
+        documents.clear();
+        positions.clear();
+        for (const auto& posting : merged) {
+            documents.push_back({posting.documentId, static_cast<uint32_t>(posting.positions.size())});
+            positions.insert(positions.end(), posting.positions.begin(), posting.positions.end());
+        }
+        writer.addTerm(term, nextTermId++, documents.data(), documents.data() + documents.size(), positions.data());
+    }
+
+    return writer.finish();
+}
+
+SegmentWriter::SegmentWriter(std::string path, CodecType codec, uint32_t analyzer)
+        : path(std::move(path)), codec(IntegerCodec::get(codec)), analyzer(analyzer) {}
+
+SegmentWriter::~SegmentWriter() {
+    removeSpills();
+}
+
+// Средняя считается так же, как IndexSegment::averageLength по заголовку
+void SegmentWriter::setDocumentLengths(std::vector<uint32_t> documentLengths) {
+    knownLengths = std::move(documentLengths);
+    uint32_t documentCount = 0;
+    uint64_t totalLength = 0;
+    for (uint32_t length : knownLengths) {
+        documentCount += length > 0 ? 1 : 0;
+        totalLength += length;
+    }
+    knownAverage = std::max(1.0, documentCount > 0 ? static_cast<double>(totalLength) / documentCount : 0.0);
+}
+
+void SegmentWriter::removeSpills() {
+    std::error_code error;
+    if (postingsFlushed > 0 || postingsSpill.is_open()) {
+        postingsSpill.close();
+        std::filesystem::remove(path + ".postings.tmp", error);
+    }
+    if (positionsFlushed > 0 || positionsSpill.is_open()) {
+        positionsSpill.close();
+        std::filesystem::remove(path + ".positions.tmp", error);
+    }
+}
+
+// Перенос накопленных блоков во временные файлы
+void SegmentWriter::flushBlocks() {
+    if (!postingsSpill.is_open()) {
+        postingsSpill.open(path + ".postings.tmp", std::ios::binary | std::ios::trunc);
+        positionsSpill.open(path + ".positions.tmp", std::ios::binary | std::ios::trunc);
+    }
+    postingsSpill.write(postingsBlock.data(), static_cast<std::streamsize>(postingsBlock.size()));
+    positionsSpill.write(positionsBlock.data(), static_cast<std::streamsize>(positionsBlock.size()));
+    spillFailed |= !postingsSpill || !positionsSpill;
+    postingsFlushed += postingsBlock.size();
+    positionsFlushed += positionsBlock.size();
+    postingsBlock.clear();
+    positionsBlock.clear();
+}
+
+void SegmentWriter::addTerm(std::string_view term, uint32_t termId,
+                            const IndexPosting* begin, const IndexPosting* end,
+                            const uint32_t* positions) {
+    size_t documentCount = static_cast<size_t>(end - begin);
+    TermEntry entry {};
+    entry.stringOffset = static_cast<uint32_t>(stringPool.size());
+    entry.stringLength = static_cast<uint32_t>(term.size());
+    entry.termId = termId;
+    entry.documentFrequency = static_cast<uint32_t>(documentCount);
+    entry.postingsOffset = postingsSize();
+    entry.positionsOffset = positionsSize();
+    entry.skipOffset = static_cast<uint32_t>(skipEntries.size());
+    stringPool.append(term);
+    automatonBuilder.add(term);
+
+    // Указатели пропуска пишутся только для списков длиннее одного блока
+    bool withSkips = documentCount > SEGMENT_BLOCK_SIZE;
+    uint32_t previousDocId = 0;
+    for (size_t blockStart = 0; blockStart < documentCount; blockStart += SEGMENT_BLOCK_SIZE) {
+        size_t blockEnd = std::min<size_t>(documentCount, blockStart + SEGMENT_BLOCK_SIZE);
+        if (withSkips) {
+            SkipEntry skip {};
+            skip.lastDocumentId = begin[blockEnd - 1].documentId;
+            skip.postingsOffset = static_cast<uint32_t>(postingsSize() - entry.postingsOffset);
+            skip.positionsOffset = static_cast<uint32_t>(positionsSize() - entry.positionsOffset);
+            skipEntries.push_back(skip);
+        }
+
+        blockDocuments.clear();
+        blockFrequencies.clear();
+        blockPositions.clear();
+        for (size_t i = blockStart; i < blockEnd; ++i) {
+            const auto& [documentId, frequency] = begin[i];
+            if (withSkips) {
+                SkipEntry& skip = skipEntries.back();
+                skip.maxFrequency = std::max(skip.maxFrequency, frequency);
+                uint32_t length = documentId < knownLengths.size() ? knownLengths[documentId] : 0;
+                // float округляется вверх, чтобы оценка блока не стала меньше веса документа
+                float impact = static_cast<float>(bm25Impact(frequency, length, knownAverage));
+                impact = std::nextafter(impact, std::numeric_limits<float>::infinity());
+                skip.maxImpact = std::max(skip.maxImpact, impact);
+            }
+            entry.maxFrequency = std::max(entry.maxFrequency, frequency);
+
+            blockDocuments.push_back(documentId - previousDocId);
+            blockFrequencies.push_back(frequency - 1);
+            previousDocId = documentId;
+
+            uint32_t previousPosition = 0;
+            for (uint32_t k = 0; k < frequency; ++k) {
+                uint32_t position = *positions++;
+                blockPositions.push_back(position - previousPosition);
+                previousPosition = position;
+            }
+
+            // Длина документа - сумма частот всех его термов
+            if (documentId >= lengths.size()) {
+                lengths.resize(documentId + 1, 0);
+            }
+            lengths[documentId] += frequency;
+        }
+        codec.encode(blockDocuments.data(), blockDocuments.size(), postingsBlock);
+        codec.encode(blockFrequencies.data(), blockFrequencies.size(), postingsBlock);
+        codec.encode(blockPositions.data(), blockPositions.size(), positionsBlock);
+
+        if (postingsBlock.size() + positionsBlock.size() >= SEGMENT_FLUSH_BYTES) {
+            flushBlocks();
+        }
+    }
+
+    entry.postingsBytes = static_cast<uint32_t>(postingsSize() - entry.postingsOffset);
+    entry.positionsBytes = static_cast<uint32_t>(positionsSize() - entry.positionsOffset);
+    entries.push_back(entry);
+}
+
+void SegmentWriter::setDeletedDocuments(std::vector<uint32_t> documents) {
+    std::sort(documents.begin(), documents.end());
+    documents.erase(std::unique(documents.begin(), documents.end()), documents.end());
+    deleted = std::move(documents);
+}
+
+bool SegmentWriter::finish() {
+    uint32_t documentCount = 0;
+    uint64_t totalLength = 0;
+    for (uint32_t length : lengths) {
+        documentCount += length > 0 ? 1 : 0;
+        totalLength += length;
+    }
+
+    SegmentHeader header {};
+    std::memcpy(header.magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+    header.version = SEGMENT_VERSION;
+    header.termCount = static_cast<uint32_t>(entries.size());
+    header.documentCount = documentCount;
+    header.dictionaryOffset = sizeof(SegmentHeader);
+    header.stringsOffset = header.dictionaryOffset + entries.size() * sizeof(TermEntry);
+    header.postingsOffset = header.stringsOffset + stringPool.size();
+    header.positionsOffset = header.postingsOffset + postingsSize();
+    // Декодерам нужен запас за последним блоком позиций,
+    // список удаленных выравнивается на 4 байта для чтения как uint32_t
+    uint64_t positionsEnd = header.positionsOffset + positionsSize();
+    header.deletedOffset = (positionsEnd + CODEC_READ_PADDING + 3) & ~uint64_t(3);
+    header.deletedCount = static_cast<uint32_t>(deleted.size());
+    header.lengthsOffset = header.deletedOffset + deleted.size() * sizeof(uint32_t);
+    header.lengthsCount = static_cast<uint32_t>(lengths.size());
+    header.totalLength = totalLength;
+    header.skipsOffset = header.lengthsOffset + lengths.size() * sizeof(uint32_t);
+    header.skipCount = static_cast<uint32_t>(skipEntries.size());
+    header.blockSize = SEGMENT_BLOCK_SIZE;
+    std::string automaton = automatonBuilder.finish();
+    header.automatonOffset = header.skipsOffset + skipEntries.size() * sizeof(SkipEntry);
+    header.automatonSize = automaton.size();
+    header.fileSize = header.automatonOffset + automaton.size();
+    // Таблица начал записей выравнивается на 8 байт для чтения как uint64_t
+    uint64_t automatonEnd = header.fileSize;
+    std::vector<uint64_t> offsetStarts;
+    if (!offsets.empty()) {
+        offsetStarts.assign(lengths.size(), std::numeric_limits<uint64_t>::max());
+        for (const auto& [documentId, start] : offsets.starts) {
+            if (documentId < offsetStarts.size()) {
+                offsetStarts[documentId] = start;
+            }
+        }
+        header.offsetsOffset = (automatonEnd + 7) & ~uint64_t(7);
+        header.offsetsSize = offsetStarts.size() * sizeof(uint64_t) + offsets.records.size();
+        header.fileSize = header.offsetsOffset + header.offsetsSize;
+    }
+    header.codec = static_cast<uint32_t>(codec.type());
+    header.analyzer = analyzer;
+
+    // Сброшенные части блоков дописываются на диск до копирования в сегмент
+    for (std::ofstream* spill : {&postingsSpill, &positionsSpill}) {
+        if (spill->is_open()) {
+            spill->close();
+            spillFailed |= spill->fail();
+        }
+    }
+    if (spillFailed) {
+        std::cerr << "Error: Unable to write to index file " << path << std::endl;
+        return false;
+    }
+
+    // Запись во временный файл и переименование: открытые снимки держат отображение старого файла
+    std::string temporaryPath = path + ".tmp";
+    std::ofstream segmentFile(temporaryPath, std::ios::binary | std::ios::trunc);
+    if (!segmentFile.is_open()) {
+        std::cerr << "Error: Unable to write to index file " << path << std::endl;
+        return false;
+    }
+    const char padding[CODEC_READ_PADDING + 4] = {};
+    segmentFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    segmentFile.write(reinterpret_cast<const char*>(entries.data()),
+                      static_cast<std::streamsize>(entries.size() * sizeof(TermEntry)));
+    segmentFile.write(stringPool.data(), static_cast<std::streamsize>(stringPool.size()));
+    // Сброшенная часть блока копируется из временного файла, остаток - из памяти
+    auto writeBlock = [&](const std::string& spillPath, uint64_t flushed, const std::string& block) {
+        if (flushed > 0) {
+            std::ifstream input(spillPath, std::ios::binary);
+            segmentFile << input.rdbuf();
+        }
+        segmentFile.write(block.data(), static_cast<std::streamsize>(block.size()));
+    };
+    writeBlock(path + ".postings.tmp", postingsFlushed, postingsBlock);
+    writeBlock(path + ".positions.tmp", positionsFlushed, positionsBlock);
+    removeSpills();
+    segmentFile.write(padding, static_cast<std::streamsize>(header.deletedOffset - positionsEnd));
+    segmentFile.write(reinterpret_cast<const char*>(deleted.data()),
+                      static_cast<std::streamsize>(deleted.size() * sizeof(uint32_t)));
+    segmentFile.write(reinterpret_cast<const char*>(lengths.data()),
+                      static_cast<std::streamsize>(lengths.size() * sizeof(uint32_t)));
+    segmentFile.write(reinterpret_cast<const char*>(skipEntries.data()),
+                      static_cast<std::streamsize>(skipEntries.size() * sizeof(SkipEntry)));
+    segmentFile.write(automaton.data(), static_cast<std::streamsize>(automaton.size()));
+    if (!offsets.empty()) {
+        segmentFile.write(padding, static_cast<std::streamsize>(header.offsetsOffset - automatonEnd));
+        segmentFile.write(reinterpret_cast<const char*>(offsetStarts.data()),
+                          static_cast<std::streamsize>(offsetStarts.size() * sizeof(uint64_t)));
+        segmentFile.write(offsets.records.data(), static_cast<std::streamsize>(offsets.records.size()));
+    }
+    segmentFile.close();
+    if (!segmentFile) {
+        std::cerr << "Error: Unable to write to index file " << path << std::endl;
+        std::filesystem::remove(temporaryPath);
+        return false;
+    }
+
+    // Сегмент сбрасывается на диск до переименования: манифест не должен сослаться на недописанный файл
+    return publishFile(temporaryPath, path);
+}
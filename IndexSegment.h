@@ -0,0 +1,301 @@
+#ifndef INDEXSEGMENT_H
+#define INDEXSEGMENT_H
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "IndexData.h"
+#include "MappedFile.h"
+#include "PostingCodec.h"
+#include "TermAutomaton.h"
+
+// Параметры BM25: по ним считаются и веса документов, и вклад терма в блоках сегмента
+constexpr double BM25_K1 = 1.2;
+constexpr double BM25_B = 0.75;
+
+// Вклад терма в BM25 без idf: частота в документе длины length при средней длине averageLength
+inline double bm25Impact(double frequency, double length, double averageLength) {
+    return frequency * (BM25_K1 + 1.0) / (frequency + BM25_K1 * (1.0 - BM25_B + BM25_B * length / averageLength));
+}
+
+/*
+ Бинарный сегмент индекса (замена index.json).
+
+ Формат (little-endian):
+   SegmentHeader
+   TermEntry[termCount]      - словарь, отсортирован по байтам терма
+   строки термов             - пул строк, на который ссылаются TermEntry
+   postings                  - для каждого терма блоки по SEGMENT_BLOCK_SIZE документов:
+                               дельты doc id, затем frequency - 1, оба массива кодеком сегмента
+   positions                 - для каждого блока postings: дельты позиций всех его документов
+                               одним массивом кодека (у каждого документа отсчет с нуля),
+                               после блока - CODEC_READ_PADDING байт запаса для декодеров
+   deleted                   - uint32 id документов, которые этот сегмент скрывает в более старых
+   lengths                   - uint32 длина документа в токенах, индекс - document_id
+   skips                     - SkipEntry для каждого блока из SEGMENT_BLOCK_SIZE документов
+                               (только у термов, где документов больше одного блока): кроме
+                               начала блока - наибольшая частота и наибольший вклад терма в BM25
+                               документа блока при средней длине сегмента (Block-Max WAND)
+   automaton                 - словарь как TermAutomaton: номер терма в автомате - номер TermEntry,
+                               по нему термы ищутся по префиксу, шаблону и с опечатками
+   offsets                   - необязательно, с выравниванием на 8 байт: uint64 начало записи
+                               TokenOffsets каждого document_id (UINT64_MAX - записи нет), затем записи
+                               с контрольными точками через TokenOffsets::CHECKPOINT_INTERVAL токенов
+
+ Кодек (varint, Group Varint, PFor) выбирается при записи и хранится в заголовке,
+ поэтому сегменты разных кодеков читаются одинаково. Там же отпечаток Analyzer:
+ термы сегмента имеют смысл только при той же нормализации запросов.
+
+ Файл отображается в память целиком, а списки читаются прямо из mmap
+ без десериализации. При открытии по словарю один раз строится хеш-таблица,
+ поэтому поиск терма стоит O(1), а не O(log n) сравнений строк.
+*/
+
+constexpr char SEGMENT_MAGIC[4] = {'S', 'E', 'I', 'X'};
+constexpr uint32_t SEGMENT_VERSION = 10;
+constexpr uint32_t SEGMENT_BLOCK_SIZE = 128;
+// Сколько байт postings и positions писатель сегмента держит в памяти до сброса на диск
+constexpr size_t SEGMENT_FLUSH_BYTES = 16 << 20;
+
+struct SegmentHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t termCount;
+    uint32_t documentCount;
+    uint64_t dictionaryOffset;
+    uint64_t stringsOffset;
+    uint64_t postingsOffset;
+    uint64_t positionsOffset;
+    uint64_t deletedOffset;
+    uint32_t deletedCount;
+    uint32_t lengthsCount;
+    uint64_t lengthsOffset;
+    uint64_t totalLength;     // сумма длин всех документов сегмента
+    uint64_t skipsOffset;
+    uint32_t skipCount;
+    uint32_t blockSize;
+    uint64_t fileSize;
+    uint32_t codec;           // CodecType списков и позиций
+    uint32_t analyzer;        // Analyzer::fingerprint() настроек, с которыми разобран текст
+    uint64_t automatonOffset;
+    uint64_t automatonSize;
+    uint64_t offsetsOffset;
+    uint64_t offsetsSize;     // 0 - границы токенов не хранятся
+};
+
+struct TermEntry {
+    uint32_t stringOffset;   // смещение в пуле строк
+    uint32_t stringLength;
+    uint32_t termId;
+    uint32_t documentFrequency;
+    uint64_t postingsOffset;  // относительно начала блока postings
+    uint64_t positionsOffset; // относительно начала блока positions
+    uint32_t postingsBytes;
+    uint32_t positionsBytes;
+    uint32_t skipOffset;      // индекс первого SkipEntry терма
+    uint32_t maxFrequency;    // наибольшая частота терма в одном документе
+};
+
+// Указатель пропуска на начало блока postings
+struct SkipEntry {
+    uint32_t lastDocumentId;  // последний документ блока
+    uint32_t postingsOffset;  // начало блока относительно начала списка терма
+    uint32_t positionsOffset;
+    uint32_t maxFrequency;    // наибольшая частота в блоке
+    float maxImpact;          // наибольший bm25Impact документа блока при средней длине сегмента
+};
+
+static_assert(sizeof(SegmentHeader) == 144, "SegmentHeader layout changed");
+static_assert(sizeof(TermEntry) == 48, "TermEntry layout changed");
+static_assert(sizeof(SkipEntry) == 20, "SkipEntry layout changed");
+
+// Чтение списка документов терма прямо из mmap: блок документов раскодируется целиком,
+// позиции блока - при первом обращении к ним
+class PostingList {
+private:
+    const IntegerCodec* codec = nullptr;
+    const uint8_t* postingsBegin = nullptr;
+    const uint8_t* positionsBegin = nullptr;
+    const SkipEntry* skips = nullptr;
+    uint32_t skipCount = 0;
+    uint32_t documentCount = 0;
+    uint32_t maxFrequency = 0;
+    // Текущий блок, число документов в нем и номер текущего документа в блоке
+    uint32_t block = 0;
+    uint32_t blockSize = 0;
+    uint32_t index = 0;
+    bool started = false;
+    uint32_t docId = 0;
+    uint32_t freq = 0;
+    uint32_t documents[SEGMENT_BLOCK_SIZE];
+    uint32_t frequencies[SEGMENT_BLOCK_SIZE];
+    // Позиции блока: начало закодированных, раскодированные дельты и начало дельт каждого документа
+    const uint8_t* blockPositions = nullptr;
+    bool positionsDecoded = false;
+    std::vector<uint32_t> positionDeltas;
+    uint32_t positionStarts[SEGMENT_BLOCK_SIZE + 1];
+
+    // false - блоков больше нет
+    bool loadBlock(uint32_t number);
+
+public:
+    PostingList() = default;
+    PostingList(CodecType codecType, const uint8_t* postingsBegin, const uint8_t* positionsBegin,
+                const SkipEntry* skips, uint32_t skipCount, uint32_t documentCount, uint32_t maxFrequency);
+
+    // Переход к следующему документу, false - список закончился
+    bool next();
+    // Переход к первому документу с id >= target (галопом по указателям пропуска),
+    // false - таких документов нет
+    bool advance(uint32_t target);
+    uint32_t documentId() const { return docId; }
+    uint32_t frequency() const { return freq; }
+    // Блок, где лежит первый документ с id >= target, по указателям пропуска без раскодирования:
+    // его последний документ, наибольшая частота и наибольший вклад терма. У списка без указателей
+    // пропуска блок один до конца id, вклад - по наибольшей частоте при нулевой длине. false - документов нет
+    bool blockBound(uint32_t target, SkipEntry& bound) const;
+    // Позиции терма в текущем документе
+    std::vector<uint32_t> positions();
+    // То же в переиспользуемый буфер
+    void readPositions(std::vector<uint32_t>& result);
+};
+
+class IndexSegment {
+private:
+    MappedFile file;
+    const uint8_t* data = nullptr;
+    const SegmentHeader* header = nullptr;
+    const TermEntry* dictionary = nullptr;
+    const char* strings = nullptr;
+    TermAutomaton automaton;
+
+    // Ячейка таблицы поиска: номер TermEntry + 1 (0 - пусто) и старшие биты хеша,
+    // строки сравниваются только при совпадении хеша
+    struct LookupSlot {
+        uint32_t entry;
+        uint32_t tag;
+    };
+    std::vector<LookupSlot> lookup;
+    size_t lookupMask = 0;
+
+    void buildLookup();
+
+public:
+    IndexSegment() = default;
+    ~IndexSegment();
+    IndexSegment(const IndexSegment&) = delete;
+    IndexSegment& operator=(const IndexSegment&) = delete;
+
+    // Отображение файла сегмента в память и проверка заголовка
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+
+    uint32_t termCount() const;
+    uint32_t documentCount() const;
+    // Отсортированные id документов, удаленных из более старых сегментов
+    const uint32_t* deletedDocuments() const;
+    uint32_t deletedCount() const;
+    // Длина документа в токенах, 0 если документа нет в сегменте
+    uint32_t documentLength(uint32_t documentId) const;
+    // Число ячеек длин: id документов сегмента меньше него
+    uint32_t lengthCount() const;
+    uint64_t totalLength() const;
+    // Средняя длина документа сегмента, не меньше 1: при ней посчитан вклад терма в блоках
+    double averageLength() const;
+    CodecType codec() const;
+    uint32_t analyzer() const;
+    // Запись TokenOffsets документа, nullptr - у документа ее нет
+    const uint8_t* tokenOffsets(uint32_t documentId) const;
+    bool hasTokenOffsets() const;
+    // Размер закодированных списков и позиций всех термов, байт
+    uint64_t postingsBytes() const;
+    uint64_t positionsBytes() const;
+    // Указатели пропуска терма, пустой диапазон для коротких списков
+    const SkipEntry* skips(const TermEntry& entry) const;
+    uint32_t skipCount(const TermEntry& entry) const;
+    // Термы словаря в порядке возрастания
+    const TermEntry* begin() const;
+    const TermEntry* end() const;
+
+    // Поиск терма по таблице, nullptr если терм не найден
+    const TermEntry* findTerm(std::string_view term) const;
+    // То же с готовым TermDictionary::hashTerm(term), чтобы не считать хеш для каждого сегмента
+    const TermEntry* findTerm(std::string_view term, uint64_t hash) const;
+    std::string_view termString(const TermEntry& entry) const;
+    // Автомат словаря для поиска термов по шаблону; номер терма - индекс от begin()
+    const TermAutomaton& terms() const { return automaton; }
+    PostingList postings(const TermEntry& entry) const;
+
+    // Запись сегмента из построенных индексов
+    static bool write(const std::string& path, const IndexData& index,
+                      const std::vector<uint32_t>& deletedDocuments = {}, CodecType codec = DEFAULT_CODEC,
+                      uint32_t analyzer = 0);
+    // Слияние основного сегмента с дельтой в новый сегмент без удаленных документов.
+    // С закрытой дельтой - перекодирование основного сегмента. Отпечаток Analyzer берется у основного
+    static bool merge(const IndexSegment& base, const IndexSegment& delta, const std::string& path,
+                      CodecType codec = DEFAULT_CODEC);
+};
+
+// Потоковая запись сегмента: термы подаются по возрастанию.
+// Блоки postings и positions больше SEGMENT_FLUSH_BYTES дописываются во временные
+// файлы рядом с сегментом, в памяти остаются только словарь и длины документов
+class SegmentWriter {
+private:
+    std::string path;
+    const IntegerCodec& codec;
+    uint32_t analyzer;
+    std::vector<TermEntry> entries;
+    std::string stringPool;
+    TermAutomatonBuilder automatonBuilder;
+    std::string postingsBlock;
+    std::string positionsBlock;
+    std::ofstream postingsSpill;
+    std::ofstream positionsSpill;
+    uint64_t postingsFlushed = 0;
+    uint64_t positionsFlushed = 0;
+    bool spillFailed = false;
+    std::vector<uint32_t> deleted;
+    std::vector<uint32_t> lengths;
+    // Длины документов, известные до записи списков, и их средняя - для вклада терма в блоке
+    std::vector<uint32_t> knownLengths;
+    double knownAverage = 1.0;
+    std::vector<SkipEntry> skipEntries;
+    TokenOffsets offsets;
+    // Массивы текущего блока перед кодированием
+    std::vector<uint32_t> blockDocuments;
+    std::vector<uint32_t> blockFrequencies;
+    std::vector<uint32_t> blockPositions;
+
+    // Полные размеры блоков вместе со сброшенной частью
+    uint64_t postingsSize() const { return postingsFlushed + postingsBlock.size(); }
+    uint64_t positionsSize() const { return positionsFlushed + positionsBlock.size(); }
+    void flushBlocks();
+    void removeSpills();
+
+public:
+    explicit SegmentWriter(std::string path, CodecType codec = DEFAULT_CODEC, uint32_t analyzer = 0);
+    ~SegmentWriter();
+    SegmentWriter(const SegmentWriter&) = delete;
+    SegmentWriter& operator=(const SegmentWriter&) = delete;
+
+    // Длины документов (индекс - document_id) до первого addTerm: по ним у блоков хранится
+    // точный наибольший вклад терма, без них - вклад наибольшей частоты при нулевой длине
+    void setDocumentLengths(std::vector<uint32_t> documentLengths);
+    // [begin, end) - вхождения по возрастанию document_id,
+    // positions - подряд позиции каждого вхождения, по frequency штук
+    void addTerm(std::string_view term, uint32_t termId,
+                 const IndexPosting* begin, const IndexPosting* end,
+                 const uint32_t* positions);
+    void setDeletedDocuments(std::vector<uint32_t> documents);
+    // Границы токенов документов; без них сегмент пишется без раздела offsets
+    void setTokenOffsets(TokenOffsets tokenOffsets) { offsets = std::move(tokenOffsets); }
+    // Запись файла сегмента, временные файлы блоков удаляются
+    bool finish();
+};
+
+#endif // INDEXSEGMENT_H
@@ -0,0 +1,392 @@
+#include "IndexSnapshot.h"
+#include "Metrics.h"
+#include "TermDictionary.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <limits>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// Последний выданный номер открытия снимка
+static std::atomic<uint64_t> lastGeneration {0};
+
+void SnapshotPostings::addSource(PostingList list, const std::vector<uint32_t>* hidden, const TermEntry& entry,
+                                 double impactScale) {
+    Source source {list, hidden, false, termCount, impactScale};
+    source.valid = source.list.next();
+    skipHidden(source);
+    sources.push_back(source);
+    if (sources.back().valid) {
+        wait(static_cast<uint32_t>(sources.size() - 1));
+    }
+    termFrequency += entry.documentFrequency;
+    postingTotal += entry.documentFrequency;
+    termHighest = std::max(termHighest, entry.maxFrequency);
+    totalFrequency = std::max(totalFrequency, termFrequency);
+    highestFrequency = previousHighest + termHighest;
+}
+
+void SnapshotPostings::nextTerm() {
+    ++termCount;
+    previousHighest += termHighest;
+    termFrequency = 0;
+    termHighest = 0;
+}
+
+bool SnapshotPostings::isHidden(const Source& source) {
+    return source.hidden != nullptr && !source.hidden->empty() &&
+           std::binary_search(source.hidden->begin(), source.hidden->end(), source.list.documentId());
+}
+
+// Сдвиг источника на ближайший документ, который не скрыт более новыми сегментами
+void SnapshotPostings::skipHidden(Source& source) {
+    while (source.valid && isHidden(source)) {
+        source.valid = source.list.next();
+    }
+}
+
+// Куча с наименьшим документом наверху
+void SnapshotPostings::wait(uint32_t index) {
+    waiting.push_back(index);
+    std::push_heap(waiting.begin(), waiting.end(), [this](uint32_t a, uint32_t b) { return later(a, b); });
+}
+
+uint32_t SnapshotPostings::take() {
+    std::pop_heap(waiting.begin(), waiting.end(), [this](uint32_t a, uint32_t b) { return later(a, b); });
+    uint32_t index = waiting.back();
+    waiting.pop_back();
+    return index;
+}
+
+// Текущий документ - наименьший в куче, с него снимаются все источники на этом документе.
+// Один id терма живет только в одном сегменте, поэтому совпадают только источники разных термов
+bool SnapshotPostings::selectCurrent() {
+    matching.clear();
+    currentFrequency = 0;
+    if (waiting.empty()) {
+        return false;
+    }
+    currentId = sources[waiting.front()].list.documentId();
+    while (!waiting.empty() && sources[waiting.front()].list.documentId() == currentId) {
+        matching.push_back(take());
+        currentFrequency += sources[matching.back()].list.frequency();
+    }
+    return true;
+}
+
+bool SnapshotPostings::next() {
+    for (uint32_t index : matching) {
+        Source& source = sources[index];
+        source.valid = source.list.next();
+        skipHidden(source);
+        if (source.valid) {
+            wait(index);
+        }
+    }
+    return selectCurrent();
+}
+
+bool SnapshotPostings::advance(uint32_t target) {
+    if (!matching.empty() && currentId >= target) {
+        return true;
+    }
+    for (uint32_t index : matching) {
+        wait(index);
+    }
+    // Из кучи снимаются только источники, которые стоят раньше цели
+    while (!waiting.empty() && sources[waiting.front()].list.documentId() < target) {
+        uint32_t index = take();
+        Source& source = sources[index];
+        source.valid = source.list.advance(target);
+        skipHidden(source);
+        if (source.valid) {
+            wait(index);
+        }
+    }
+    return selectCurrent();
+}
+
+std::vector<uint32_t> SnapshotPostings::positions() {
+    std::vector<uint32_t> result;
+    readPositions(result);
+    return result;
+}
+
+void SnapshotPostings::readPositions(std::vector<uint32_t>& result) {
+    if (matching.size() == 1) {
+        sources[matching.front()].list.readPositions(result);
+        return;
+    }
+    // Разные термы не стоят на одной позиции, слияние - сортировка общего массива
+    thread_local std::vector<uint32_t> termPositions;
+    result.clear();
+    for (uint32_t index : matching) {
+        sources[index].list.readPositions(termPositions);
+        result.insert(result.end(), termPositions.begin(), termPositions.end());
+    }
+    std::sort(result.begin(), result.end());
+}
+
+bool SnapshotPostings::blockBound(uint32_t target, BlockBound& bound) const {
+    bound = {std::numeric_limits<uint32_t>::max(), 0.0};
+    bool found = false;
+    // Источники одного терма идут подряд, документ терма виден только в одном сегменте.
+    // Вклад растет медленнее частоты, поэтому сумма вкладов термов не меньше вклада суммы частот
+    uint32_t term = 0;
+    double highest = 0;
+    for (const Source& source : sources) {
+        SkipEntry skip;
+        if (!source.valid || !source.list.blockBound(target, skip)) {
+            continue;
+        }
+        if (source.term != term) {
+            bound.impact += highest;
+            highest = 0;
+            term = source.term;
+        }
+        found = true;
+        highest = std::max(highest, skip.maxImpact * source.impactScale);
+        bound.lastDocumentId = std::min(bound.lastDocumentId, skip.lastDocumentId);
+    }
+    bound.impact += highest;
+    return found;
+}
+
+bool IndexSnapshot::open(const std::string& mainPath, const std::string& deltaPath) {
+    PhaseTimer timer(Phase::Load);
+    segments.clear();
+    hidden.clear();
+    openedManifest = IndexManifest();
+
+    auto mainSegment = std::make_unique<IndexSegment>();
+    if (!mainSegment->open(mainPath)) {
+        return false;
+    }
+    segments.push_back(std::move(mainSegment));
+    hidden.emplace_back();
+
+    if (!deltaPath.empty() && fs::exists(deltaPath)) {
+        auto deltaSegment = std::make_unique<IndexSegment>();
+        if (deltaSegment->open(deltaPath)) {
+            hidden[0].assign(deltaSegment->deletedDocuments(),
+                             deltaSegment->deletedDocuments() + deltaSegment->deletedCount());
+            segments.push_back(std::move(deltaSegment));
+            hidden.emplace_back();
+        }
+    }
+
+    liveDocuments = 0;
+    liveLength = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        liveDocuments += segments[i]->documentCount();
+        liveLength += segments[i]->totalLength();
+        for (uint32_t documentId : hidden[i]) {
+            uint32_t length = segments[i]->documentLength(documentId);
+            if (length > 0) {
+                --liveDocuments;
+                liveLength -= length;
+            }
+        }
+    }
+    openGeneration = lastGeneration.fetch_add(1, std::memory_order_relaxed) + 1;
+    return true;
+}
+
+bool IndexSnapshot::openPublished(const std::string& manifestPath) {
+    // Писатель удаляет файлы прошлого поколения сразу после публикации, поэтому
+    // прочитанный манифест может устареть раньше, чем откроются его сегменты
+    static constexpr int OPEN_ATTEMPTS = 3;
+    for (int attempt = 0; attempt < OPEN_ATTEMPTS; ++attempt) {
+        IndexManifest published;
+        if (!published.load(manifestPath)) {
+            break;
+        }
+        bool opened = open(published.main().path, published.delta().path);
+        if (opened && segments.size() == (published.hasDelta() ? 2u : 1u)) {
+            openedManifest = published;
+            return true;
+        }
+        IndexManifest latest;
+        if (!latest.load(manifestPath) || latest.generation() == published.generation()) {
+            break;
+        }
+    }
+    segments.clear();
+    hidden.clear();
+    openedManifest = IndexManifest();
+    return false;
+}
+
+bool IndexSnapshot::setAnalyzer(std::shared_ptr<const Analyzer> analyzer) {
+    // Запрос, разобранный другими настройками, молча не нашел бы ни одного терма
+    for (const auto& segment : segments) {
+        if (segment->analyzer() != analyzer->fingerprint()) {
+            return false;
+        }
+    }
+    textAnalyzer = std::move(analyzer);
+    return true;
+}
+
+SnapshotPostings IndexSnapshot::postings(std::string_view term) const {
+    SnapshotPostings result;
+    // Хеш один на все сегменты
+    uint64_t hash = TermDictionary::hashTerm(term);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const TermEntry* entry = segments[i]->findTerm(term, hash);
+        if (entry != nullptr) {
+            result.addSource(segments[i]->postings(*entry), &hidden[i], *entry, impactScale(i));
+        }
+    }
+    return result;
+}
+
+SnapshotPostings IndexSnapshot::postings(const std::vector<std::string_view>& terms) const {
+    SnapshotPostings result;
+    for (std::string_view term : terms) {
+        uint64_t hash = TermDictionary::hashTerm(term);
+        for (size_t i = 0; i < segments.size(); ++i) {
+            const TermEntry* entry = segments[i]->findTerm(term, hash);
+            if (entry != nullptr) {
+                result.addSource(segments[i]->postings(*entry), &hidden[i], *entry, impactScale(i));
+            }
+        }
+        result.nextTerm();
+    }
+    return result;
+}
+
+std::vector<std::string_view> IndexSnapshot::expand(const TermPattern& pattern, size_t limit) const {
+    // Кандидаты перебираются в порядке словаря, поэтому их число ограничено отдельно:
+    // шаблон вроде a* не обходит весь словарь ради limit лучших. У нечеткого шаблона
+    // предел действует на каждое расстояние, и ближние термы всегда среди кандидатов
+    size_t scanLimit = limit * EXPANSION_SCAN_FACTOR;
+    struct Candidate {
+        uint32_t distance;
+        uint32_t documentFrequency;
+    };
+    std::unordered_map<std::string_view, Candidate> candidates;
+    std::vector<TermMatch> matches;
+    for (const auto& segment : segments) {
+        matches.clear();
+        if (pattern.kind == PatternKind::Fuzzy) {
+            segment->terms().matchFuzzy(pattern.text, pattern.distance, scanLimit, matches);
+        } else {
+            segment->terms().matchWildcard(pattern.text, scanLimit, matches);
+        }
+        for (const TermMatch& match : matches) {
+            if (match.ordinal >= segment->termCount()) {
+                continue;
+            }
+            const TermEntry& entry = segment->begin()[match.ordinal];
+            auto [it, inserted] = candidates.try_emplace(segment->termString(entry),
+                                                         Candidate{match.distance, 0});
+            it->second.documentFrequency += entry.documentFrequency;
+        }
+    }
+
+    std::vector<std::pair<std::string_view, Candidate>> ranked(candidates.begin(), candidates.end());
+    auto better = [](const auto& a, const auto& b) {
+        if (a.second.distance != b.second.distance) {
+            return a.second.distance < b.second.distance;
+        }
+        if (a.second.documentFrequency != b.second.documentFrequency) {
+            return a.second.documentFrequency > b.second.documentFrequency;
+        }
+        return a.first < b.first;
+    };
+    if (ranked.size() > limit) {
+        std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(limit), ranked.end(), better);
+        ranked.resize(limit);
+    } else {
+        std::sort(ranked.begin(), ranked.end(), better);
+    }
+    std::vector<std::string_view> terms;
+    terms.reserve(ranked.size());
+    for (const auto& [term, candidate] : ranked) {
+        terms.push_back(term);
+    }
+    return terms;
+}
+
+uint32_t IndexSnapshot::documentFrequency(std::string_view term) const {
+    uint32_t frequency = 0;
+    uint64_t hash = TermDictionary::hashTerm(term);
+    for (const auto& segment : segments) {
+        const TermEntry* entry = segment->findTerm(term, hash);
+        if (entry != nullptr) {
+            frequency += entry->documentFrequency;
+        }
+    }
+    return frequency;
+}
+
+uint32_t IndexSnapshot::documentCount() const {
+    return liveDocuments;
+}
+
+uint32_t IndexSnapshot::documentLength(uint32_t documentId) const {
+    for (size_t i = segments.size(); i-- > 0;) {
+        uint32_t length = segments[i]->documentLength(documentId);
+        if (length > 0 && !std::binary_search(hidden[i].begin(), hidden[i].end(), documentId)) {
+            return length;
+        }
+    }
+    return 0;
+}
+
+void IndexSnapshot::setDocuments(const DocumentState& state) {
+    documentPaths.clear();
+    documentRecords.clear();
+    for (const auto& [filePath, record] : state.documents()) {
+        if (record.documentId >= documentPaths.size()) {
+            documentPaths.resize(record.documentId + 1);
+            documentRecords.resize(record.documentId + 1);
+        }
+        documentPaths[record.documentId] = filePath;
+        documentRecords[record.documentId] = record;
+    }
+}
+
+bool IndexSnapshot::loadDocuments() {
+    // Состояние публикуется вместе с сегментами, поэтому описывает те же версии файлов
+    DocumentState state;
+    if (openedManifest.state().path.empty() || !state.load(openedManifest.state().path)) {
+        return false;
+    }
+    setDocuments(state);
+    return true;
+}
+
+const std::string& IndexSnapshot::documentPath(uint32_t documentId) const {
+    static const std::string unknown;
+    return documentId < documentPaths.size() ? documentPaths[documentId] : unknown;
+}
+
+const DocumentRecord* IndexSnapshot::documentRecord(uint32_t documentId) const {
+    return documentId < documentPaths.size() && !documentPaths[documentId].empty() ? &documentRecords[documentId]
+                                                                                    : nullptr;
+}
+
+const uint8_t* IndexSnapshot::tokenOffsets(uint32_t documentId, uint32_t& length) const {
+    for (size_t i = segments.size(); i-- > 0;) {
+        length = segments[i]->documentLength(documentId);
+        if (length > 0 && !std::binary_search(hidden[i].begin(), hidden[i].end(), documentId)) {
+            return segments[i]->tokenOffsets(documentId);
+        }
+    }
+    length = 0;
+    return nullptr;
+}
+
+// Вклад записан при средней длине сегмента; при большей средней снимка знаменатель BM25
+// уменьшается не больше чем во столько же раз, во сколько выросла средняя
+double IndexSnapshot::impactScale(size_t segment) const {
+    return std::max(1.0, std::max(1.0, averageDocumentLength()) / segments[segment]->averageLength());
+}
+
+double IndexSnapshot::averageDocumentLength() const {
+    return liveDocuments > 0 ? static_cast<double>(liveLength) / liveDocuments : 0.0;
+}
@@ -0,0 +1,164 @@
+#ifndef INDEXSNAPSHOT_H
+#define INDEXSNAPSHOT_H
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Analyzer.h"
+#include "DocumentState.h"
+#include "IndexManifest.h"
+#include "IndexSegment.h"
+
+// Верхняя оценка документов списка от цели до lastDocumentId включительно:
+// вклад терма в BM25 без idf при средней длине снимка
+struct BlockBound {
+    uint32_t lastDocumentId;
+    double impact;
+};
+
+/*
+ Список документов терма по всем сегментам снимка, по возрастанию document_id.
+ Может объединять несколько термов (раскрытие шаблона): источники держатся
+ в куче по текущему документу, частоты источников на одном документе
+ складываются, позиции сливаются.
+*/
+class SnapshotPostings {
+private:
+    struct Source {
+        PostingList list;
+        const std::vector<uint32_t>* hidden;
+        bool valid;
+        uint32_t term;  // номер терма объединения
+        // Во сколько раз вклад терма при средней длине снимка может быть больше, чем при средней сегмента
+        double impactScale;
+    };
+    std::vector<Source> sources;
+    // Источники на текущем документе и куча остальных действующих по documentId
+    std::vector<uint32_t> matching;
+    std::vector<uint32_t> waiting;
+    uint32_t currentId = 0;
+    uint32_t currentFrequency = 0;
+    uint32_t totalFrequency = 0;
+    uint32_t highestFrequency = 0;
+    uint64_t postingTotal = 0;
+    uint32_t termCount = 0;
+    // Частоты терма, который сейчас добавляется, по всем его сегментам
+    uint32_t termFrequency = 0;
+    uint32_t termHighest = 0;
+    uint32_t previousHighest = 0;
+
+    static bool isHidden(const Source& source);
+    static void skipHidden(Source& source);
+    bool later(uint32_t a, uint32_t b) const {
+        return sources[a].list.documentId() > sources[b].list.documentId();
+    }
+    void wait(uint32_t index);
+    uint32_t take();
+    bool selectCurrent();
+
+public:
+    SnapshotPostings() = default;
+    void addSource(PostingList list, const std::vector<uint32_t>* hidden, const TermEntry& entry,
+                   double impactScale = 1.0);
+    // Следующие источники относятся к другому терму
+    void nextTerm();
+
+    // Переход к следующему документу, false - списки закончились
+    bool next();
+    // Переход к первому документу с id >= target, false - таких документов нет
+    bool advance(uint32_t target);
+    uint32_t documentId() const { return currentId; }
+    uint32_t frequency() const { return currentFrequency; }
+    std::vector<uint32_t> positions();
+    void readPositions(std::vector<uint32_t>& result);
+    // Оценка по блокам источников, где лежат первые документы с id >= target: вклады
+    // складываются по термам, граница - ближайший конец блока. false - документов >= target нет
+    bool blockBound(uint32_t target, BlockBound& bound) const;
+
+    // Число документов терма во всех сегментах (без учета скрытых),
+    // у объединения - наибольшее среди его термов
+    uint32_t documentFrequency() const { return totalFrequency; }
+    // Наибольшая частота в одном документе, для верхней оценки веса;
+    // у объединения - сумма наибольших частот термов
+    uint32_t maxFrequency() const { return highestFrequency; }
+    // Сумма длин всех списков - оценка числа документов сверху, по ней планируются булевы запросы
+    uint64_t postingCount() const { return postingTotal; }
+};
+
+/*
+ Набор сегментов индекса: основной и необязательная дельта.
+ Дельта хранит переиндексированные документы и список id,
+ которые она скрывает в основном сегменте.
+*/
+class IndexSnapshot {
+private:
+    // Во сколько раз больше кандидатов, чем нужно термов, перебирается при раскрытии шаблона
+    static constexpr size_t EXPANSION_SCAN_FACTOR = 16;
+    // Сегменты от старых к новым
+    std::vector<std::unique_ptr<IndexSegment>> segments;
+    // Для каждого сегмента - отсортированные id, скрытые более новыми сегментами
+    std::vector<std::vector<uint32_t>> hidden;
+    // Число и суммарная длина видимых документов, считаются при открытии
+    uint32_t liveDocuments = 0;
+    uint64_t liveLength = 0;
+    uint64_t openGeneration = 0;
+    IndexManifest openedManifest;
+    std::shared_ptr<const Analyzer> textAnalyzer = Analyzer::standard();
+    // Файлы по document_id (пустой путь - id свободен) и их состояние при индексации
+    std::vector<std::string> documentPaths;
+    std::vector<DocumentRecord> documentRecords;
+
+    double impactScale(size_t segment) const;
+
+public:
+    IndexSnapshot() = default;
+
+    // Открытие основного сегмента и дельты, если она есть
+    bool open(const std::string& mainPath, const std::string& deltaPath);
+    // Открытие сегментов поколения, опубликованного в манифесте. Если между
+    // чтением манифеста и открытием вышло новое поколение, берется оно
+    bool openPublished(const std::string& manifestPath = INDEX_MANIFEST_PATH);
+    // Манифест, по которому открыт снимок (пустой, если открыт по путям)
+    const IndexManifest& manifest() const { return openedManifest; }
+    bool isOpen() const { return !segments.empty(); }
+    size_t segmentCount() const { return segments.size(); }
+    // Номер открытия снимка в процессе: у каждого нового снимка он больше,
+    // поэтому по нему видно, что индекс переоткрыт после перестройки
+    uint64_t generation() const { return openGeneration; }
+    // Analyzer, которым разобраны документы сегментов; запросы к снимку разбираются им же.
+    // false - отпечаток analyzer не совпал с записанным в сегментах, Analyzer снимка не меняется
+    bool setAnalyzer(std::shared_ptr<const Analyzer> analyzer);
+    const Analyzer& analyzer() const { return *textAnalyzer; }
+    std::shared_ptr<const Analyzer> sharedAnalyzer() const { return textAnalyzer; }
+    // Пути файлов документов с размером, временем изменения и хешем при индексации:
+    // по ним сниппеты вырезаются из текста. loadDocuments берет их из index.state поколения
+    void setDocuments(const DocumentState& state);
+    bool loadDocuments();
+    // Путь файла документа, пустая строка - путь неизвестен
+    const std::string& documentPath(uint32_t documentId) const;
+    // Состояние файла документа при индексации, nullptr - неизвестно
+    const DocumentRecord* documentRecord(uint32_t documentId) const;
+
+    SnapshotPostings postings(std::string_view term) const;
+    // Один список документов по нескольким термам
+    SnapshotPostings postings(const std::vector<std::string_view>& terms) const;
+    // Термы всех сегментов под шаблон, не больше limit: сначала ближайшие к шаблону,
+    // затем самые частые. Wildcard выбирает частые только среди первых по словарю
+    // limit * EXPANSION_SCAN_FACTOR термов сегмента. Строки указывают в отображение
+    // сегментов и живут со снимком
+    std::vector<std::string_view> expand(const TermPattern& pattern, size_t limit) const;
+    // Число документов терма (без учета скрытых)
+    uint32_t documentFrequency(std::string_view term) const;
+    uint32_t documentCount() const;
+    // Длина документа в токенах из сегмента, где он сейчас живет
+    uint32_t documentLength(uint32_t documentId) const;
+    // Запись TokenOffsets документа из того же сегмента и число токенов в ней;
+    // nullptr - документа нет или сегмент хранит индекс без границ токенов
+    const uint8_t* tokenOffsets(uint32_t documentId, uint32_t& length) const;
+    double averageDocumentLength() const;
+};
+
+#endif // INDEXSNAPSHOT_H
@@ -1,21 +1,56 @@
 #include "InvertedIndex.h"
 #include "ConverterJSON.h"
-#include "SearchServer.h"
+#include "MappedFile.h"
+#include "Metrics.h"
 #include <filesystem>
+#include <atomic>
+#include <numeric>
+#include <queue>
+#include <thread>
+#include <unordered_set>
+#include "IndexSnapshot.h"
 namespace fs = std::filesystem;
 
+/*
+ Прогон - вхождения одного потока, сброшенные на диск при нехватке памяти.
+ Термы идут по возрастанию строк, как в сегменте: RunTerm, затем postingCount
+ вхождений в порядке чтения, у каждого document_id, frequency и frequency позиций.
+ Поэтому прогоны сливаются одним последовательным проходом по каждому.
+*/
+struct RunTerm {
+    uint32_t termId;
+    uint32_t postingCount;
+    uint64_t wordCount;   // число uint32 во вхождениях терма
+};
+
 
 void InvertedIndex::manageIndex(ConverterJSON& converter) {
-    std::string indexFilePath = "../index.json";
-    bool indexExists = fs::exists(indexFilePath);
+    waitForMerge();
+    // Индекс есть, только если опубликован манифест и файлы совпадают с ним;
+    // сегмент старого формата не открывается и строится заново
+    IndexManifest manifest;
+    IndexSegment segment;
+    bool indexExists = manifest.load(INDEX_MANIFEST_PATH) && manifest.verify(!manifestVerified) &&
+                       segment.open(manifest.main().path);
+    manifestVerified = manifestVerified || indexExists;
+    // Термы, разобранные с другими стоп-словами, регистром или стеммером, не совпадут с запросами
+    bool analyzerChanged = indexExists && segment.analyzer() != converter.getAnalyzer()->fingerprint();
+    // Границы токенов нужны всем документам сразу: иначе сниппеты были бы только у переиндексированных
+    bool offsetsChanged = indexExists && segment.hasTokenOffsets() != converter.getSnippets();
+    segment.close();
+    if (analyzerChanged) {
+        std::cerr << "Analyzer settings changed, rebuilding index" << std::endl;
+    } else if (offsetsChanged) {
+        std::cerr << "Snippet settings changed, rebuilding index" << std::endl;
+    }
 
     // если файл базы существует, то проверяем не пора ли обновить
-    if (indexExists) {
+    if (indexExists && !analyzerChanged && !offsetsChanged) {
         // Получаем текущее время
         auto currentTime = std::chrono::system_clock::now();
 
-        // Получаем время последнего изменения файла
-        auto lastWriteTime = fs::last_write_time(indexFilePath);
+        // Время последнего обновления индекса - время публикации index.manifest
+        auto lastWriteTime = fs::last_write_time(INDEX_MANIFEST_PATH);
 
         // Преобразуем в time_t
         std::time_t current_time_t = std::chrono::system_clock::to_time_t(currentTime);
@@ -27,7 +62,7 @@ void InvertedIndex::manageIndex(ConverterJSON& converter) {
 
         // Сравниваем с интервалом времени (TimeUpdate дб в кофиге в секундах)
         if (elapsedSeconds >= converter.getTimeUpdate()) {  // Используем converter для вызова getTimeUpdate
-            createIndex(converter);
+            updateIndex(converter);
         }
     } else {
         // Если индекс не существует, создаем новый индекс
@@ -35,160 +70,801 @@ void InvertedIndex::manageIndex(ConverterJSON& converter) {
     }
 }
 
-// Метод создания id токенов
-void InvertedIndex::indexTokens(std::unordered_map<std::string, int>& termIdMap, std::vector<std::string>& tokens, int& nextTermId) {
-    for (const auto& word : tokens) {
-        if (termIdMap.find(word) == termIdMap.end()) {
-            termIdMap[word] = nextTermId++;
+InvertedIndex::~InvertedIndex() {
+    waitForMerge();
+}
+
+// Публикация поколения: файлы уже сброшены на диск, манифест с их контрольными
+// суммами заменяется атомарно, после чего файлы прошлых поколений не нужны
+static bool publishGeneration(uint64_t generation, const std::string& mainPath,
+                              const std::string& deltaPath, const std::string& statePath) {
+    IndexManifest manifest;
+    manifest.setGeneration(generation);
+    if (!manifest.setMain(mainPath) || !manifest.setDelta(deltaPath) || !manifest.setState(statePath) ||
+        !manifest.save(INDEX_MANIFEST_PATH)) {
+        return false;
+    }
+    manifest.removeStale(INDEX_MANIFEST_PATH);
+    return true;
+}
+
+// Хеш содержимого файла, 0 если файл не читается
+static uint64_t hashFile(const std::string& filePath) {
+    MappedFile inputFile;
+    if (!inputFile.open(filePath)) {
+        return 0;
+    }
+    return DocumentState::hashContent(inputFile.view());
+}
+
+// Ограниченный пул потоков: count задач разбираются workers потоками через общий счетчик
+template <typename Task>
+static void runParallel(size_t count, unsigned workers, Task task) {
+    std::atomic<size_t> nextTask{0};
+    auto worker = [&](unsigned workerIndex) {
+        for (size_t i = nextTask++; i < count; i = nextTask++) {
+            task(i, workerIndex);
         }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned w = 1; w < workers; ++w) {
+        threads.emplace_back(worker, w);
+    }
+    worker(0);
+    for (auto& thread : threads) {
+        thread.join();
     }
 }
 
-// Метод создания инвертированного индекса (частота появления в документах)
-void InvertedIndex::createInvertedIndex(std::unordered_map<int, std::vector<std::pair<int, int>>>& invertedIndex,
-                                        const std::unordered_map<std::string, int>& termIdMap,
-                                        const std::vector<std::string>& tokens,
-                                        int documentId) {
-    for (const auto& word : tokens) {
-        int termId = termIdMap.at(word);
+void InvertedIndex::setThreadCount(unsigned count) {
+    threadCount = count;
+}
 
-        auto& docList = invertedIndex[termId];
-        auto it = std::find_if(docList.begin(), docList.end(), [&](const std::pair<int, int>& p) {
-            return p.first == documentId;
-        });
+unsigned InvertedIndex::getThreadCount() const {
+    if (threadCount > 0) {
+        return threadCount;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
 
-        if (it != docList.end()) {
-            it->second++;  // Увеличиваем частоту
-        } else {
-            docList.emplace_back(documentId, 1);  // Новый документ, частота = 1
+unsigned InvertedIndex::workerCount(size_t fileCount) const {
+    return std::max<unsigned>(1, std::min<size_t>(getThreadCount(), fileCount));
+}
+
+// Метод добавления документа во вхождения потока.
+// Документ читается порциями: порция режется по последнему пробельному символу,
+// незаконченное слово переносится в начало следующей порции
+bool InvertedIndex::indexDocument(WorkerPostings& worker, Tokenizer& tokenizer, const std::string& filePath,
+                                  int documentId, uint64_t& contentHash) {
+    std::ifstream input(filePath, std::ios::binary);
+    if (!input.is_open()) {
+        std::cerr << "Error: Unable to open file " << filePath << std::endl;
+        return false;
+    }
+    std::string& chunk = worker.chunk;
+    if (chunk.size() < READ_CHUNK) {
+        chunk.resize(READ_CHUNK);
+    }
+
+    auto& occurrences = worker.occurrences;
+    occurrences.clear();
+    bool added = false;
+    // Перенос накопленных пар во вхождения и сброс прогона, если поток превысил свою долю памяти
+    auto flush = [&]() {
+        // Вхождения документа из разных переносов склеиваются при раскладке или слиянии прогонов
+        worker.split |= added;
+        addOccurrences(worker, static_cast<uint32_t>(documentId));
+        added = true;
+        if (worker.memoryLimit > 0 && worker.memoryUsage() > worker.memoryLimit && !spillRun(worker)) {
+            worker.failed = true;
+            return false;
         }
+        return true;
+    };
+
+    uint64_t hash = DocumentState::HASH_SEED;
+    uint64_t bytesRead = 0;
+    uint32_t position = 0;
+    // Смещение начала буфера в файле - для границ токенов
+    uint64_t chunkOffset = 0;
+    if (storeTokenOffsets) {
+        worker.tokenOffsets.beginDocument(static_cast<uint32_t>(documentId));
     }
+    size_t carried = 0;
+    bool last = false;
+    while (!last) {
+        // Слово длиннее буфера: буфер растет, пока слово не поместится целиком
+        if (carried == chunk.size()) {
+            chunk.resize(chunk.size() * 2);
+        }
+        PhaseTimer readTimer(Phase::Read);
+        input.read(chunk.data() + carried, static_cast<std::streamsize>(chunk.size() - carried));
+        readTimer.stop();
+        if (input.bad()) {
+            std::cerr << "Error: Unable to read file " << filePath << std::endl;
+            if (storeTokenOffsets) {
+                worker.tokenOffsets.endDocument(); // длины у документа не будет, запись не читается
+            }
+            return false;
+        }
+        size_t count = static_cast<size_t>(input.gcount());
+        bytesRead += count;
+        hash = DocumentState::hashContent(std::string_view(chunk.data() + carried, count), hash);
+        size_t filled = carried + count;
+        last = input.eof();
+
+        size_t cut = filled;
+        if (!last) {
+            while (cut > 0 && !Tokenizer::isSpace(chunk[cut - 1])) {
+                --cut;
+            }
+            if (cut == 0) {
+                carried = filled;
+                continue;
+            }
+        }
+
+        PhaseTimer tokenizeTimer(Phase::Tokenize);
+        tokenizer.reset(std::string_view(chunk.data(), cut));
+        std::string_view word;
+        while (tokenizer.next(word)) {
+            // Id выдает общий словарь, поэтому он одинаков во всех потоках
+            occurrences.emplace_back(dictionary.intern(word), position++);
+            if (storeTokenOffsets) {
+                worker.tokenOffsets.addToken(chunkOffset + tokenizer.tokenBegin(), chunkOffset + tokenizer.tokenEnd());
+            }
+            if (occurrences.size() >= OCCURRENCE_LIMIT && !flush()) {
+                return false;
+            }
+        }
+        std::copy(chunk.begin() + cut, chunk.begin() + filled, chunk.begin());
+        carried = filled - cut;
+        chunkOffset += cut;
+    }
+    if (storeTokenOffsets) {
+        worker.tokenOffsets.endDocument();
+    }
+    if (!occurrences.empty() && !flush()) {
+        return false;
+    }
+    contentHash = hash;
+    worker.documentLengths.emplace_back(static_cast<uint32_t>(documentId), position);
+    Metrics& metrics = Metrics::global();
+    metrics.add(Counter::Documents, 1);
+    metrics.add(Counter::Tokens, position);
+    metrics.add(Counter::BytesRead, bytesRead);
+    return true;
 }
 
-// Метод создания позиционного индекса
-void InvertedIndex::createPositionalIndex(std::unordered_map<int, std::unordered_map<int, std::vector<int>>>& positionalIndex,
-                                          const std::unordered_map<std::string, int>& termIdMap,
-                                          const std::vector<std::string>& tokens,
-                                          int documentId) {
-    for (int i = 0; i < tokens.size(); ++i) {
-        const std::string& word = tokens[i];
-        int termId = termIdMap.at(word);
+// Перенос пар (терм, позиция) документа во вхождения потока
+void InvertedIndex::addOccurrences(WorkerPostings& worker, uint32_t documentId) {
+    auto& occurrences = worker.occurrences;
+    size_t postingCount = worker.postings.size();
+    // После сортировки вхождения терма идут подряд, а его позиции - по возрастанию
+    std::sort(occurrences.begin(), occurrences.end());
+    for (size_t i = 0; i < occurrences.size();) {
+        uint32_t termId = occurrences[i].first;
+        size_t end = i;
+        for (; end < occurrences.size() && occurrences[end].first == termId; ++end) {
+            worker.positions.push_back(occurrences[end].second);
+        }
+        worker.termIds.push_back(termId);
+        worker.postings.push_back({documentId, static_cast<uint32_t>(end - i)});
+        i = end;
+    }
+    occurrences.clear();
+    Metrics::global().add(Counter::Postings, worker.postings.size() - postingCount);
+}
 
-        positionalIndex[termId][documentId].push_back(i);  // Добавляем позицию
+// Строки термов по id; терм, которого нет в снимке словаря, остается пустым
+static std::vector<std::string_view> termsById(const TermDictionary& dictionary) {
+    std::vector<std::string_view> terms(dictionary.size() + 1);
+    for (const auto& [term, termId] : dictionary.terms()) {
+        if (termId >= terms.size()) {
+            terms.resize(termId + 1);
+        }
+        terms[termId] = term;
     }
+    return terms;
 }
 
-// Метод для построения индекса основной
-void InvertedIndex::createIndex(ConverterJSON& converter) {
-    SearchServer searchServer;
-    std::unordered_map<std::string, int> termIdMap;
-    int nextTermId = 1;  // Следующий ID для нового терма
+// Сброс вхождений потока на диск прогоном, сгруппированным по термам
+bool InvertedIndex::spillRun(WorkerPostings& worker) {
+    if (worker.termIds.empty()) {
+        return true;
+    }
+    PhaseTimer timer(Phase::Serialize);
+    size_t count = worker.termIds.size();
+    std::vector<uint64_t> positionStarts(count);
+    uint64_t positionStart = 0;
+    for (size_t i = 0; i < count; ++i) {
+        positionStarts[i] = positionStart;
+        positionStart += worker.postings[i].frequency;
+    }
+    // Вхождения раскладываются по термам подсчетом, внутри терма остается порядок чтения,
+    // по документам их упорядочит слияние
+    uint32_t idCount = *std::max_element(worker.termIds.begin(), worker.termIds.end()) + 1;
+    std::vector<uint32_t> starts(idCount + 1, 0);
+    for (uint32_t termId : worker.termIds) {
+        ++starts[termId + 1];
+    }
+    for (uint32_t termId = 0; termId < idCount; ++termId) {
+        starts[termId + 1] += starts[termId];
+    }
+    std::vector<uint32_t> order(count);
+    std::vector<uint32_t> next(starts.begin(), starts.end() - 1);
+    for (size_t i = 0; i < count; ++i) {
+        order[next[worker.termIds[i]]++] = static_cast<uint32_t>(i);
+    }
+    // Термы прогона по возрастанию строк
+    std::vector<std::string_view> terms = termsById(dictionary);
+    std::vector<uint32_t> runTerms;
+    for (uint32_t termId = 0; termId < idCount; ++termId) {
+        if (starts[termId + 1] > starts[termId]) {
+            runTerms.push_back(termId);
+        }
+    }
+    std::sort(runTerms.begin(), runTerms.end(), [&](uint32_t a, uint32_t b) {
+        return terms[a] < terms[b];
+    });
+
+    std::string path = worker.runPrefix + std::to_string(worker.runs.size());
+    std::ofstream runFile(path, std::ios::binary | std::ios::trunc);
+    if (!runFile.is_open()) {
+        std::cerr << "Error: Unable to write to index run " << path << std::endl;
+        return false;
+    }
+    // Вхождения терма собираются в буфер и пишутся одной записью
+    std::vector<uint32_t> block;
+    for (uint32_t termId : runTerms) {
+        block.clear();
+        for (size_t k = starts[termId]; k < starts[termId + 1]; ++k) {
+            const IndexPosting& posting = worker.postings[order[k]];
+            const uint32_t* source = worker.positions.data() + positionStarts[order[k]];
+            block.push_back(posting.documentId);
+            block.push_back(posting.frequency);
+            block.insert(block.end(), source, source + posting.frequency);
+        }
+        RunTerm term {termId, starts[termId + 1] - starts[termId], block.size()};
+        runFile.write(reinterpret_cast<const char*>(&term), sizeof(term));
+        runFile.write(reinterpret_cast<const char*>(block.data()),
+                      static_cast<std::streamsize>(block.size() * sizeof(uint32_t)));
+    }
+    Metrics::global().add(Counter::BytesWritten, static_cast<uint64_t>(runFile.tellp()));
+    runFile.close();
+    if (!runFile) {
+        std::cerr << "Error: Unable to write to index run " << path << std::endl;
+        std::error_code error;
+        fs::remove(path, error);
+        return false;
+    }
 
-    // Инвертированный и позиционный индексы
-    std::unordered_map<int, std::vector<std::pair<int, int>>> invertedIndex;
-    std::unordered_map<int, std::unordered_map<int, std::vector<int>>> positionalIndex;
+    worker.runs.push_back(path);
+    worker.termIds.clear();
+    worker.postings.clear();
+    worker.positions.clear();
+    return true;
+}
 
-    // Мапа для сопоставления документов и их ID
-    std::unordered_map<std::string, int> documentIdMap;
+// Слияние прогонов в сегмент: k-путевое слияние по строкам термов, каждый прогон читается подряд
+bool InvertedIndex::mergeRuns(const std::vector<std::string>& runs, const std::string& path,
+                              const std::vector<uint32_t>& deletedDocuments, std::vector<uint32_t> documentLengths,
+                              TokenOffsets tokenOffsets) {
+    PhaseTimer timer(Phase::Merge);
+    struct RunReader {
+        std::ifstream file;
+        RunTerm term {};
+    };
+    std::vector<RunReader> readers(runs.size());
+    // Заголовок следующего терма; конец файла ровно на границе терма - конец прогона
+    auto readTerm = [](RunReader& reader) {
+        reader.file.read(reinterpret_cast<char*>(&reader.term), sizeof(RunTerm));
+        return static_cast<bool>(reader.file);
+    };
+    auto runFailed = [&](size_t r) {
+        std::cerr << "Error: Unable to read index run " << runs[r] << std::endl;
+        return false;
+    };
+
+    std::vector<std::string_view> terms = termsById(dictionary);
+    // Куча прогонов по строке текущего терма, при равных строках - по номеру прогона
+    auto after = [&](size_t a, size_t b) {
+        std::string_view termA = terms[readers[a].term.termId];
+        std::string_view termB = terms[readers[b].term.termId];
+        return termA != termB ? termA > termB : a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heap(after);
+    for (size_t r = 0; r < runs.size(); ++r) {
+        readers[r].file.open(runs[r], std::ios::binary);
+        if (!readers[r].file.is_open()) {
+            return runFailed(r);
+        }
+        if (readTerm(readers[r])) {
+            heap.push(r);
+        }
+    }
+
+    struct RunPosting {
+        IndexPosting posting;
+        size_t positionsStart;
+    };
+    std::vector<RunPosting> gathered;
+    // Вхождения терма из всех прогонов подряд, как они записаны в прогонах
+    std::vector<uint32_t> gatheredWords;
+    std::vector<IndexPosting> documents;
+    std::vector<uint32_t> positions;
+    SegmentWriter writer(path, codec, analyzer->fingerprint());
+    writer.setDocumentLengths(std::move(documentLengths));
+    writer.setTokenOffsets(std::move(tokenOffsets));
+    while (!heap.empty()) {
+        // Прогоны с текущим термом выходят из кучи по возрастанию номеров,
+        // а прогоны потока пронумерованы в порядке записи
+        uint32_t termId = readers[heap.top()].term.termId;
+        gathered.clear();
+        gatheredWords.clear();
+        while (!heap.empty() && readers[heap.top()].term.termId == termId) {
+            size_t r = heap.top();
+            heap.pop();
+            RunReader& reader = readers[r];
+            size_t start = gatheredWords.size();
+            gatheredWords.resize(start + reader.term.wordCount);
+            reader.file.read(reinterpret_cast<char*>(gatheredWords.data() + start),
+                             static_cast<std::streamsize>(reader.term.wordCount * sizeof(uint32_t)));
+            if (!reader.file) {
+                return runFailed(r);
+            }
+            for (uint32_t i = 0; i < reader.term.postingCount; ++i) {
+                if (start + 2 > gatheredWords.size() || start + 2 + gatheredWords[start + 1] > gatheredWords.size()) {
+                    return runFailed(r);
+                }
+                gathered.push_back({{gatheredWords[start], gatheredWords[start + 1]}, start + 2});
+                start += 2 + gatheredWords[start + 1];
+            }
+            if (readTerm(reader)) {
+                heap.push(r);
+            } else if (reader.file.gcount() != 0) {
+                return runFailed(r);
+            }
+        }
 
-    // Загружаем document_id из config.json
-    std::ifstream configFile("../config.json");
-    if (configFile.is_open()) {
-        json configJson;
-        configFile >> configJson;
-        for (const auto& [filePath, docID] : configJson["document_id"].items()) {
-            documentIdMap[filePath] = docID.get<int>();
+        // Устойчивая сортировка: части документа склеиваются в порядке чтения
+        std::stable_sort(gathered.begin(), gathered.end(), [](const RunPosting& a, const RunPosting& b) {
+            return a.posting.documentId < b.posting.documentId;
+        });
+        documents.clear();
+        positions.clear();
+        for (const RunPosting& item : gathered) {
+            if (!documents.empty() && documents.back().documentId == item.posting.documentId) {
+                documents.back().frequency += item.posting.frequency;
+            } else {
+                documents.push_back(item.posting);
+            }
+            const uint32_t* source = gatheredWords.data() + item.positionsStart;
+            positions.insert(positions.end(), source, source + item.posting.frequency);
         }
-        configFile.close();
+        writer.addTerm(terms[termId], termId, documents.data(), documents.data() + documents.size(),
+                       positions.data());
     }
 
-    // Мьютексы для защиты общих данных
-    std::mutex termIdMapMutex;
-    std::mutex invertedIndexMutex;
-    std::mutex positionalIndexMutex;
+    writer.setDeletedDocuments(deletedDocuments);
+    return writer.finish();
+}
 
-    // Вектор потоков
-    std::vector<std::thread> threads;
+// Перенос вхождений всех потоков в общие массивы CSR
+void InvertedIndex::buildLayout(std::vector<WorkerPostings>& workerPostings, IndexData& index) {
+    PhaseTimer timer(Phase::Merge);
+    uint32_t idCount = static_cast<uint32_t>(dictionary.size()) + 1;
 
-    // Обработка каждого файла в отдельном потоке
-    for (const auto& filePath : converter.GetTextDocuments()) {
-        threads.emplace_back([&, filePath]() {
-            std::ifstream inputFile(filePath);
-            if (!inputFile.is_open()) {
-                std::cerr << "Error: Unable to open file " << filePath << std::endl;
-                return;
+    // Строки термов подряд в порядке id
+    std::vector<std::string_view> termsById(idCount);
+    for (const auto& [term, termId] : dictionary.terms()) {
+        termsById[termId] = term;
+    }
+    index.termTextOffsets.reserve(idCount + 1);
+    for (std::string_view term : termsById) {
+        index.termTextOffsets.push_back(static_cast<uint32_t>(index.termText.size()));
+        index.termText.append(term);
+    }
+    index.termTextOffsets.push_back(static_cast<uint32_t>(index.termText.size()));
+
+    // Смещения списков и позиций по числу вхождений и сумме частот каждого терма
+    index.postingOffsets.assign(idCount + 1, 0);
+    index.positionOffsets.assign(idCount + 1, 0);
+    for (const auto& worker : workerPostings) {
+        for (size_t i = 0; i < worker.termIds.size(); ++i) {
+            ++index.postingOffsets[worker.termIds[i] + 1];
+            index.positionOffsets[worker.termIds[i] + 1] += worker.postings[i].frequency;
+        }
+    }
+    for (uint32_t termId = 0; termId < idCount; ++termId) {
+        index.postingOffsets[termId + 1] += index.postingOffsets[termId];
+        index.positionOffsets[termId + 1] += index.positionOffsets[termId];
+    }
+
+    // Раскладка вхождений по термам со ссылкой на их позиции в массиве потока:
+    // номер потока в старших 16 битах source, начало позиций - в младших 48
+    struct BuildPosting {
+        IndexPosting posting;
+        uint64_t source;
+    };
+    constexpr int SOURCE_SHIFT = 48;
+    constexpr uint64_t SOURCE_MASK = (uint64_t(1) << SOURCE_SHIFT) - 1;
+    std::vector<BuildPosting> build(index.postingOffsets.back());
+    std::vector<uint32_t> next(index.postingOffsets.begin(), index.postingOffsets.end() - 1);
+    bool split = false;
+    for (uint32_t w = 0; w < workerPostings.size(); ++w) {
+        WorkerPostings& worker = workerPostings[w];
+        uint64_t positionStart = 0;
+        for (size_t i = 0; i < worker.termIds.size(); ++i) {
+            build[next[worker.termIds[i]]++] = {worker.postings[i], (uint64_t(w) << SOURCE_SHIFT) | positionStart};
+            positionStart += worker.postings[i].frequency;
+        }
+        split |= worker.split;
+        index.tokenOffsets.append(worker.tokenOffsets);
+        worker.termIds = {};
+        worker.postings = {};
+        worker.occurrences = {};
+        worker.chunk = {};
+        worker.tokenOffsets = {};
+    }
+
+    // Списки сортируются по документам и копируются вместе с позициями, порции id не пересекаются.
+    // Части большого документа идут подряд в порядке чтения и склеиваются в одно вхождение
+    index.postings.resize(build.size());
+    index.positions.resize(index.positionOffsets.back());
+    std::vector<uint32_t> postingCounts(split ? idCount : 0);
+    runParallel(TERM_CHUNKS, getThreadCount(), [&](size_t chunk, unsigned) {
+        uint32_t first = static_cast<uint32_t>(uint64_t(idCount) * chunk / TERM_CHUNKS);
+        uint32_t last = static_cast<uint32_t>(uint64_t(idCount) * (chunk + 1) / TERM_CHUNKS);
+        for (uint32_t termId = first; termId < last; ++termId) {
+            auto begin = build.begin() + index.postingOffsets[termId];
+            auto end = build.begin() + index.postingOffsets[termId + 1];
+            std::sort(begin, end, [](const BuildPosting& a, const BuildPosting& b) {
+                if (a.posting.documentId != b.posting.documentId) {
+                    return a.posting.documentId < b.posting.documentId;
+                }
+                return a.source < b.source;
+            });
+            IndexPosting* postings = index.postings.data() + index.postingOffsets[termId];
+            IndexPosting* written = postings;
+            uint32_t* output = index.positions.data() + index.positionOffsets[termId];
+            for (auto it = begin; it != end; ++it) {
+                if (written != postings && written[-1].documentId == it->posting.documentId) {
+                    written[-1].frequency += it->posting.frequency;
+                } else {
+                    *written++ = it->posting;
+                }
+                const uint32_t* source = workerPostings[it->source >> SOURCE_SHIFT].positions.data() +
+                                         (it->source & SOURCE_MASK);
+                output = std::copy(source, source + it->posting.frequency, output);
+            }
+            if (split) {
+                postingCounts[termId] = static_cast<uint32_t>(written - postings);
             }
+        }
+    });
+
+    // После склейки списки стали короче и сдвигаются вплотную, позиции остаются на месте
+    if (split) {
+        uint32_t offset = 0;
+        for (uint32_t termId = 0; termId < idCount; ++termId) {
+            auto begin = index.postings.begin() + index.postingOffsets[termId];
+            std::copy(begin, begin + postingCounts[termId], index.postings.begin() + offset);
+            index.postingOffsets[termId] = offset;
+            offset += postingCounts[termId];
+        }
+        index.postingOffsets[idCount] = offset;
+        index.postings.resize(offset);
+    }
+}
 
-            std::string content((std::istreambuf_iterator<char>(inputFile)),
-                                (std::istreambuf_iterator<char>()));
-            inputFile.close();
+// Сбор вхождений всех файлов по потокам, хеши содержимого - в порядке списка файлов
+bool InvertedIndex::collectPostings(const std::vector<std::string>& files,
+                                    const std::unordered_map<std::string, int>& documentIdMap,
+                                    std::vector<WorkerPostings>& workerPostings,
+                                    std::vector<uint64_t>& contentHashes) {
+    // Токенизатор у каждого потока свой, его буфер переиспользуется между документами
+    std::vector<Tokenizer> tokenizers(workerPostings.size(), Tokenizer(*analyzer));
+    contentHashes.assign(files.size(), 0);
+
+    runParallel(files.size(), static_cast<unsigned>(workerPostings.size()), [&](size_t fileIndex, unsigned worker) {
+        // После ошибки записи прогона поток больше не берет документы
+        if (workerPostings[worker].failed) {
+            return;
+        }
+        const std::string& filePath = files[fileIndex];
+        auto documentIt = documentIdMap.find(filePath);
+        if (documentIt == documentIdMap.end()) {
+            std::cerr << "Error: No document_id for file " << filePath << std::endl;
+            return;
+        }
+        indexDocument(workerPostings[worker], tokenizers[worker], filePath, documentIt->second,
+                      contentHashes[fileIndex]);
+    });
 
-            // Токенизация текста
-            std::vector<std::string> tokens = searchServer.tokenize(content);
+    for (const auto& worker : workerPostings) {
+        if (worker.failed) {
+            return false;
+        }
+    }
+    return true;
+}
 
-            // Приведение к нижнему регистру
-            searchServer.toLowercase(tokens);
+// Метод построения индекса в памяти
+IndexData InvertedIndex::buildIndex(const std::vector<std::string>& files,
+                                    const std::unordered_map<std::string, int>& documentIdMap) {
+    dictionary.clear();
+    // У каждого потока свои массивы вхождений, запись в них идет без блокировок
+    std::vector<WorkerPostings> workerPostings(workerCount(files.size()));
+    IndexData index;
+    collectPostings(files, documentIdMap, workerPostings, index.contentHashes);
+    buildLayout(workerPostings, index);
+    return index;
+}
 
-            // Удаление стоп-слов
-            searchServer.removeStopWords(tokens);
+// Размер записанного сегмента в счетчик записанных байт
+static void addWrittenBytes(const std::string& path, bool written) {
+    std::error_code error;
+    uintmax_t size = written ? fs::file_size(path, error) : 0;
+    if (!error) {
+        Metrics::global().add(Counter::BytesWritten, size);
+    }
+}
 
-            // Получение document_id
-            int documentId = documentIdMap[filePath];
+// Метод построения и записи сегмента с ограничением памяти
+bool InvertedIndex::writeIndex(const std::vector<std::string>& files,
+                               const std::unordered_map<std::string, int>& documentIdMap,
+                               const std::string& path, const std::vector<uint32_t>& deletedDocuments,
+                               size_t memoryLimit, std::vector<uint64_t>& contentHashes) {
+    dictionary.clear();
+    unsigned workers = workerCount(files.size());
+    std::vector<WorkerPostings> workerPostings(workers);
+    for (unsigned w = 0; w < workers; ++w) {
+        workerPostings[w].memoryLimit = memoryLimit > 0 ? std::max<size_t>(1, memoryLimit / workers) : 0;
+        workerPostings[w].runPrefix = path + ".run" + std::to_string(w) + ".";
+    }
+    bool written = collectPostings(files, documentIdMap, workerPostings, contentHashes);
 
-            // Локальные структуры данных для текущего потока
-            std::unordered_map<std::string, int> localTermIdMap;
-            std::unordered_map<int, std::vector<std::pair<int, int>>> localInvertedIndex;
-            std::unordered_map<int, std::unordered_map<int, std::vector<int>>> localPositionalIndex;
+    bool spilled = false;
+    for (const auto& worker : workerPostings) {
+        spilled |= !worker.runs.empty();
+    }
+    // Все уместилось в память: раскладка CSR и запись сегмента, как без ограничения
+    if (written && !spilled) {
+        IndexData index;
+        buildLayout(workerPostings, index);
+        PhaseTimer timer(Phase::Serialize);
+        written = IndexSegment::write(path, index, deletedDocuments, codec, analyzer->fingerprint());
+        timer.stop();
+        addWrittenBytes(path, written);
+        return written;
+    }
 
-            // Индексация токенов
-            int localNextTermId = nextTermId;
-            indexTokens(localTermIdMap, tokens, localNextTermId);
+    // Остаток в памяти тоже уходит в прогоны, и все прогоны сливаются одним проходом
+    std::vector<std::string> runs;
+    std::vector<uint32_t> lengths;
+    TokenOffsets tokenOffsets;
+    for (auto& worker : workerPostings) {
+        written = written && spillRun(worker);
+        runs.insert(runs.end(), worker.runs.begin(), worker.runs.end());
+        tokenOffsets.append(worker.tokenOffsets);
+        for (const auto& [documentId, length] : worker.documentLengths) {
+            if (documentId >= lengths.size()) {
+                lengths.resize(documentId + 1, 0);
+            }
+            lengths[documentId] = length;
+        }
+    }
+    written = written && mergeRuns(runs, path, deletedDocuments, std::move(lengths), std::move(tokenOffsets));
+    std::error_code error;
+    for (const auto& run : runs) {
+        fs::remove(run, error);
+    }
+    addWrittenBytes(path, written);
+    return written;
+}
 
-            // Создание локального инвертированного индекса
-            createInvertedIndex(localInvertedIndex, localTermIdMap, tokens, documentId);
+// Метод для построения индекса основной
+void InvertedIndex::createIndex(ConverterJSON& converter) {
+    waitForMerge();
+    codec = converter.getIndexCodec();
+    analyzer = converter.getAnalyzer();
+    storeTokenOffsets = converter.getSnippets();
 
-            // Создание локального позиционного индекса
-            createPositionalIndex(localPositionalIndex, localTermIdMap, tokens, documentId);
+    // Мапа для сопоставления документов и их ID
+    const std::unordered_map<std::string, int>& documentIdMap = converter.getDocumentIds();
+    std::vector<std::string> files = converter.GetTextDocuments();
+
+    // Новое поколение пишется рядом с опубликованным и не трогает его файлы
+    IndexManifest published;
+    published.load(INDEX_MANIFEST_PATH);
+    uint64_t generation = published.generation() + 1;
+    std::string mainPath = IndexManifest::segmentPath(generation);
+
+    // Сохранение индекса в бинарный сегмент index.<N>.bin
+    std::vector<uint64_t> contentHashes;
+    if (!writeIndex(files, documentIdMap, mainPath, {}, converter.getIndexMemoryLimit(), contentHashes)) {
+        return;
+    }
 
-            // Слияние локальных данных с глобальными
-            {
-                std::lock_guard<std::mutex> lock(termIdMapMutex);
-                for (const auto& [term, id] : localTermIdMap) {
-                    if (termIdMap.find(term) == termIdMap.end()) {
-                        termIdMap[term] = nextTermId++;
-                    }
-                }
-            }
+    // Состояние документов для последующих инкрементальных обновлений
+    DocumentState state;
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto documentIt = documentIdMap.find(files[i]);
+        std::error_code error;
+        DocumentRecord record;
+        record.size = fs::file_size(files[i], error);
+        record.modified = fs::last_write_time(files[i], error).time_since_epoch().count();
+        if (documentIt == documentIdMap.end() || error) {
+            continue;
+        }
+        record.documentId = static_cast<uint32_t>(documentIt->second);
+        record.segment = DocumentSegment::Main;
+        record.contentHash = contentHashes[i];
+        state.documents()[files[i]] = record;
+    }
+    std::string statePath = IndexManifest::statePath(generation);
+    if (state.save(statePath)) {
+        publishGeneration(generation, mainPath, "", statePath);
+    }
+}
 
-            {
-                std::lock_guard<std::mutex> lock(invertedIndexMutex);
-                for (const auto& [termId, docList] : localInvertedIndex) {
-                    invertedIndex[termId].insert(invertedIndex[termId].end(), docList.begin(), docList.end());
-                }
-            }
+// Метод инкрементального обновления индекса
+void InvertedIndex::updateIndex(ConverterJSON& converter) {
+    waitForMerge();
+    // Дельта и следующее слияние пишутся кодеком из config, старый сегмент читается своим
+    codec = converter.getIndexCodec();
+    analyzer = converter.getAnalyzer();
+    storeTokenOffsets = converter.getSnippets();
+
+    IndexManifest published;
+    DocumentState state;
+    if (!published.load(INDEX_MANIFEST_PATH) || !state.load(published.state().path)) {
+        createIndex(converter);
+        return;
+    }
+    uint64_t generation = published.generation() + 1;
+    std::string statePath = IndexManifest::statePath(generation);
 
-            {
-                std::lock_guard<std::mutex> lock(positionalIndexMutex);
-                for (const auto& [termId, docPositions] : localPositionalIndex) {
-                    for (const auto& [docId, positions] : docPositions) {
-                        positionalIndex[termId][docId].insert(
-                                positionalIndex[termId][docId].end(),
-                                positions.begin(),
-                                positions.end()
-                        );
-                    }
-                }
+    const std::unordered_map<std::string, int>& documentIdMap = converter.getDocumentIds();
+    auto& records = state.documents();
+    std::vector<std::string> changedFiles;
+    std::unordered_map<std::string, DocumentRecord> changedRecords;
+    std::unordered_set<std::string> presentFiles;
+    bool stateChanged = false;
+
+    // Сравниваем размер и время изменения, хеш считаем только при расхождении
+    for (const auto& filePath : converter.GetTextDocuments()) {
+        auto documentIt = documentIdMap.find(filePath);
+        std::error_code error;
+        DocumentRecord current;
+        current.size = fs::file_size(filePath, error);
+        current.modified = fs::last_write_time(filePath, error).time_since_epoch().count();
+        if (documentIt == documentIdMap.end() || error) {
+            continue;
+        }
+        current.documentId = static_cast<uint32_t>(documentIt->second);
+        current.segment = DocumentSegment::Delta;
+        presentFiles.insert(filePath);
+
+        auto recordIt = records.find(filePath);
+        if (recordIt != records.end()) {
+            DocumentRecord& record = recordIt->second;
+            bool sameDocument = record.documentId == current.documentId && record.size == current.size;
+            if (sameDocument && record.modified == current.modified) {
+                continue;
             }
-        });
+            // Время изменилось, но содержимое могло остаться прежним
+            if (sameDocument && hashFile(filePath) == record.contentHash) {
+                record.modified = current.modified;
+                stateChanged = true;
+                continue;
+            }
+        }
+        changedFiles.push_back(filePath);
+        changedRecords[filePath] = current;
     }
 
-    // Ожидание завершения всех потоков
-    for (auto& thread : threads) {
-        if (thread.joinable()) {
-            thread.join();
+    // Удаленные и измененные документы скрываются в основном сегменте
+    bool deltaChanged = !changedFiles.empty();
+    for (auto it = records.begin(); it != records.end();) {
+        bool removed = presentFiles.count(it->first) == 0;
+        bool changed = changedRecords.count(it->first) != 0;
+        if ((removed || changed) && it->second.segment == DocumentSegment::Main) {
+            state.deletedFromMain().push_back(it->second.documentId);
+        }
+        if (removed) {
+            it = records.erase(it);
+            deltaChanged = true;
+        } else {
+            ++it;
+        }
+    }
+
+    // Изменились только времена файлов: сегменты остаются прежними
+    if (!deltaChanged) {
+        if (stateChanged && state.save(statePath)) {
+            publishGeneration(generation, published.main().path, published.delta().path, statePath);
+        }
+        return;
+    }
+
+    // Дельта пересобирается из новых изменений и документов, которые в ней уже были
+    std::vector<std::string> deltaFiles = changedFiles;
+    for (const auto& [filePath, record] : records) {
+        if (record.segment == DocumentSegment::Delta && changedRecords.count(filePath) == 0) {
+            deltaFiles.push_back(filePath);
+        }
+    }
+
+    std::vector<uint64_t> contentHashes;
+    std::string deltaPath = IndexManifest::deltaPath(generation);
+    if (!writeIndex(deltaFiles, documentIdMap, deltaPath, state.deletedFromMain(),
+                    converter.getIndexMemoryLimit(), contentHashes)) {
+        return;
+    }
+
+    for (size_t i = 0; i < changedFiles.size(); ++i) {
+        DocumentRecord& record = changedRecords[changedFiles[i]];
+        record.contentHash = contentHashes[i];
+        records[changedFiles[i]] = record;
+    }
+    if (!state.save(statePath) || !publishGeneration(generation, published.main().path, deltaPath, statePath)) {
+        return;
+    }
+
+    if (state.deltaDocumentCount() * MERGE_RATIO >= records.size()) {
+        startMerge();
+    }
+}
+
+void InvertedIndex::startMerge() {
+    mergeTask = std::async(std::launch::async, [this]() {
+        mergeDelta();
+    });
+}
+
+void InvertedIndex::waitForMerge() {
+    if (mergeTask.valid()) {
+        mergeTask.get();
+    }
+}
+
+// Слияние дельты с основным сегментом, выполняется в фоне
+void InvertedIndex::mergeDelta() {
+    IndexManifest published;
+    if (!published.load(INDEX_MANIFEST_PATH) || !published.hasDelta()) {
+        return;
+    }
+    uint64_t generation = published.generation() + 1;
+    std::string mergedPath = IndexManifest::segmentPath(generation);
+    {
+        IndexSegment base;
+        IndexSegment delta;
+        if (!base.open(published.main().path) || !delta.open(published.delta().path)) {
+            return;
         }
+        PhaseTimer timer(Phase::Merge);
+        if (!IndexSegment::merge(base, delta, mergedPath, codec)) {
+            fs::remove(mergedPath);
+            return;
+        }
+        timer.stop();
+        addWrittenBytes(mergedPath, true);
     }
 
-    // Сохранение индексов (основной, инвертированный, позиционный)
-    converter.saveIndex(termIdMap, invertedIndex, positionalIndex);
+    DocumentState state;
+    if (!state.load(published.state().path)) {
+        return;
+    }
+    for (auto& [filePath, record] : state.documents()) {
+        record.segment = DocumentSegment::Main;
+    }
+    state.deletedFromMain().clear();
+    // Читатели, открывшие старые сегменты, продолжают работать с ними до закрытия
+    std::string statePath = IndexManifest::statePath(generation);
+    if (state.save(statePath)) {
+        publishGeneration(generation, mergedPath, "", statePath);
+    }
 }
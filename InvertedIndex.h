@@ -10,32 +10,120 @@
 #include <chrono>
 #include <ctime>
 #include <filesystem>
+#include <future>
 #include <nlohmann/json.hpp>
 #include "ConverterJSON.h"
+#include "IndexData.h"
+#include "TermDictionary.h"
+#include "DocumentState.h"
+#include "Tokenizer.h"
+#include "Analyzer.h"
+#include "PostingCodec.h"
 
 namespace fs = std::filesystem;
 
+// Вхождения, собранные одним потоком, в порядке обработки документов
+struct WorkerPostings {
+    std::vector<uint32_t> termIds;
+    std::vector<IndexPosting> postings;
+    // Позиции вхождений подряд, по frequency штук на вхождение
+    std::vector<uint32_t> positions;
+    // Пары (терм, позиция) текущего документа, буфер переиспользуется
+    std::vector<std::pair<uint32_t, uint32_t>> occurrences;
+    // Буфер чтения документа порциями
+    std::string chunk;
+    // Большой документ дает несколько вхождений одного терма, их надо склеить
+    bool split = false;
+    // Пары (документ, длина в токенах) обработанных документов
+    std::vector<std::pair<uint32_t, uint32_t>> documentLengths;
+    // Границы токенов обработанных документов; на диск прогонами не сбрасываются,
+    // их запись в несколько раз короче вхождений
+    TokenOffsets tokenOffsets;
+
+    // Доля памяти потока, при превышении вхождения уходят на диск (0 - без ограничения)
+    size_t memoryLimit = 0;
+    // Начало имени файлов прогонов и уже записанные прогоны по порядку
+    std::string runPrefix;
+    std::vector<std::string> runs;
+    bool failed = false;
+
+    // Байты, занятые накопленными вхождениями
+    size_t memoryUsage() const {
+        return termIds.size() * sizeof(uint32_t) + postings.size() * sizeof(IndexPosting) +
+               positions.size() * sizeof(uint32_t);
+    }
+};
+
 class InvertedIndex {
 private:
+    // Списки термов раскладываются по CSR параллельно, порциями id
+    static constexpr size_t TERM_CHUNKS = 256;
+    // Документ читается порциями такого размера
+    static constexpr size_t READ_CHUNK = 1 << 20;
+    // Столько пар (терм, позиция) документа копится до переноса во вхождения
+    static constexpr size_t OCCURRENCE_LIMIT = 1 << 20;
+    // Дельта сливается с основным сегментом, когда в ней больше 1/MERGE_RATIO документов
+    static constexpr size_t MERGE_RATIO = 10;
+    unsigned threadCount = 0;
+    // Кодек записываемых сегментов
+    CodecType codec = DEFAULT_CODEC;
+    // Хранить в сегментах байтовые границы токенов для сниппетов
+    bool storeTokenOffsets = false;
+    // Нормализация текста документов, ее отпечаток пишется в сегменты
+    std::shared_ptr<const Analyzer> analyzer = Analyzer::standard();
+    // Общий для всех потоков словарь термов
+    TermDictionary dictionary;
+    // Фоновое слияние дельты с основным сегментом
+    std::future<void> mergeTask;
+    // Контрольные суммы файлов из манифеста сверяются один раз за процесс
+    bool manifestVerified = false;
 
 public:
     InvertedIndex()=default;
+    ~InvertedIndex();
     // Метод для создания/обновления базы индекса токенов
     void manageIndex(ConverterJSON& converter);
     // Метод для построения индекса
     void createIndex(ConverterJSON& converter);
+    // Переиндексация только добавленных, измененных и удаленных файлов
+    void updateIndex(ConverterJSON& converter);
+    // Ожидание завершения фонового слияния
+    void waitForMerge();
+    // Построение индекса по списку файлов без записи на диск
+    IndexData buildIndex(const std::vector<std::string>& files,
+                         const std::unordered_map<std::string, int>& documentIdMap);
+    // Построение и запись сегмента; вхождения сверх memoryLimit байт сбрасываются
+    // на диск прогонами, отсортированными по термам, и прогоны сливаются в сегмент (SPIMI)
+    bool writeIndex(const std::vector<std::string>& files,
+                    const std::unordered_map<std::string, int>& documentIdMap,
+                    const std::string& path, const std::vector<uint32_t>& deletedDocuments,
+                    size_t memoryLimit, std::vector<uint64_t>& contentHashes);
+    // Количество рабочих потоков (0 - по числу ядер)
+    void setThreadCount(unsigned count);
+    unsigned getThreadCount() const;
+    // Кодек списков и позиций в новых сегментах, createIndex и updateIndex берут его из config
+    void setCodec(CodecType type) { codec = type; }
+    // Analyzer документов, createIndex и updateIndex берут его из config
+    void setAnalyzer(std::shared_ptr<const Analyzer> settings) { analyzer = std::move(settings); }
+    // Границы токенов в новых сегментах, createIndex и updateIndex берут настройку из config
+    void setTokenOffsets(bool enabled) { storeTokenOffsets = enabled; }
 
 private:
     //вспомогательные методы построения индекса
-    void indexTokens(std::unordered_map<std::string, int>& termIdMap, std::vector<std::string>& tokens, int& nextTermId);
-    void createInvertedIndex(std::unordered_map<int, std::vector<std::pair<int, int>>>& invertedIndex,
-                             const std::unordered_map<std::string, int>& termIdMap,
-                             const std::vector<std::string>& tokens,
-                             int documentId);
-    void createPositionalIndex(std::unordered_map<int, std::unordered_map<int, std::vector<int>>>& positionalIndex,
-                               const std::unordered_map<std::string, int>& termIdMap,
-                               const std::vector<std::string>& tokens,
-                               int documentId);
+    unsigned workerCount(size_t fileCount) const;
+    bool collectPostings(const std::vector<std::string>& files,
+                         const std::unordered_map<std::string, int>& documentIdMap,
+                         std::vector<WorkerPostings>& workerPostings, std::vector<uint64_t>& contentHashes);
+    bool indexDocument(WorkerPostings& worker, Tokenizer& tokenizer, const std::string& filePath,
+                       int documentId, uint64_t& contentHash);
+    void addOccurrences(WorkerPostings& worker, uint32_t documentId);
+    bool spillRun(WorkerPostings& worker);
+    bool mergeRuns(const std::vector<std::string>& runs, const std::string& path,
+                   const std::vector<uint32_t>& deletedDocuments, std::vector<uint32_t> documentLengths,
+                   TokenOffsets tokenOffsets);
+    void buildLayout(std::vector<WorkerPostings>& workerPostings, IndexData& index);
+    void startMerge();
+    void mergeDelta();
 };
 
 #endif // INVERTEDINDEX_H
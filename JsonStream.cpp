@@ -0,0 +1,394 @@
+#include "JsonStream.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+bool RequestReader::open(const std::string& filePath, bool jsonLines) {
+    path = filePath;
+    position = 0;
+    lines = jsonLines;
+    started = false;
+    finished = false;
+    error = false;
+    if (!file.open(filePath)) {
+        return false;
+    }
+    text = file.view();
+    return true;
+}
+
+bool RequestReader::fail(const char* message) {
+    std::cerr << "Invalid " << path << ": " << message << " at byte " << position << "." << std::endl;
+    error = true;
+    finished = true;
+    return false;
+}
+
+void RequestReader::skipSpace() {
+    while (position < text.size() &&
+           (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r')) {
+        ++position;
+    }
+}
+
+bool RequestReader::consume(char expected) {
+    skipSpace();
+    if (position < text.size() && text[position] == expected) {
+        ++position;
+        return true;
+    }
+    return false;
+}
+
+// Код UTF-16 из четырех шестнадцатеричных цифр после \u
+static bool readHex(std::string_view text, size_t& position, uint32_t& code) {
+    if (position + 4 > text.size()) {
+        return false;
+    }
+    code = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        char c = text[position++];
+        code <<= 4;
+        if (c >= '0' && c <= '9') {
+            code |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            code |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            code |= c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void appendUtf8(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out.push_back(static_cast<char>(code));
+    } else if (code < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else if (code < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (code >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+    }
+}
+
+// Строка JSON с разбором escape-последовательностей, участки без них копируются целиком
+bool RequestReader::readString(std::string& value) {
+    value.clear();
+    if (!consume('"')) {
+        return fail("expected a string");
+    }
+    while (position < text.size()) {
+        size_t end = position;
+        while (end < text.size() && text[end] != '"' && text[end] != '\\') {
+            ++end;
+        }
+        value.append(text.data() + position, end - position);
+        position = end;
+        if (position >= text.size()) {
+            break;
+        }
+        if (text[position++] == '"') {
+            return true;
+        }
+        if (position >= text.size()) {
+            break;
+        }
+        char escape = text[position++];
+        switch (escape) {
+            case '"': value.push_back('"'); break;
+            case '\\': value.push_back('\\'); break;
+            case '/': value.push_back('/'); break;
+            case 'b': value.push_back('\b'); break;
+            case 'f': value.push_back('\f'); break;
+            case 'n': value.push_back('\n'); break;
+            case 'r': value.push_back('\r'); break;
+            case 't': value.push_back('\t'); break;
+            case 'u': {
+                uint32_t code = 0;
+                if (!readHex(text, position, code)) {
+                    return fail("bad \\u escape");
+                }
+                // Символ вне BMP записан суррогатной парой
+                if (code >= 0xD800 && code < 0xDC00 && text.substr(position, 2) == "\\u") {
+                    size_t low = position + 2;
+                    uint32_t second = 0;
+                    if (readHex(text, low, second) && second >= 0xDC00 && second < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (second - 0xDC00);
+                        position = low;
+                    }
+                }
+                appendUtf8(value, code);
+                break;
+            }
+            default:
+                return fail("bad escape");
+        }
+    }
+    return fail("unterminated string");
+}
+
+// Пропуск значения любого типа: вложенность считается по скобкам вне строк
+bool RequestReader::skipValue() {
+    skipSpace();
+    if (position >= text.size()) {
+        return fail("unexpected end of file");
+    }
+    if (text[position] == '"') {
+        return readString(scratch);
+    }
+    if (text[position] != '{' && text[position] != '[') {
+        while (position < text.size() && std::strchr(",}] \t\r\n", text[position]) == nullptr) {
+            ++position;
+        }
+        return true;
+    }
+    size_t depth = 0;
+    while (position < text.size()) {
+        char c = text[position];
+        if (c == '"') {
+            if (!readString(scratch)) {
+                return false;
+            }
+            continue;
+        }
+        ++position;
+        if (c == '{' || c == '[') {
+            ++depth;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+            return true;
+        }
+    }
+    return fail("unexpected end of file");
+}
+
+bool RequestReader::findKey(std::string_view name) {
+    if (consume('}')) {
+        return false;
+    }
+    while (true) {
+        if (!readString(scratch)) {
+            return false;
+        }
+        if (!consume(':')) {
+            return fail("expected ':'");
+        }
+        if (scratch == name) {
+            return true;
+        }
+        if (!skipValue()) {
+            return false;
+        }
+        if (consume('}')) {
+            return false;
+        }
+        if (!consume(',')) {
+            return fail("expected ',' or '}'");
+        }
+    }
+}
+
+bool RequestReader::finishObject() {
+    while (!consume('}')) {
+        if (!consume(',')) {
+            return fail("expected ',' or '}'");
+        }
+        if (!readString(scratch)) {
+            return false;
+        }
+        if (!consume(':')) {
+            return fail("expected ':'");
+        }
+        if (!skipValue()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool RequestReader::next(std::string& request) {
+    if (finished || !file.isOpen()) {
+        return false;
+    }
+
+    if (lines) {
+        skipSpace();
+        if (position >= text.size()) {
+            finished = true;
+            return false;
+        }
+        if (text[position] == '"') {
+            return readString(request);
+        }
+        if (!consume('{')) {
+            return fail("expected a string or an object");
+        }
+        if (!findKey("request")) {
+            return error ? false : fail("missing \"request\"");
+        }
+        skipSpace();
+        if (position >= text.size() || text[position] != '"') {
+            return fail("\"request\" must be a string");
+        }
+        return readString(request) && finishObject();
+    }
+
+    // Первый вызов доходит до начала массива "requests", остальные ключи не нужны
+    if (!started) {
+        started = true;
+        if (!consume('{')) {
+            return fail("expected an object");
+        }
+        if (!findKey("requests")) {
+            return error ? false : fail("missing \"requests\"");
+        }
+        if (!consume('[')) {
+            return fail("\"requests\" must be an array");
+        }
+        if (consume(']')) {
+            finished = true;
+            return false;
+        }
+    } else {
+        if (consume(']')) {
+            finished = true;
+            return false;
+        }
+        if (!consume(',')) {
+            return fail("expected ',' or ']'");
+        }
+    }
+    skipSpace();
+    if (position >= text.size() || text[position] != '"') {
+        return fail("every request must be a string");
+    }
+    return readString(request);
+}
+
+AnswersWriter::~AnswersWriter() {
+    if (opened) {
+        close();
+    }
+}
+
+bool AnswersWriter::open(const std::string& path) {
+    output.open(path, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) {
+        return false;
+    }
+    opened = true;
+    count = 0;
+    buffer = "{\n    \"Answers:\": {";
+    return true;
+}
+
+void AnswersWriter::flush() {
+    output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    buffer.clear();
+}
+
+void AnswersWriter::appendRank(std::string& out, float rank) {
+    double value = std::ceil(static_cast<double>(rank) * 1000) / 1000;
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    // Кратчайшая запись, которая читается обратно в то же число; у целых ".0", как у nlohmann
+    char digits[32];
+    char* end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    out.append(digits, end);
+    if (std::find_if(digits, end, [](char c) { return c == '.' || c == 'e'; }) == end) {
+        out += ".0";
+    }
+}
+
+void AnswersWriter::appendString(std::string& out, std::string_view text) {
+    static constexpr char HEX[] = "0123456789abcdef";
+    out += '"';
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    out += "\\u00";
+                    out += HEX[static_cast<unsigned char>(c) >> 4];
+                    out += HEX[c & 0xF];
+                } else {
+                    out += c;
+                }
+                break;
+        }
+    }
+    out += '"';
+}
+
+void AnswersWriter::add(const Answer& answer, const Snippets* snippets) {
+    buffer += count == 0 ? "\n" : ",\n";
+    buffer += "        \"request";
+    buffer += std::to_string(count++);
+    buffer += ":\": {\n";
+    if (answer.empty()) {
+        buffer += "            \"result:\": \"false\"\n        }";
+    } else {
+        buffer += "            \"relevance:\": [\n";
+        for (size_t i = 0; i < answer.size(); ++i) {
+            buffer += "                {\n                    \"docid:\": ";
+            buffer += std::to_string(answer[i].first);
+            buffer += ",\n                    \"rank:\": ";
+            appendRank(buffer, answer[i].second);
+            if (snippets != nullptr && i < snippets->size()) {
+                buffer += ",\n                    \"snippet:\": ";
+                appendString(buffer, (*snippets)[i]);
+            }
+            buffer += i + 1 < answer.size() ? "\n                },\n" : "\n                }\n";
+        }
+        buffer += "            ],\n            \"result:\": \"true\"\n        }";
+    }
+    if (buffer.size() >= FLUSH_SIZE) {
+        flush();
+    }
+}
+
+bool AnswersWriter::close() {
+    buffer += count == 0 ? "}\n}" : "\n    }\n}";
+    flush();
+    output.close();
+    opened = false;
+    return !output.fail();
+}
+
+void AnswersWriter::appendAnswer(std::string& out, const Answer& answer, const Snippets* snippets) {
+    if (answer.empty()) {
+        out += "{\"result:\":\"false\"}";
+        return;
+    }
+    out += "{\"relevance:\":[";
+    for (size_t i = 0; i < answer.size(); ++i) {
+        out += i == 0 ? "{\"docid:\":" : ",{\"docid:\":";
+        out += std::to_string(answer[i].first);
+        out += ",\"rank:\":";
+        appendRank(out, answer[i].second);
+        if (snippets != nullptr && i < snippets->size()) {
+            out += ",\"snippet:\":";
+            appendString(out, (*snippets)[i]);
+        }
+        out += '}';
+    }
+    out += "],\"result:\":\"true\"}";
+}
@@ -0,0 +1,96 @@
+#ifndef JSONSTREAM_H
+#define JSONSTREAM_H
+
+#pragma once
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "MappedFile.h"
+
+/*
+ Потоковое чтение запросов без построения дерева JSON.
+
+ Файл отображается в память и разбирается по мере вызовов next(), в памяти
+ держится только текущий запрос. Форматы:
+  - requests.json: объект с массивом строк "requests", остальные ключи
+    пропускаются;
+  - requests.jsonl: по запросу в строке - строка JSON или объект
+    с ключом "request".
+*/
+class RequestReader {
+private:
+    MappedFile file;
+    std::string_view text;
+    size_t position = 0;
+    bool lines = false;
+    bool started = false;
+    bool finished = false;
+    bool error = false;
+    std::string path;
+    std::string scratch;
+
+    void skipSpace();
+    bool consume(char expected);
+    bool readString(std::string& value);
+    bool skipValue();
+    // После '{': переход к значению ключа name, false - ключа нет или ошибка
+    bool findKey(std::string_view name);
+    // Пропуск оставшихся пар объекта до '}'
+    bool finishObject();
+    bool fail(const char* message);
+
+public:
+    // jsonLines = true - формат JSONL
+    bool open(const std::string& filePath, bool jsonLines);
+    // Следующий запрос, false - запросы кончились или файл испорчен
+    bool next(std::string& request);
+    bool failed() const { return error; }
+};
+
+/*
+ Потоковая запись answers.json: ответ сериализуется сразу из результатов
+ поиска и дописывается в буфер, буфер сбрасывается в файл частями.
+ Формат тот же, что у nlohmann::json::dump(4) для дерева
+ {"Answers:": {"requestN:": ...}}, ключи идут по номеру запроса.
+ Со сниппетами у документа есть еще ключ "snippet:".
+*/
+class AnswersWriter {
+public:
+    using Answer = std::vector<std::pair<int, float>>;
+    // Сниппеты документов ответа в том же порядке
+    using Snippets = std::vector<std::string>;
+
+private:
+    static constexpr size_t FLUSH_SIZE = 1 << 20;
+
+    std::ofstream output;
+    std::string buffer;
+    size_t count = 0;
+    bool opened = false;
+
+    void flush();
+
+public:
+    AnswersWriter() = default;
+    ~AnswersWriter();
+    AnswersWriter(const AnswersWriter&) = delete;
+    AnswersWriter& operator=(const AnswersWriter&) = delete;
+
+    bool open(const std::string& path);
+    // Ответ на следующий по порядку запрос; snippets - nullptr, если сниппеты не строятся
+    void add(const Answer& answer, const Snippets* snippets = nullptr);
+    // Закрывающие скобки и сброс на диск, false - ошибка записи
+    bool close();
+
+    // Ответ одной строкой, как nlohmann::json::dump() (для резидентного режима)
+    static void appendAnswer(std::string& out, const Answer& answer, const Snippets* snippets = nullptr);
+    // Ранг как в answers.json: округление вверх до тысячных
+    static void appendRank(std::string& out, float rank);
+    // Строка в кавычках с экранированием, как у nlohmann
+    static void appendString(std::string& out, std::string_view text);
+};
+
+#endif // JSONSTREAM_H
@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Файл, отображенный в память только для чтения
+class MappedFile {
+private:
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Пустой файл открывается успешно, но не отображается
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return opened; }
+
+    const uint8_t* bytes() const { return data; }
+    size_t size() const { return length; }
+    std::string_view view() const { return {reinterpret_cast<const char*>(data), length}; }
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,148 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <sstream>
+
+Metrics& Metrics::global() {
+    static Metrics metrics;
+    return metrics;
+}
+
+const char* Metrics::phaseName(Phase phase) {
+    static const char* names[] = {"scan", "read", "tokenize", "merge", "serialize", "load", "lookup", "score"};
+    return names[static_cast<size_t>(phase)];
+}
+
+const char* Metrics::counterName(Counter counter) {
+    static const char* names[] = {"documents", "tokens", "postings", "bytes_read", "bytes_written",
+                                  "cache_hits", "cache_misses", "cache_evictions"};
+    return names[static_cast<size_t>(counter)];
+}
+
+// Значения меньше 32 нс лежат каждое в своей корзине,
+// дальше у каждой степени двойки 16 корзин по старшим битам после ведущего
+size_t LatencyHistogram::bucketOf(uint64_t nanoseconds) {
+    if (nanoseconds < (uint64_t(2) << SUB_BITS)) {
+        return static_cast<size_t>(nanoseconds);
+    }
+    int highestBit = 0;
+    while (nanoseconds >> (highestBit + 1)) {
+        ++highestBit;
+    }
+    int shift = highestBit - SUB_BITS;
+    return (static_cast<size_t>(shift) + 1) << SUB_BITS |
+           static_cast<size_t>((nanoseconds >> shift) & ((1 << SUB_BITS) - 1));
+}
+
+uint64_t LatencyHistogram::lowerBound(size_t bucket) {
+    if (bucket < (size_t(2) << SUB_BITS)) {
+        return bucket;
+    }
+    int shift = static_cast<int>(bucket >> SUB_BITS) - 1;
+    uint64_t mantissa = (uint64_t(1) << SUB_BITS) | (bucket & ((1 << SUB_BITS) - 1));
+    return mantissa << shift;
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    counts[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+    uint64_t previous = highest.load(std::memory_order_relaxed);
+    while (previous < nanoseconds && !highest.compare_exchange_weak(previous, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (auto& count : counts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    highest.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::quantileSeconds(double q) const {
+    uint64_t recorded = count();
+    if (recorded == 0) {
+        return 0;
+    }
+    // Ранг квантиля среди записанных значений, считая с 1
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * recorded + 0.5));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        seen += counts[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t low = lowerBound(bucket);
+            uint64_t high = bucket + 1 < BUCKETS ? lowerBound(bucket + 1) : low;
+            return std::min((low + high) / 2e9, maxSeconds());
+        }
+    }
+    return maxSeconds();
+}
+
+void Metrics::reset() {
+    for (size_t i = 0; i < phaseNanoseconds.size(); ++i) {
+        phaseNanoseconds[i].store(0, std::memory_order_relaxed);
+        phaseCalls[i].store(0, std::memory_order_relaxed);
+    }
+    for (auto& counter : counters) {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    queryLatency.reset();
+}
+
+void Metrics::addPhase(Phase phase, uint64_t nanoseconds) {
+    if (enabled()) {
+        phaseNanoseconds[static_cast<size_t>(phase)].fetch_add(nanoseconds, std::memory_order_relaxed);
+        phaseCalls[static_cast<size_t>(phase)].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+nlohmann::json Metrics::toJson() const {
+    nlohmann::json result;
+    for (size_t i = 0; i < phaseNanoseconds.size(); ++i) {
+        result["phases"][phaseName(static_cast<Phase>(i))] = {
+                {"seconds", phaseNanoseconds[i].load(std::memory_order_relaxed) / 1e9},
+                {"calls", phaseCalls[i].load(std::memory_order_relaxed)}};
+    }
+    for (size_t i = 0; i < counters.size(); ++i) {
+        result["counters"][counterName(static_cast<Counter>(i))] = counters[i].load(std::memory_order_relaxed);
+    }
+    uint64_t queries = queryLatency.count();
+    result["queries"] = {
+            {"count", queries},
+            {"avg_ms", queries > 0 ? queryLatency.sumSeconds() * 1000 / queries : 0.0},
+            {"p50_ms", queryLatency.quantileSeconds(0.5) * 1000},
+            {"p99_ms", queryLatency.quantileSeconds(0.99) * 1000},
+            {"max_ms", queryLatency.maxSeconds() * 1000}};
+    return result;
+}
+
+std::string Metrics::toPrometheus() const {
+    std::ostringstream out;
+    out << "# HELP search_engine_phase_seconds_total Time spent in each phase, summed over threads.\n"
+        << "# TYPE search_engine_phase_seconds_total counter\n";
+    for (size_t i = 0; i < phaseNanoseconds.size(); ++i) {
+        out << "search_engine_phase_seconds_total{phase=\"" << phaseName(static_cast<Phase>(i)) << "\"} "
+            << phaseNanoseconds[i].load(std::memory_order_relaxed) / 1e9 << "\n";
+    }
+    out << "# HELP search_engine_phase_calls_total Number of timed sections of each phase.\n"
+        << "# TYPE search_engine_phase_calls_total counter\n";
+    for (size_t i = 0; i < phaseCalls.size(); ++i) {
+        out << "search_engine_phase_calls_total{phase=\"" << phaseName(static_cast<Phase>(i)) << "\"} "
+            << phaseCalls[i].load(std::memory_order_relaxed) << "\n";
+    }
+    for (size_t i = 0; i < counters.size(); ++i) {
+        std::string name = std::string("search_engine_") + counterName(static_cast<Counter>(i)) + "_total";
+        out << "# TYPE " << name << " counter\n"
+            << name << " " << counters[i].load(std::memory_order_relaxed) << "\n";
+    }
+    out << "# HELP search_engine_query_latency_seconds Latency of a single query.\n"
+        << "# TYPE search_engine_query_latency_seconds summary\n";
+    for (double q : {0.5, 0.99}) {
+        out << "search_engine_query_latency_seconds{quantile=\"" << q << "\"} "
+            << queryLatency.quantileSeconds(q) << "\n";
+    }
+    out << "search_engine_query_latency_seconds_sum " << queryLatency.sumSeconds() << "\n"
+        << "search_engine_query_latency_seconds_count " << queryLatency.count() << "\n";
+    return out.str();
+}
@@ -0,0 +1,140 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Фазы построения индекса и поиска
+enum class Phase {
+    Scan,       // обход каталога документов
+    Read,       // чтение файлов документов
+    Tokenize,   // разбор на слова и сбор вхождений
+    Merge,      // раскладка вхождений по термам и слияние прогонов и сегментов
+    Serialize,  // запись сегментов и прогонов на диск
+    Load,       // открытие снимка индекса
+    Lookup,     // поиск термов запроса в словарях сегментов
+    Score,      // обход списков и ранжирование
+    Count
+};
+
+enum class Counter {
+    Documents,
+    Tokens,
+    Postings,
+    BytesRead,
+    BytesWritten,
+    CacheHits,      // ответы, взятые из кэша запросов
+    CacheMisses,
+    CacheEvictions,
+    Count
+};
+
+/*
+ Гистограмма задержек на логарифмической шкале: 16 корзин на каждую степень
+ двойки наносекунд, ошибка квантиля не больше 1/32. Запись - один атомарный
+ инкремент, поэтому ее можно вести из любого числа потоков.
+*/
+class LatencyHistogram {
+private:
+    static constexpr int SUB_BITS = 4;
+    static constexpr size_t BUCKETS = 64 << SUB_BITS;
+    std::array<std::atomic<uint64_t>, BUCKETS> counts {};
+    std::atomic<uint64_t> total {0};
+    std::atomic<uint64_t> sum {0};
+    std::atomic<uint64_t> highest {0};
+
+    static size_t bucketOf(uint64_t nanoseconds);
+    static uint64_t lowerBound(size_t bucket);
+
+public:
+    void record(uint64_t nanoseconds);
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    double sumSeconds() const { return sum.load(std::memory_order_relaxed) / 1e9; }
+    double maxSeconds() const { return highest.load(std::memory_order_relaxed) / 1e9; }
+    // Середина корзины, в которую попал квантиль q (0..1), в секундах
+    double quantileSeconds(double q) const;
+};
+
+/*
+ Профилирование фаз и счетчики, общие на процесс.
+
+ Пока сбор выключен (по умолчанию), таймер фазы не читает часы, а счетчики
+ не пишутся - остается одна проверка флага. Время фаз суммируется по всем
+ потокам, поэтому при параллельной работе оно больше времени по часам.
+ Фазы могут вкладываться: сброс прогона (serialize) идет внутри tokenize.
+*/
+class Metrics {
+private:
+    std::atomic<bool> active {false};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Phase::Count)> phaseNanoseconds {};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Phase::Count)> phaseCalls {};
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::Count)> counters {};
+    LatencyHistogram queryLatency;
+
+    Metrics() = default;
+
+public:
+    static Metrics& global();
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    void setEnabled(bool enabled) { active.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return active.load(std::memory_order_relaxed); }
+    void reset();
+
+    void addPhase(Phase phase, uint64_t nanoseconds);
+    void add(Counter counter, uint64_t value) {
+        if (enabled()) {
+            counters[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+        }
+    }
+    // Время одного запроса от разбора до готового ответа
+    void recordQuery(uint64_t nanoseconds) {
+        if (enabled()) {
+            queryLatency.record(nanoseconds);
+        }
+    }
+
+    nlohmann::json toJson() const;
+    // Текстовый формат Prometheus (exposition format 0.0.4)
+    std::string toPrometheus() const;
+
+    static const char* phaseName(Phase phase);
+    static const char* counterName(Counter counter);
+};
+
+// Замер фазы от создания до stop() или выхода из области видимости
+class PhaseTimer {
+private:
+    Phase phase;
+    bool running;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit PhaseTimer(Phase phase) : phase(phase), running(Metrics::global().enabled()) {
+        if (running) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    ~PhaseTimer() { stop(); }
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    void stop() {
+        if (running) {
+            running = false;
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            Metrics::global().addPhase(phase, static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    }
+};
+
+#endif // METRICS_H
@@ -0,0 +1,330 @@
+#include "PostingCodec.h"
+#include <array>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define POSTING_CODEC_SSE2 1
+#endif
+// pshufb из SSSE3 нет в базовом x86-64: без -mssse3 функция собирается для SSSE3 отдельно
+// и выбирается при запуске, если процессор ее поддерживает
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define POSTING_CODEC_SSSE3 1
+#define POSTING_CODEC_TARGET_SSSE3
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define POSTING_CODEC_SSSE3 1
+#define POSTING_CODEC_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define POSTING_CODEC_SSSE3_DISPATCH 1
+#endif
+
+const IntegerCodec& IntegerCodec::get(CodecType type) {
+    static const VarintCodec varint;
+    static const GroupVarintCodec groupVarint;
+    static const PForCodec pfor;
+    switch (type) {
+        case CodecType::GroupVarint:
+            return groupVarint;
+        case CodecType::PFor:
+            return pfor;
+        default:
+            return varint;
+    }
+}
+
+bool IntegerCodec::parse(std::string_view name, CodecType& type) {
+    for (CodecType candidate : {CodecType::Varint, CodecType::GroupVarint, CodecType::PFor}) {
+        if (name == get(candidate).name()) {
+            type = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void VarintCodec::encode(const uint32_t* values, size_t count, std::string& out) const {
+    for (size_t i = 0; i < count; ++i) {
+        putVarint(out, values[i]);
+    }
+}
+
+const uint8_t* VarintCodec::decode(const uint8_t* data, size_t count, uint32_t* values) const {
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = getVarint(data);
+    }
+    return data;
+}
+
+namespace {
+
+// Число байт, которыми записывается число в Group Varint (1-4)
+size_t byteLength(uint32_t value) {
+    return value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : value < (1u << 24) ? 3 : 4;
+}
+
+// Для каждого управляющего байта: длина четверки и перестановка байт для pshufb
+// (0x80 - нулевой байт результата)
+struct GroupTables {
+    std::array<uint8_t, 256> lengths {};
+    std::array<std::array<uint8_t, 16>, 256> shuffles {};
+};
+
+constexpr GroupTables makeGroupTables() {
+    GroupTables tables {};
+    for (int control = 0; control < 256; ++control) {
+        uint8_t source = 0;
+        for (int value = 0; value < 4; ++value) {
+            int length = ((control >> (2 * value)) & 3) + 1;
+            for (int byte = 0; byte < 4; ++byte) {
+                tables.shuffles[control][value * 4 + byte] = byte < length ? source++ : 0x80;
+            }
+        }
+        tables.lengths[control] = source;
+    }
+    return tables;
+}
+
+constexpr GroupTables GROUP_TABLES = makeGroupTables();
+
+}
+
+void GroupVarintCodec::encode(const uint32_t* values, size_t count, std::string& out) const {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        uint8_t control = 0;
+        for (size_t k = 0; k < 4; ++k) {
+            control |= static_cast<uint8_t>((byteLength(values[i + k]) - 1) << (2 * k));
+        }
+        out.push_back(static_cast<char>(control));
+        for (size_t k = 0; k < 4; ++k) {
+            uint32_t value = values[i + k];
+            for (size_t byte = byteLength(value); byte > 0; --byte) {
+                out.push_back(static_cast<char>(value & 0xFF));
+                value >>= 8;
+            }
+        }
+    }
+    for (; i < count; ++i) {
+        putVarint(out, values[i]);
+    }
+}
+
+namespace {
+
+// Четверки по одному числу: 4 байта читаются разом и лишние отрезаются маской
+const uint8_t* decodeGroupsScalar(const uint8_t* data, size_t groups, uint32_t* values) {
+    static constexpr uint32_t MASKS[4] = {0xFF, 0xFFFF, 0xFFFFFF, 0xFFFFFFFF};
+    for (size_t group = 0; group < groups; ++group) {
+        uint8_t control = *data++;
+        for (size_t k = 0; k < 4; ++k) {
+            uint32_t length = (control >> (2 * k)) & 3;
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            *values++ = value & MASKS[length];
+            data += length + 1;
+        }
+    }
+    return data;
+}
+
+#ifdef POSTING_CODEC_SSSE3
+// Четверка за одну перестановку: читается 16 байт, из них берутся только байты четверки
+POSTING_CODEC_TARGET_SSSE3
+const uint8_t* decodeGroupsSsse3(const uint8_t* data, size_t groups, uint32_t* values) {
+    for (size_t group = 0; group < groups; ++group) {
+        uint8_t control = *data++;
+        __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(GROUP_TABLES.shuffles[control].data()));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + group * 4), _mm_shuffle_epi8(input, shuffle));
+        data += GROUP_TABLES.lengths[control];
+    }
+    return data;
+}
+#endif
+
+bool useSsse3() {
+#if defined(POSTING_CODEC_SSSE3_DISPATCH)
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+#elif defined(POSTING_CODEC_SSSE3)
+    return true;
+#else
+    return false;
+#endif
+}
+
+}
+
+const uint8_t* GroupVarintCodec::decode(const uint8_t* data, size_t count, uint32_t* values) const {
+    size_t groups = count / 4;
+#ifdef POSTING_CODEC_SSSE3
+    if (useSsse3()) {
+        data = decodeGroupsSsse3(data, groups, values);
+    } else {
+        data = decodeGroupsScalar(data, groups, values);
+    }
+#else
+    data = decodeGroupsScalar(data, groups, values);
+#endif
+    for (size_t i = groups * 4; i < count; ++i) {
+        values[i] = getVarint(data);
+    }
+    return data;
+}
+
+namespace {
+
+constexpr size_t LANES = 4;
+constexpr size_t LANE_VALUES = PForCodec::BLOCK / LANES;
+
+int bitWidth(uint32_t value) {
+    int width = 0;
+    while (value != 0) {
+        ++width;
+        value >>= 1;
+    }
+    return width;
+}
+
+size_t varintLength(int bits) {
+    return bits <= 7 ? 1 : static_cast<size_t>(bits + 6) / 7;
+}
+
+// Распаковка порции из 128 чисел по B бит: j-е число полосы занимает биты [j*B, (j+1)*B)
+// ее потока, k-е 32-битное слово полосы лежит в words[k * 4 + полоса]
+template <int B>
+void unpackBlock(const uint8_t* packed, uint32_t* values) {
+    if constexpr (B == 0) {
+        std::memset(values, 0, PForCodec::BLOCK * sizeof(uint32_t));
+    } else {
+#ifdef POSTING_CODEC_SSE2
+        const __m128i* words = reinterpret_cast<const __m128i*>(packed);
+        const __m128i mask = _mm_set1_epi32(static_cast<int>(B == 32 ? 0xFFFFFFFFu : (1u << (B % 32)) - 1));
+        for (int j = 0; j < static_cast<int>(LANE_VALUES); ++j) {
+            const int bit = j * B;
+            const int offset = bit % 32;
+            __m128i value = _mm_srli_epi32(_mm_loadu_si128(words + bit / 32), offset);
+            if (offset + B > 32) {
+                value = _mm_or_si128(value, _mm_slli_epi32(_mm_loadu_si128(words + bit / 32 + 1), 32 - offset));
+            }
+            if (B < 32) {
+                value = _mm_and_si128(value, mask);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(values + j * LANES), value);
+        }
+#else
+        uint32_t words[LANES * B];
+        std::memcpy(words, packed, sizeof(words));
+        const uint32_t mask = B == 32 ? 0xFFFFFFFFu : (1u << (B % 32)) - 1;
+        for (size_t j = 0; j < LANE_VALUES; ++j) {
+            const size_t bit = j * B;
+            const size_t offset = bit % 32;
+            for (size_t lane = 0; lane < LANES; ++lane) {
+                uint32_t value = words[bit / 32 * LANES + lane] >> offset;
+                if (offset + B > 32) {
+                    value |= words[(bit / 32 + 1) * LANES + lane] << (32 - offset);
+                }
+                values[j * LANES + lane] = value & mask;
+            }
+        }
+#endif
+    }
+}
+
+using BlockUnpacker = void (*)(const uint8_t*, uint32_t*);
+
+template <size_t... Widths>
+constexpr std::array<BlockUnpacker, sizeof...(Widths)> makeUnpackers(std::index_sequence<Widths...>) {
+    return {&unpackBlock<static_cast<int>(Widths)>...};
+}
+
+// Распаковщик для каждой ширины 0..32, ширина известна только при чтении порции
+constexpr std::array<BlockUnpacker, 33> UNPACKERS = makeUnpackers(std::make_index_sequence<33>());
+
+// Ширина упаковки, при которой порция с исключениями занимает меньше всего байт
+int chooseWidth(const uint32_t* values) {
+    std::array<size_t, 33> widthCounts {};
+    for (size_t i = 0; i < PForCodec::BLOCK; ++i) {
+        ++widthCounts[bitWidth(values[i])];
+    }
+    int best = 32;
+    size_t bestSize = LANES * 32 * sizeof(uint32_t);
+    for (int width = 0; width < 32; ++width) {
+        size_t size = LANES * width * sizeof(uint32_t);
+        size_t exceptions = 0;
+        for (int wider = width + 1; wider <= 32; ++wider) {
+            exceptions += widthCounts[wider];
+            size += widthCounts[wider] * (1 + varintLength(wider - width));
+        }
+        if (exceptions <= 255 && size < bestSize) {
+            best = width;
+            bestSize = size;
+        }
+    }
+    return best;
+}
+
+}
+
+void PForCodec::encode(const uint32_t* values, size_t count, std::string& out) const {
+    size_t i = 0;
+    for (; i + BLOCK <= count; i += BLOCK) {
+        const uint32_t* block = values + i;
+        int width = chooseWidth(block);
+        uint32_t mask = width == 32 ? 0xFFFFFFFFu : (1u << width) - 1;
+
+        uint32_t words[LANES * 32] = {};
+        std::string exceptions;
+        uint8_t exceptionCount = 0;
+        for (size_t k = 0; k < BLOCK && width > 0; ++k) {
+            size_t lane = k % LANES;
+            size_t bit = k / LANES * width;
+            size_t offset = bit % 32;
+            uint32_t low = block[k] & mask;
+            words[bit / 32 * LANES + lane] |= low << offset;
+            if (offset + width > 32) {
+                words[(bit / 32 + 1) * LANES + lane] |= low >> (32 - offset);
+            }
+        }
+        for (size_t k = 0; k < BLOCK; ++k) {
+            if (width < 32 && (block[k] >> width) != 0) {
+                exceptions.push_back(static_cast<char>(k));
+                putVarint(exceptions, block[k] >> width);
+                ++exceptionCount;
+            }
+        }
+
+        out.push_back(static_cast<char>(width));
+        out.push_back(static_cast<char>(exceptionCount));
+        out.append(reinterpret_cast<const char*>(words), LANES * width * sizeof(uint32_t));
+        out.append(exceptions);
+    }
+    for (; i < count; ++i) {
+        putVarint(out, values[i]);
+    }
+}
+
+const uint8_t* PForCodec::decode(const uint8_t* data, size_t count, uint32_t* values) const {
+    size_t i = 0;
+    for (; i + BLOCK <= count; i += BLOCK) {
+        int width = data[0] <= 32 ? data[0] : 32;
+        uint8_t exceptionCount = data[1];
+        data += 2;
+        UNPACKERS[width](data, values + i);
+        data += LANES * width * sizeof(uint32_t);
+        // Исключения: старшие биты дописываются над упакованными младшими
+        for (uint8_t e = 0; e < exceptionCount; ++e) {
+            uint8_t index = *data++;
+            uint32_t high = getVarint(data);
+            if (width < 32) {
+                values[i + (index % BLOCK)] |= high << width;
+            }
+        }
+    }
+    for (; i < count; ++i) {
+        values[i] = getVarint(data);
+    }
+    return data;
+}
@@ -0,0 +1,111 @@
+#ifndef POSTINGCODEC_H
+#define POSTINGCODEC_H
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Запись беззнакового числа в формате varint (7 бит на байт)
+inline void putVarint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Чтение varint, указатель сдвигается за прочитанное число
+inline uint32_t getVarint(const uint8_t*& data) {
+    uint32_t value = *data & 0x7F;
+    if (*data++ < 0x80) return value;
+    int shift = 7;
+    while (true) {
+        uint8_t byte = *data++;
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (byte < 0x80) break;
+        shift += 7;
+    }
+    return value;
+}
+
+// Номер кодека хранится в заголовке сегмента, значения не меняются
+enum class CodecType : uint32_t {
+    Varint = 0,
+    GroupVarint = 1,
+    PFor = 2
+};
+
+// Кодек сегментов, если в config.json не задан index_codec
+constexpr CodecType DEFAULT_CODEC = CodecType::PFor;
+
+/*
+ Кодек массива беззнаковых 32-битных чисел (дельты id, частоты, позиции).
+
+ Массив кодируется целиком, длину хранит вызывающий. Декодер может прочитать
+ до CODEC_READ_PADDING байт за концом закодированных данных, поэтому после
+ последнего массива в файле должно быть столько же байт запаса.
+*/
+class IntegerCodec {
+public:
+    virtual ~IntegerCodec() = default;
+
+    virtual CodecType type() const = 0;
+    virtual const char* name() const = 0;
+    // Дописывает count чисел в конец out
+    virtual void encode(const uint32_t* values, size_t count, std::string& out) const = 0;
+    // Читает count чисел в values, возвращает указатель за прочитанными данными
+    virtual const uint8_t* decode(const uint8_t* data, size_t count, uint32_t* values) const = 0;
+
+    static const IntegerCodec& get(CodecType type);
+    // Кодек по имени из config.json, false - имя неизвестно
+    static bool parse(std::string_view name, CodecType& type);
+};
+
+constexpr size_t CODEC_READ_PADDING = 16;
+
+// Числа подряд в varint
+class VarintCodec : public IntegerCodec {
+public:
+    CodecType type() const override { return CodecType::Varint; }
+    const char* name() const override { return "varint"; }
+    void encode(const uint32_t* values, size_t count, std::string& out) const override;
+    const uint8_t* decode(const uint8_t* data, size_t count, uint32_t* values) const override;
+};
+
+/*
+ Group Varint: четверка чисел - управляющий байт (по 2 бита на длину каждого
+ числа, 1-4 байта) и сами числа little-endian. Остаток меньше четверки - varint.
+ С SSSE3 четверка разбирается одной перестановкой байт (pshufb) по таблице
+ на 256 управляющих байт.
+*/
+class GroupVarintCodec : public IntegerCodec {
+public:
+    CodecType type() const override { return CodecType::GroupVarint; }
+    const char* name() const override { return "group_varint"; }
+    void encode(const uint32_t* values, size_t count, std::string& out) const override;
+    const uint8_t* decode(const uint8_t* data, size_t count, uint32_t* values) const override;
+};
+
+/*
+ PForDelta: порции по 128 чисел упаковываются по b бит, b выбирается так,
+ чтобы порция вместе с исключениями была короче всего. Числа шире b бит -
+ исключения: их старшие биты идут после упаковки (номер в порции и varint).
+ Формат порции: байт b, байт числа исключений, 16*b байт упаковки, исключения.
+
+ Упаковка вертикальная в 4 полосы: число i лежит в полосе i % 4, поэтому
+ распаковка SSE2 сдвигает и маскирует сразу четыре числа, а скалярная версия
+ читает тот же формат. Остаток меньше 128 чисел - varint.
+*/
+class PForCodec : public IntegerCodec {
+public:
+    static constexpr size_t BLOCK = 128;
+
+    CodecType type() const override { return CodecType::PFor; }
+    const char* name() const override { return "pfor"; }
+    void encode(const uint32_t* values, size_t count, std::string& out) const override;
+    const uint8_t* decode(const uint8_t* data, size_t count, uint32_t* values) const override;
+};
+
+#endif // POSTINGCODEC_H
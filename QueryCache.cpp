@@ -0,0 +1,88 @@
+#include "QueryCache.h"
+#include "Metrics.h"
+
+void QueryCache::setCapacity(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = bytes;
+    evict(capacity);
+}
+
+size_t QueryCache::getCapacity() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return capacity;
+}
+
+// Вытеснение с конца списка, пока записи не уложатся в limit байт
+void QueryCache::evict(size_t limit) {
+    while (used > limit && !entries.empty()) {
+        Entry& oldest = entries.back();
+        used -= oldest.bytes;
+        index.erase(oldest.key);
+        entries.pop_back();
+        Metrics::global().add(Counter::CacheEvictions, 1);
+    }
+}
+
+// Ответы прошлых снимков больше не нужны: их документы могли измениться
+void QueryCache::startGeneration(uint64_t fresh) {
+    if (generation != fresh) {
+        index.clear();
+        entries.clear();
+        used = 0;
+        generation = fresh;
+    }
+}
+
+bool QueryCache::lookup(const std::string& key, uint64_t snapshotGeneration, Answer& answer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (capacity == 0) {
+        return false;
+    }
+    startGeneration(snapshotGeneration);
+    auto found = index.find(key);
+    if (found == index.end()) {
+        Metrics::global().add(Counter::CacheMisses, 1);
+        return false;
+    }
+    // Найденная запись становится самой свежей
+    entries.splice(entries.begin(), entries, found->second);
+    answer = found->second->answer;
+    Metrics::global().add(Counter::CacheHits, 1);
+    return true;
+}
+
+void QueryCache::store(const std::string& key, uint64_t snapshotGeneration, const Answer& answer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = key.size() + answer.size() * sizeof(Answer::value_type) + ENTRY_OVERHEAD;
+    // Ответ старого снимка, пока запрос считался, индекс успели переоткрыть
+    if (bytes > capacity || snapshotGeneration < generation) {
+        return;
+    }
+    startGeneration(snapshotGeneration);
+
+    // Два потока могли вычислить один запрос одновременно, остается первый ответ
+    if (index.count(key) > 0) {
+        return;
+    }
+    evict(capacity - bytes);
+    entries.push_front(Entry {key, answer, bytes});
+    index.emplace(entries.front().key, entries.begin());
+    used += bytes;
+}
+
+void QueryCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    index.clear();
+    entries.clear();
+    used = 0;
+}
+
+size_t QueryCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+size_t QueryCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return used;
+}
@@ -0,0 +1,69 @@
+#ifndef QUERYCACHE_H
+#define QUERYCACHE_H
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ Кэш ответов на запросы с вытеснением давно не использованных (LRU).
+
+ Ключ - нормализованный запрос, ответы действительны только для снимка
+ индекса с тем же номером поколения: при первом обращении с новым
+ поколением кэш очищается целиком. Размер записей (ключ, ответ и служебные
+ данные) ограничен бюджетом в байтах, 0 - кэш выключен.
+ Все методы можно вызывать из потоков поиска одновременно.
+*/
+class QueryCache {
+public:
+    using Answer = std::vector<std::pair<int, float>>;
+
+private:
+    // Примерный расход памяти на запись сверх ключа и ответа: узлы списка и хеш-таблицы
+    static constexpr size_t ENTRY_OVERHEAD = 96;
+
+    struct Entry {
+        std::string key;
+        Answer answer;
+        size_t bytes;
+    };
+
+    mutable std::mutex mutex;
+    size_t capacity = 0;
+    size_t used = 0;
+    uint64_t generation = 0;
+    // Записи от недавно использованных к давним
+    std::list<Entry> entries;
+    // Ключи указывают на строки в узлах списка, узлы не перемещаются
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+
+    void evict(size_t limit);
+    void startGeneration(uint64_t fresh);
+
+public:
+    QueryCache() = default;
+    QueryCache(const QueryCache&) = delete;
+    QueryCache& operator=(const QueryCache&) = delete;
+
+    // Бюджет в байтах, лишние записи вытесняются сразу
+    void setCapacity(size_t bytes);
+    size_t getCapacity() const;
+    bool enabled() const { return getCapacity() > 0; }
+
+    // false - ответа нет, запрос нужно вычислить
+    bool lookup(const std::string& key, uint64_t snapshotGeneration, Answer& answer);
+    void store(const std::string& key, uint64_t snapshotGeneration, const Answer& answer);
+    void clear();
+
+    size_t size() const;
+    size_t bytes() const;
+};
+
+#endif // QUERYCACHE_H
@@ -0,0 +1,698 @@
+#include "QueryEvaluator.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define QUERY_EVALUATOR_SSE2 1
+#endif
+
+namespace {
+
+// Пересечение двух отсортированных списков позиций без повторов, результат - в out
+size_t intersectPositions(const uint32_t* a, size_t aSize, const uint32_t* b, size_t bSize, uint32_t* out) {
+    size_t i = 0;
+    size_t j = 0;
+    size_t count = 0;
+#ifdef QUERY_EVALUATOR_SSE2
+    // Блоками по 4: каждая позиция a сравнивается со всеми четырьмя позициями блока b
+    while (i + 4 <= aSize && j + 4 <= bSize) {
+        __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + j));
+        __m128i equal = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi32(left, right),
+                             _mm_cmpeq_epi32(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(0, 3, 2, 1)))),
+                _mm_or_si128(_mm_cmpeq_epi32(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(1, 0, 3, 2))),
+                             _mm_cmpeq_epi32(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(2, 1, 0, 3)))));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(equal));
+        for (int k = 0; k < 4; ++k) {
+            if (mask & (1 << k)) {
+                out[count++] = a[i + k];
+            }
+        }
+        // Сдвигается блок с меньшей последней позицией (при равенстве - оба)
+        uint32_t aLast = a[i + 3];
+        uint32_t bLast = b[j + 3];
+        if (aLast <= bLast) {
+            i += 4;
+        }
+        if (bLast <= aLast) {
+            j += 4;
+        }
+    }
+#endif
+    while (i < aSize && j < bSize) {
+        if (a[i] < b[j]) {
+            ++i;
+        } else if (b[j] < a[i]) {
+            ++j;
+        } else {
+            out[count++] = a[i];
+            ++i;
+            ++j;
+        }
+    }
+    return count;
+}
+
+// Наименьшее расстояние между позициями двух слов
+uint32_t minimalDistance(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    uint32_t best = std::numeric_limits<uint32_t>::max();
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() && j < b.size() && best > 1) {
+        if (a[i] < b[j]) {
+            best = std::min(best, b[j] - a[i]);
+            ++i;
+        } else {
+            best = std::min(best, a[i] - b[j]);
+            ++j;
+        }
+    }
+    return best;
+}
+
+// Наименьшее окно (разница крайних позиций), в котором встречается каждое из слов
+uint32_t minimalWindow(const std::vector<const std::vector<uint32_t>*>& lists) {
+    std::vector<size_t> heads(lists.size(), 0);
+    uint32_t best = std::numeric_limits<uint32_t>::max();
+    while (true) {
+        size_t lowest = 0;
+        uint32_t low = std::numeric_limits<uint32_t>::max();
+        uint32_t high = 0;
+        for (size_t i = 0; i < lists.size(); ++i) {
+            uint32_t position = (*lists[i])[heads[i]];
+            if (position < low) {
+                low = position;
+                lowest = i;
+            }
+            high = std::max(high, position);
+        }
+        best = std::min(best, high - low);
+        if (++heads[lowest] >= lists[lowest]->size()) {
+            return best;
+        }
+    }
+}
+
+}
+
+TopDocuments::TopDocuments(size_t limit) : limit(limit) {
+    heap.reserve(limit);
+}
+
+bool TopDocuments::better(const ScoredDocument& a, const ScoredDocument& b) {
+    return a.second > b.second || (a.second == b.second && a.first < b.first);
+}
+
+void TopDocuments::push(uint32_t documentId, double score) {
+    if (limit == 0) {
+        return;
+    }
+    ScoredDocument document(documentId, score);
+    if (heap.size() < limit) {
+        heap.push_back(document);
+        std::push_heap(heap.begin(), heap.end(), better);
+    } else if (better(document, heap.front())) {
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = document;
+        std::push_heap(heap.begin(), heap.end(), better);
+    }
+}
+
+double TopDocuments::threshold() const {
+    return full() ? heap.front().second : 0.0;
+}
+
+std::vector<ScoredDocument> TopDocuments::take() {
+    std::sort_heap(heap.begin(), heap.end(), better);
+    return std::move(heap);
+}
+
+QueryEvaluator::QueryEvaluator(const IndexSnapshot& snapshot)
+        : snapshot(snapshot),
+          documentCount(snapshot.documentCount()),
+          averageLength(std::max(1.0, snapshot.averageDocumentLength())) {}
+
+void QueryEvaluator::addCursor(Evaluation& evaluation, SnapshotPostings postings) const {
+    TermCursor cursor;
+    cursor.postings = std::move(postings);
+    double documentFrequency = cursor.postings.documentFrequency();
+    cursor.valid = documentFrequency > 0 && cursor.postings.next();
+    cursor.idf = std::max(0.0, std::log(1.0 + (documentCount - documentFrequency + 0.5) /
+                                              (documentFrequency + 0.5)));
+    // Оценка сверху: наибольшая частота и нулевая длина документа
+    double maxFrequency = cursor.postings.maxFrequency();
+    cursor.maxScore = cursor.idf * maxFrequency * (BM25_K1 + 1.0) /
+                      (maxFrequency + BM25_K1 * (1.0 - BM25_B));
+    evaluation.cursors.push_back(std::move(cursor));
+}
+
+QueryEvaluator::Evaluation QueryEvaluator::prepare(const SearchQuery& query) const {
+    Evaluation evaluation;
+    std::vector<const std::string*> names;
+
+    // Повторяющиеся слова запроса читаются одним курсором
+    auto cursorOf = [&](const std::string& term) {
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (*names[i] == term) {
+                return i;
+            }
+        }
+        PhaseTimer lookupTimer(Phase::Lookup);
+        SnapshotPostings postings = snapshot.postings(term);
+        lookupTimer.stop();
+        names.push_back(&term);
+        addCursor(evaluation, std::move(postings));
+        return evaluation.cursors.size() - 1;
+    };
+
+    for (const auto& term : query.terms) {
+        cursorOf(term);
+    }
+    for (const auto& phrase : query.phrases) {
+        if (phrase.terms.size() < 2) {
+            continue;
+        }
+        PhraseCursors phraseCursors;
+        phraseCursors.slop = phrase.slop;
+        for (const auto& term : phrase.terms) {
+            size_t index = cursorOf(term);
+            evaluation.cursors[index].required = true;
+            phraseCursors.cursors.push_back(index);
+        }
+        evaluation.phrases.push_back(std::move(phraseCursors));
+    }
+    // Курсоры шаблонов идут за словами и в фразы не входят
+    for (const auto& pattern : query.patterns) {
+        PhaseTimer lookupTimer(Phase::Lookup);
+        SnapshotPostings postings = snapshot.postings(snapshot.expand(pattern, MAX_EXPANSIONS));
+        lookupTimer.stop();
+        addCursor(evaluation, std::move(postings));
+    }
+
+    // Бонус пары не больше PROXIMITY_WEIGHT * меньший idf, он добавляется к оценке первого слова:
+    // бонус бывает только у документа, где есть оба слова
+    for (size_t i = 0; i + 1 < evaluation.cursors.size(); ++i) {
+        TermCursor& first = evaluation.cursors[i];
+        const TermCursor& second = evaluation.cursors[i + 1];
+        evaluation.pairs.emplace_back(i, i + 1);
+        first.bonus = PROXIMITY_WEIGHT * std::min(first.idf, second.idf);
+        first.maxScore += first.bonus;
+    }
+    return evaluation;
+}
+
+double QueryEvaluator::termScore(const TermCursor& cursor, double length) const {
+    double frequency = cursor.postings.frequency();
+    double norm = BM25_K1 * (1.0 - BM25_B + BM25_B * length / averageLength);
+    return cursor.idf * frequency * (BM25_K1 + 1.0) / (frequency + norm);
+}
+
+double QueryEvaluator::blockScore(TermCursor& cursor, uint32_t target) const {
+    if (cursor.blockScore >= 0 && cursor.blockTarget <= target && target <= cursor.blockEnd) {
+        return cursor.blockScore;
+    }
+    BlockBound bound {};
+    cursor.blockTarget = target;
+    if (!cursor.postings.blockBound(target, bound)) {
+        cursor.blockEnd = std::numeric_limits<uint32_t>::max();
+        cursor.blockScore = 0;
+        return 0;
+    }
+    // Вклад блока наибольший среди его документов, поэтому оценка не меньше веса любого из них
+    cursor.blockEnd = bound.lastDocumentId;
+    cursor.blockScore = std::min(cursor.maxScore, cursor.idf * bound.impact + cursor.bonus);
+    return cursor.blockScore;
+}
+
+bool QueryEvaluator::blockReaches(const std::vector<TermCursor*>& order, uint32_t target, double threshold,
+                                  uint32_t& skipTo) const {
+    // Документы от цели до ближайшего конца блока получают вес только от списков,
+    // которые стоят не дальше цели; остальные начинаются с next
+    double upperBound = 0;
+    uint32_t boundary = std::numeric_limits<uint32_t>::max();
+    uint32_t next = std::numeric_limits<uint32_t>::max();
+    for (TermCursor* cursor : order) {
+        if (cursor->documentId() > target) {
+            next = std::min(next, cursor->documentId());
+            continue;
+        }
+        upperBound += blockScore(*cursor, target);
+        boundary = std::min(boundary, cursor->blockEnd);
+    }
+    if (upperBound >= threshold) {
+        return true;
+    }
+    skipTo = boundary == std::numeric_limits<uint32_t>::max() ? next : std::min(next, boundary + 1);
+    return false;
+}
+
+bool QueryEvaluator::matchesPhrase(const Evaluation& evaluation, const PhraseCursors& phrase) {
+    const auto& cursors = evaluation.cursors;
+    for (size_t index : phrase.cursors) {
+        if (cursors[index].positions.empty()) {
+            return false;
+        }
+    }
+
+    if (phrase.slop > 0) {
+        // Все слова фразы в окне длиной фраза + slop
+        std::vector<const std::vector<uint32_t>*> lists;
+        for (size_t index : phrase.cursors) {
+            const auto* positions = &cursors[index].positions;
+            if (std::find(lists.begin(), lists.end(), positions) == lists.end()) {
+                lists.push_back(positions);
+            }
+        }
+        return minimalWindow(lists) <= phrase.cursors.size() - 1 + phrase.slop;
+    }
+
+    // Точная фраза: позиции начала, для которых i-е слово стоит на позиции начала + i
+    thread_local std::vector<uint32_t> candidates;
+    thread_local std::vector<uint32_t> shifted;
+    thread_local std::vector<uint32_t> matched;
+    candidates = cursors[phrase.cursors[0]].positions;
+    for (size_t i = 1; i < phrase.cursors.size() && !candidates.empty(); ++i) {
+        shifted.clear();
+        for (uint32_t position : cursors[phrase.cursors[i]].positions) {
+            if (position >= i) {
+                shifted.push_back(static_cast<uint32_t>(position - i));
+            }
+        }
+        matched.resize(std::min(candidates.size(), shifted.size()));
+        matched.resize(intersectPositions(candidates.data(), candidates.size(),
+                                          shifted.data(), shifted.size(), matched.data()));
+        std::swap(candidates, matched);
+    }
+    return !candidates.empty();
+}
+
+bool QueryEvaluator::scoreDocument(Evaluation& evaluation, uint32_t documentId, double& score) const {
+    double length = snapshot.documentLength(documentId);
+    score = 0;
+    for (const auto& cursor : evaluation.cursors) {
+        if (cursor.valid && cursor.documentId() == documentId) {
+            score += termScore(cursor, length);
+        }
+    }
+    if (evaluation.phrases.empty() && evaluation.pairs.empty()) {
+        return true;
+    }
+
+    // Позиции читаются только у оцениваемых документов
+    for (auto& cursor : evaluation.cursors) {
+        if (cursor.valid && cursor.documentId() == documentId) {
+            cursor.postings.readPositions(cursor.positions);
+        } else {
+            cursor.positions.clear();
+        }
+    }
+    for (const auto& phrase : evaluation.phrases) {
+        if (!matchesPhrase(evaluation, phrase)) {
+            return false;
+        }
+    }
+    for (const auto& [first, second] : evaluation.pairs) {
+        const TermCursor& a = evaluation.cursors[first];
+        const TermCursor& b = evaluation.cursors[second];
+        if (a.positions.empty() || b.positions.empty()) {
+            continue;
+        }
+        uint32_t distance = minimalDistance(a.positions, b.positions);
+        // 0 - шаблон и слово, которое он сам раскрывает (love lov*), стоят на одной позиции: это не близость
+        if (distance > 0 && distance <= PROXIMITY_WINDOW) {
+            score += PROXIMITY_WEIGHT * std::min(a.idf, b.idf) / (static_cast<double>(distance) * distance);
+        }
+    }
+    return true;
+}
+
+std::vector<ScoredDocument> QueryEvaluator::matchAny(const SearchQuery& query, size_t limit, bool pruning,
+                                                     bool blockMax) const {
+    Evaluation evaluation = prepare(query);
+    PhaseTimer timer(Phase::Score);
+    TopDocuments top(limit);
+    std::vector<TermCursor*> order;
+    for (auto& cursor : evaluation.cursors) {
+        if (cursor.valid) {
+            order.push_back(&cursor);
+        } else if (cursor.required) {
+            return top.take(); // слова фразы нет в индексе
+        }
+    }
+
+    while (!order.empty()) {
+        // Списков в запросе не больше десятка, сортировка вставками дешевле любой кучи
+        for (size_t i = 1; i < order.size(); ++i) {
+            for (size_t j = i; j > 0 && order[j]->documentId() < order[j - 1]->documentId(); --j) {
+                std::swap(order[j], order[j - 1]);
+            }
+        }
+
+        // Опорный список: первый, на котором сумма верхних оценок достигает порога
+        size_t pivot = 0;
+        if (pruning && top.full()) {
+            double threshold = top.threshold();
+            double upperBound = 0;
+            pivot = order.size();
+            for (size_t i = 0; i < order.size(); ++i) {
+                upperBound += order[i]->maxScore;
+                if (upperBound >= threshold) {
+                    pivot = i;
+                    break;
+                }
+            }
+            if (pivot == order.size()) {
+                break; // ни один оставшийся документ не попадет в top-k
+            }
+        }
+        // Документ без слова фразы не подходит, поэтому цель не раньше текущих документов этих слов
+        uint32_t target = order[pivot]->documentId();
+        for (const TermCursor* cursor : order) {
+            if (cursor->required) {
+                target = std::max(target, cursor->documentId());
+            }
+        }
+
+        uint32_t skipTo = 0;
+        if (blockMax && pruning && top.full() && !blockReaches(order, target, top.threshold(), skipTo)) {
+            if (skipTo == std::numeric_limits<uint32_t>::max()) {
+                break; // ни в одном оставшемся блоке вес не наберется
+            }
+            for (TermCursor* cursor : order) {
+                if (cursor->documentId() < skipTo) {
+                    cursor->valid = cursor->postings.advance(skipTo);
+                }
+            }
+        } else if (order.front()->documentId() == target) {
+            // Все списки до опорного стоят на цели - документ оценивается полностью
+            double score = 0;
+            if (scoreDocument(evaluation, target, score)) {
+                top.push(target, score);
+            }
+            for (TermCursor* cursor : order) {
+                if (cursor->documentId() == target) {
+                    cursor->valid = cursor->postings.next();
+                }
+            }
+        } else {
+            // Документы до цели не наберут порог, списки перескакивают к ней
+            for (TermCursor* cursor : order) {
+                if (cursor->documentId() < target) {
+                    cursor->valid = cursor->postings.advance(target);
+                }
+            }
+        }
+
+        for (const TermCursor* cursor : order) {
+            if (!cursor->valid && cursor->required) {
+                return top.take();
+            }
+        }
+        order.erase(std::remove_if(order.begin(), order.end(), [](const TermCursor* cursor) {
+            return !cursor->valid;
+        }), order.end());
+    }
+    return top.take();
+}
+
+std::vector<ScoredDocument> QueryEvaluator::matchAll(const SearchQuery& query, size_t limit) const {
+    Evaluation evaluation = prepare(query);
+    PhaseTimer timer(Phase::Score);
+    TopDocuments top(limit);
+    if (evaluation.cursors.empty()) {
+        return top.take();
+    }
+    std::vector<TermCursor*> order;
+    for (auto& cursor : evaluation.cursors) {
+        if (!cursor.valid) {
+            return top.take();
+        }
+        order.push_back(&cursor);
+    }
+
+    // Самое редкое слово ведет пересечение
+    std::sort(order.begin(), order.end(), [](const TermCursor* a, const TermCursor* b) {
+        return a->postings.documentFrequency() < b->postings.documentFrequency();
+    });
+
+    TermCursor& lead = *order.front();
+    uint32_t candidate = lead.documentId();
+    while (true) {
+        bool aligned = true;
+        for (size_t i = 1; i < order.size(); ++i) {
+            if (!order[i]->postings.advance(candidate)) {
+                return top.take();
+            }
+            if (order[i]->documentId() > candidate) {
+                candidate = order[i]->documentId();
+                aligned = false;
+                break;
+            }
+        }
+
+        if (aligned) {
+            double score = 0;
+            if (scoreDocument(evaluation, candidate, score)) {
+                top.push(candidate, score);
+            }
+            if (!lead.postings.next()) {
+                break;
+            }
+        } else if (!lead.postings.advance(candidate)) {
+            break;
+        }
+        candidate = lead.documentId();
+    }
+    return top.take();
+}
+
+QueryEvaluator::PlanNode QueryEvaluator::plan(const SearchQuery& query, const QueryNode& node,
+                                              Evaluation& evaluation) const {
+    PlanNode result;
+    result.op = node.op;
+    auto addLeaf = [&](SnapshotPostings postings) {
+        PlanNode leaf;
+        leaf.op = QueryOperator::Term;
+        leaf.cost = postings.postingCount();
+        addCursor(evaluation, std::move(postings));
+        leaf.cursor = evaluation.cursors.size() - 1;
+        return leaf;
+    };
+
+    switch (node.op) {
+    case QueryOperator::Term: {
+        PhaseTimer lookupTimer(Phase::Lookup);
+        return addLeaf(snapshot.postings(query.terms[node.index]));
+    }
+    case QueryOperator::Pattern: {
+        PhaseTimer lookupTimer(Phase::Lookup);
+        PlanNode leaf = addLeaf(snapshot.postings(snapshot.expand(query.patterns[node.index], MAX_EXPANSIONS)));
+        leaf.op = QueryOperator::Pattern;
+        return leaf;
+    }
+    case QueryOperator::Phrase: {
+        // Фраза - пересечение ее слов с проверкой позиций на каждом кандидате
+        const QueryPhrase& phrase = query.phrases[node.index];
+        PhraseCursors phraseCursors;
+        phraseCursors.slop = phrase.slop;
+        for (const auto& term : phrase.terms) {
+            PhaseTimer lookupTimer(Phase::Lookup);
+            result.children.push_back(addLeaf(snapshot.postings(term)));
+            phraseCursors.cursors.push_back(result.children.back().cursor);
+        }
+        result.cursor = evaluation.phrases.size();
+        evaluation.phrases.push_back(std::move(phraseCursors));
+        break;
+    }
+    case QueryOperator::Not: {
+        if (node.children.empty()) {
+            break;
+        }
+        PlanNode child = plan(query, node.children.front(), evaluation);
+        if (child.op == QueryOperator::Not && !child.children.empty()) {
+            return std::move(child.children.front()); // NOT NOT x = x
+        }
+        result.children.push_back(std::move(child));
+        return result;
+    }
+    case QueryOperator::And:
+    case QueryOperator::Or:
+        for (const auto& childNode : node.children) {
+            PlanNode child = plan(query, childNode, evaluation);
+            if (child.op == QueryOperator::Not) {
+                if (!child.children.empty()) {
+                    result.excluded.push_back(std::move(child.children.front()));
+                }
+            } else if (child.op == QueryOperator::And && child.children.empty()) {
+                // NOT a AND NOT b внутри OR тоже фильтр: документов, из которых вычитать, у него нет
+                for (auto& filter : child.excluded) {
+                    result.excluded.push_back(std::move(filter));
+                }
+            } else if (child.op == node.op && (node.op == QueryOperator::And || child.excluded.empty())) {
+                // (a AND b) AND c = a AND b AND c; у OR так можно, только если у вложенного нет фильтров
+                for (auto& grandchild : child.children) {
+                    result.children.push_back(std::move(grandchild));
+                }
+                for (auto& filter : child.excluded) {
+                    result.excluded.push_back(std::move(filter));
+                }
+            } else {
+                result.children.push_back(std::move(child));
+            }
+        }
+        if (result.children.size() == 1 && result.excluded.empty()) {
+            return std::move(result.children.front());
+        }
+        break;
+    }
+
+    if (result.op == QueryOperator::Or) {
+        for (const auto& child : result.children) {
+            result.cost += child.cost;
+        }
+    } else {
+        // Самый редкий ребенок ведет пересечение, остальные догоняют его через advance()
+        std::sort(result.children.begin(), result.children.end(), [](const PlanNode& a, const PlanNode& b) {
+            return a.cost < b.cost;
+        });
+        result.cost = result.children.empty() ? 0 : result.children.front().cost;
+    }
+    // Фильтр с большим числом документов скорее отбросит кандидата, его проверяем первым
+    std::sort(result.excluded.begin(), result.excluded.end(), [](const PlanNode& a, const PlanNode& b) {
+        return a.cost > b.cost;
+    });
+    return result;
+}
+
+bool QueryEvaluator::excludedAt(Evaluation& evaluation, PlanNode& node, uint32_t documentId) const {
+    for (auto& filter : node.excluded) {
+        if (advanceNode(evaluation, filter, documentId) && filter.documentId == documentId) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool QueryEvaluator::advanceNode(Evaluation& evaluation, PlanNode& node, uint32_t target) const {
+    if (node.op == QueryOperator::Term || node.op == QueryOperator::Pattern) {
+        TermCursor& cursor = evaluation.cursors[node.cursor];
+        if (cursor.valid && cursor.documentId() < target) {
+            cursor.valid = cursor.postings.advance(target);
+        }
+        node.documentId = cursor.documentId();
+        return node.valid = cursor.valid;
+    }
+    if (node.started && (!node.valid || node.documentId >= target)) {
+        return node.valid;
+    }
+    node.started = true;
+    node.valid = false;
+
+    uint32_t candidate = target;
+    while (true) {
+        if (node.op == QueryOperator::Or) {
+            // Кандидат - ближайший документ любого ребенка
+            bool found = false;
+            uint32_t nearest = std::numeric_limits<uint32_t>::max();
+            for (auto& child : node.children) {
+                if (advanceNode(evaluation, child, candidate)) {
+                    found = true;
+                    nearest = std::min(nearest, child.documentId);
+                }
+            }
+            if (!found) {
+                return false;
+            }
+            candidate = nearest;
+        } else {
+            // Дети AND и слова фразы догоняют друг друга, пока не встанут на один документ
+            if (node.children.empty()) {
+                return false; // одни NOT: документов, из которых их вычитать, нет
+            }
+            bool aligned = false;
+            while (!aligned) {
+                aligned = true;
+                for (auto& child : node.children) {
+                    if (!advanceNode(evaluation, child, candidate)) {
+                        return false;
+                    }
+                    if (child.documentId > candidate) {
+                        candidate = child.documentId;
+                        aligned = false;
+                        break;
+                    }
+                }
+            }
+        }
+
+        bool accepted = !excludedAt(evaluation, node, candidate);
+        if (accepted && node.op == QueryOperator::Phrase) {
+            for (const auto& child : node.children) {
+                TermCursor& cursor = evaluation.cursors[child.cursor];
+                cursor.postings.readPositions(cursor.positions);
+            }
+            accepted = matchesPhrase(evaluation, evaluation.phrases[node.cursor]);
+        }
+        if (accepted) {
+            node.documentId = candidate;
+            return node.valid = true;
+        }
+        if (candidate == std::numeric_limits<uint32_t>::max()) {
+            return false;
+        }
+        ++candidate;
+    }
+}
+
+double QueryEvaluator::scoreNode(const Evaluation& evaluation, const PlanNode& node, uint32_t documentId,
+                                 double length) const {
+    if (node.op == QueryOperator::Term || node.op == QueryOperator::Pattern) {
+        const TermCursor& cursor = evaluation.cursors[node.cursor];
+        return cursor.valid && cursor.documentId() == documentId ? termScore(cursor, length) : 0.0;
+    }
+    double score = 0;
+    for (const auto& child : node.children) {
+        // У OR в вес идут только ветви, выполненные на документе
+        if (node.op != QueryOperator::Or || (child.valid && child.documentId == documentId)) {
+            score += scoreNode(evaluation, child, documentId, length);
+        }
+    }
+    return score;
+}
+
+std::vector<ScoredDocument> QueryEvaluator::matchTree(const SearchQuery& query, size_t limit, bool pruning) const {
+    if (!query.tree) {
+        return matchAny(query, limit, pruning);
+    }
+    const QueryNode& root = *query.tree;
+    bool flat = root.op == QueryOperator::Or || root.op == QueryOperator::And;
+    for (const auto& child : root.children) {
+        flat = flat && (child.op == QueryOperator::Term || child.op == QueryOperator::Pattern ||
+                        (child.op == QueryOperator::Phrase && root.op == QueryOperator::And));
+    }
+    if (flat) {
+        return root.op == QueryOperator::Or ? matchAny(query, limit, pruning) : matchAll(query, limit);
+    }
+
+    Evaluation evaluation;
+    PlanNode planned = plan(query, root, evaluation);
+    PhaseTimer timer(Phase::Score);
+    TopDocuments top(limit);
+    if (planned.op == QueryOperator::Not) {
+        return top.take(); // запрос из одного отрицания: документов, из которых вычитать, нет
+    }
+    uint32_t target = 0;
+    while (advanceNode(evaluation, planned, target)) {
+        uint32_t documentId = planned.documentId;
+        top.push(documentId, scoreNode(evaluation, planned, documentId, snapshot.documentLength(documentId)));
+        if (documentId == std::numeric_limits<uint32_t>::max()) {
+            break;
+        }
+        target = documentId + 1;
+    }
+    return top.take();
+}
@@ -0,0 +1,177 @@
+#ifndef QUERYEVALUATOR_H
+#define QUERYEVALUATOR_H
+
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "IndexSnapshot.h"
+#include "TermAutomaton.h"
+
+// document_id и вес документа по BM25
+using ScoredDocument = std::pair<uint32_t, double>;
+
+// Фраза в кавычках: слова идут подряд, при slop > 0 - в окне с slop лишними словами
+struct QueryPhrase {
+    std::vector<std::string> terms;
+    uint32_t slop = 0;
+};
+
+// Операторы булева запроса; Term, Phrase и Pattern - листья дерева
+enum class QueryOperator : uint8_t {
+    Term,
+    Phrase,
+    Pattern,
+    And,
+    Or,
+    Not
+};
+
+// Узел дерева: лист ссылается на слово, фразу или шаблон SearchQuery по номеру
+struct QueryNode {
+    QueryOperator op = QueryOperator::And;
+    uint32_t index = 0;
+    std::vector<QueryNode> children;
+};
+
+// Разобранный запрос: слова в порядке запроса (включая слова фраз), фразы,
+// которые документ обязан содержать, и шаблоны (слово*, сл?во, слово~N).
+// У запроса с AND, OR, NOT или скобками есть дерево: тогда документ отбирается
+// по нему, а фразы обязательны только там, где они стоят в дереве
+struct SearchQuery {
+    std::vector<std::string> terms;
+    std::vector<QueryPhrase> phrases;
+    std::vector<TermPattern> patterns;
+    std::shared_ptr<const QueryNode> tree;
+};
+
+/*
+ Вычисление запроса документ за документом (DAAT): списки всех слов
+ запроса идут параллельно, каждый документ оценивается один раз.
+ Дизъюнкция использует WAND - списки, которые не могут поднять документ
+ выше текущего порога top-k, перескакиваются через advance(). Block-Max
+ WAND уточняет оценку по указателям пропуска: если сумма оценок блоков,
+ в которых стоит цель, не достигает порога, все списки перескакивают за
+ ближайший конец блока, не раскодируя документы внутри.
+ Конъюнкция ведется самым редким словом, остальные догоняют его галопом.
+ Фразы проверяются пересечением позиций, близость соседних слов запроса
+ добавляет к весу бонус. Шаблон раскрывается по словарям сегментов не
+ больше чем в MAX_EXPANSIONS термов, и их списки читаются одним курсором
+ как одно слово: частоты складываются, idf берется по самому частому терму.
+
+ Булев запрос сначала планируется: вложенные AND и OR одного вида
+ сливаются, дети AND упорядочиваются по числу документов, и пересечение
+ ведет самый редкий из них, а NOT становятся фильтрами узла, к которым
+ обращаются через advance() только на уже найденных кандидатах. Поэтому
+ запрос стоит примерно столько же, сколько его самое избирательное условие.
+*/
+class QueryEvaluator {
+private:
+    // Бонус близости: вес пары соседних слов и наибольшее расстояние между ними
+    static constexpr double PROXIMITY_WEIGHT = 1.0;
+    static constexpr uint32_t PROXIMITY_WINDOW = 5;
+
+    struct TermCursor {
+        SnapshotPostings postings;
+        double idf = 0;
+        double maxScore = 0;   // верхняя оценка вклада слова в вес любого документа
+        double bonus = 0;      // часть maxScore за близость к следующему слову
+        // Оценка блока, в котором лежит цель blockTarget, действует до blockEnd включительно
+        uint32_t blockTarget = 0;
+        uint32_t blockEnd = 0;
+        double blockScore = -1;
+        bool valid = false;
+        bool required = false; // слово входит во фразу
+        std::vector<uint32_t> positions; // позиции в оцениваемом документе
+
+        uint32_t documentId() const { return postings.documentId(); }
+    };
+
+    // Фраза в номерах курсоров: i-е слово фразы - курсор cursors[i]
+    struct PhraseCursors {
+        std::vector<size_t> cursors;
+        uint32_t slop = 0;
+    };
+
+    struct Evaluation {
+        std::vector<TermCursor> cursors;
+        std::vector<PhraseCursors> phrases;
+        // Соседние слова запроса, за близость которых дается бонус
+        std::vector<std::pair<size_t, size_t>> pairs;
+    };
+
+    // Узел плана булева запроса. У листа свой курсор, даже если слово повторяется:
+    // ветви дерева двигаются к разным документам независимо
+    struct PlanNode {
+        QueryOperator op = QueryOperator::And;
+        size_t cursor = 0;              // Term и Pattern - номер курсора, Phrase - номер фразы
+        std::vector<PlanNode> children; // у AND и Phrase - по возрастанию стоимости
+        std::vector<PlanNode> excluded; // NOT: документы, где они есть, отбрасываются
+        uint64_t cost = 0;              // оценка числа документов сверху
+        uint32_t documentId = 0;
+        bool started = false;
+        bool valid = false;
+    };
+
+    const IndexSnapshot& snapshot;
+    double documentCount;
+    double averageLength;
+
+    void addCursor(Evaluation& evaluation, SnapshotPostings postings) const;
+    Evaluation prepare(const SearchQuery& query) const;
+    PlanNode plan(const SearchQuery& query, const QueryNode& node, Evaluation& evaluation) const;
+    // Первый подходящий узлу документ с id >= target, false - таких нет
+    bool advanceNode(Evaluation& evaluation, PlanNode& node, uint32_t target) const;
+    bool excludedAt(Evaluation& evaluation, PlanNode& node, uint32_t documentId) const;
+    // Вес документа: слова ветвей, которые на нем выполнены
+    double scoreNode(const Evaluation& evaluation, const PlanNode& node, uint32_t documentId, double length) const;
+    double termScore(const TermCursor& cursor, double length) const;
+    // Верхняя оценка вклада слова в документы от target до cursor.blockEnd
+    double blockScore(TermCursor& cursor, uint32_t target) const;
+    // false - вес документов от target не достигнет порога до skipTo
+    bool blockReaches(const std::vector<TermCursor*>& order, uint32_t target, double threshold,
+                      uint32_t& skipTo) const;
+    // Вес документа, на котором стоят курсоры; false - документ не содержит фразу запроса
+    bool scoreDocument(Evaluation& evaluation, uint32_t documentId, double& score) const;
+    static bool matchesPhrase(const Evaluation& evaluation, const PhraseCursors& phrase);
+
+public:
+    // Наибольшее число термов, в которое раскрывается шаблон
+    static constexpr size_t MAX_EXPANSIONS = 64;
+
+    explicit QueryEvaluator(const IndexSnapshot& snapshot);
+
+    // Документы, где есть хотя бы одно слово и все фразы; pruning = false - полный перебор без WAND,
+    // blockMax = false - WAND только по оценкам слов целиком
+    std::vector<ScoredDocument> matchAny(const SearchQuery& query, size_t limit, bool pruning = true,
+                                         bool blockMax = true) const;
+    // Документы, где есть все слова и все фразы
+    std::vector<ScoredDocument> matchAll(const SearchQuery& query, size_t limit) const;
+    // Документы, подходящие под дерево запроса. Дерево из одного OR над словами или
+    // одного AND над словами и фразами вычисляется через matchAny и matchAll
+    std::vector<ScoredDocument> matchTree(const SearchQuery& query, size_t limit, bool pruning = true) const;
+};
+
+// Ограниченная куча лучших документов: наверху худший из отобранных
+class TopDocuments {
+private:
+    size_t limit;
+    std::vector<ScoredDocument> heap;
+
+public:
+    explicit TopDocuments(size_t limit);
+
+    // Лучше ли документ, чем b: больший вес, при равенстве - меньший id
+    static bool better(const ScoredDocument& a, const ScoredDocument& b);
+
+    void push(uint32_t documentId, double score);
+    bool full() const { return limit > 0 && heap.size() >= limit; }
+    // Вес, который нужно набрать, чтобы попасть в отбор
+    double threshold() const;
+    // Отобранные документы от лучшего к худшему
+    std::vector<ScoredDocument> take();
+};
+
+#endif // QUERYEVALUATOR_H
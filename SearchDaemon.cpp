@@ -0,0 +1,145 @@
+#include "SearchDaemon.h"
+#include "Metrics.h"
+#include <chrono>
+
+SearchDaemon::SearchDaemon(ConverterJSON& converter, InvertedIndex& invertedIndex, SearchServer& searchServer)
+        : converter(converter), invertedIndex(invertedIndex), searchServer(searchServer) {}
+
+SearchDaemon::~SearchDaemon() {
+    stop();
+}
+
+bool SearchDaemon::start() {
+    responsesLimit = converter.GetResponsesLimit();
+    refreshInterval = std::max(1, converter.getTimeUpdate());
+    withSnippets = converter.getSnippets();
+    searchServer.setCacheCapacity(converter.getQueryCacheLimit());
+    if (!reloadSnapshot(true)) {
+        return false;
+    }
+    stopping = false;
+    refresher = std::thread(&SearchDaemon::refreshLoop, this);
+    return true;
+}
+
+void SearchDaemon::stop() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (refresher.joinable()) {
+        refresher.join();
+    }
+}
+
+std::shared_ptr<const IndexSnapshot> SearchDaemon::currentSnapshot() const {
+    return std::atomic_load(&snapshot);
+}
+
+// Новый снимок открывается рядом со старым и подменяет его одной атомарной записью
+bool SearchDaemon::reloadSnapshot(bool force) {
+    std::shared_ptr<const IndexSnapshot> current = currentSnapshot();
+    IndexManifest published;
+    if (!force && current && published.load(INDEX_MANIFEST_PATH) && published.sameSegments(current->manifest())) {
+        return true;
+    }
+
+    auto fresh = std::make_shared<IndexSnapshot>();
+    if (!fresh->openPublished()) {
+        std::cerr << "Error: Unable to open the index published in index.manifest" << std::endl;
+        return false;
+    }
+    // Сегменты построены или проверены manageIndex с текущим config. Если перестроить
+    // индекс под новые настройки не удалось, запросы разбираются прежним Analyzer сегментов
+    if (!fresh->setAnalyzer(converter.getAnalyzer())) {
+        if (!current || !fresh->setAnalyzer(current->sharedAnalyzer())) {
+            std::cerr << "Error: The index was built with analyzer settings other than in config.json" << std::endl;
+            return false;
+        }
+        std::cerr << "Index is not rebuilt for the new analyzer settings, queries use the previous ones" << std::endl;
+    }
+    if (withSnippets && !fresh->loadDocuments()) {
+        std::cerr << "Error: Unable to load the document state, snippets are empty" << std::endl;
+    }
+    std::atomic_store(&snapshot, std::shared_ptr<const IndexSnapshot>(std::move(fresh)));
+    if (!force) {
+        std::cerr << "Index reloaded" << std::endl;
+    }
+    return true;
+}
+
+void SearchDaemon::refresh() {
+    std::lock_guard<std::mutex> lock(refreshMutex);
+    // Конфиг перечитывается, чтобы увидеть новые документы и настройки
+    if (!converter.loadConfig()) {
+        std::cerr << "Failed to load configuration, index is not refreshed." << std::endl;
+        return;
+    }
+    responsesLimit = converter.GetResponsesLimit();
+    refreshInterval = std::max(1, converter.getTimeUpdate());
+    searchServer.setCacheCapacity(converter.getQueryCacheLimit());
+
+    invertedIndex.manageIndex(converter);
+    withSnippets = converter.getSnippets();
+    // Слияние дельты публикует еще одно поколение, снимок открывается только после него
+    invertedIndex.waitForMerge();
+    reloadSnapshot(false);
+}
+
+void SearchDaemon::refreshLoop() {
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    while (!stopping) {
+        wake.wait_for(lock, std::chrono::seconds(refreshInterval.load()),
+                      [this] { return stopping || refreshRequested; });
+        if (stopping) {
+            break;
+        }
+        refreshRequested = false;
+        lock.unlock();
+        refresh();
+        lock.lock();
+    }
+}
+
+void SearchDaemon::serve(std::istream& input, std::ostream& output) {
+    std::string line;
+    while (std::getline(input, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        if (line == ":quit") {
+            break;
+        }
+        if (line == ":refresh") {
+            {
+                std::lock_guard<std::mutex> lock(wakeMutex);
+                refreshRequested = true;
+            }
+            wake.notify_all();
+            output << json({{"refresh:", "scheduled"}}).dump() << std::endl;
+            continue;
+        }
+        if (line == ":stats") {
+            output << Metrics::global().toJson().dump() << std::endl;
+            continue;
+        }
+
+        // Запрос работает со снимком, который был текущим на его начало
+        std::shared_ptr<const IndexSnapshot> current = currentSnapshot();
+        std::vector<std::string> requests {line};
+        std::vector<SearchQuery> queries = searchServer.processRequests(requests, current->analyzer());
+        auto answers = searchServer.search(*current, queries, responsesLimit);
+        std::string answer;
+        if (withSnippets) {
+            auto answerSnippets = searchServer.snippets(*current, queries, answers);
+            AnswersWriter::appendAnswer(answer, answers.front(), &answerSnippets.front());
+        } else {
+            AnswersWriter::appendAnswer(answer, answers.front());
+        }
+        output << answer << std::endl;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SEARCHDAEMON_H
+#define SEARCHDAEMON_H
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "ConverterJSON.h"
+#include "IndexSnapshot.h"
+#include "InvertedIndex.h"
+#include "SearchServer.h"
+
+/*
+ Резидентный режим: индекс открыт один раз, запросы приходят построчно.
+
+ Протокол: каждая строка входа - запрос в том же виде, что в requests.json,
+ на каждую строку выводится одна строка JSON с ответом в формате answers.json.
+ Служебные строки: ":refresh" - проверить индекс сейчас, ":stats" - метрики
+ в JSON (собираются с флагом --stats), ":quit" - выход. С snippets в config
+ у документов ответа есть сниппеты.
+
+ Фоновый поток каждые time_update секунд вызывает manageIndex и, если в
+ index.manifest опубликованы другие сегменты, открывает новый снимок и
+ подменяет его атомарно.
+ Запрос держит shared_ptr на снимок, с которым начал, поэтому старый снимок
+ закрывается, когда его отпустит последний запрос (как в RCU).
+*/
+class SearchDaemon {
+private:
+    ConverterJSON& converter;
+    InvertedIndex& invertedIndex;
+    SearchServer& searchServer;
+
+    // Читается и подменяется только через std::atomic_load/std::atomic_store
+    std::shared_ptr<const IndexSnapshot> snapshot;
+    std::atomic<int> responsesLimit {5};
+    std::atomic<int> refreshInterval {1};
+    std::atomic<bool> withSnippets {false};
+
+    std::mutex refreshMutex;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool refreshRequested = false;
+    std::thread refresher;
+
+    void refreshLoop();
+    bool reloadSnapshot(bool force);
+
+public:
+    SearchDaemon(ConverterJSON& converter, InvertedIndex& invertedIndex, SearchServer& searchServer);
+    ~SearchDaemon();
+    SearchDaemon(const SearchDaemon&) = delete;
+    SearchDaemon& operator=(const SearchDaemon&) = delete;
+
+    // Открытие снимка и запуск фонового обновления, индекс уже должен быть построен
+    bool start();
+    void stop();
+    // Обновление индекса и подмена снимка, если сегменты изменились
+    void refresh();
+    std::shared_ptr<const IndexSnapshot> currentSnapshot() const;
+
+    // Обработка строк до конца входа или ":quit"
+    void serve(std::istream& input, std::ostream& output);
+};
+
+#endif // SEARCHDAEMON_H
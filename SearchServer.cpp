@@ -1,226 +1,652 @@
 #include "SearchServer.h"
 #include "ConverterJSON.h"
-
-// Метод для токенизации текста
-std::vector<std::string> SearchServer::tokenize(const std::string& text) {
-    std::vector<std::string> tokens;
-    std::stringstream allText(text);
-    std::string word;
-
-    while (allText >> word) {
-        // Удаление пунктуации в начале и конце каждого слова
-        word.erase(std::remove_if(word.begin(), word.end(), ::ispunct), word.end());
-        tokens.push_back(word);
+#include "Metrics.h"
+
+// Наибольшее расстояние нечеткого поиска: слово~ означает слово~2
+static constexpr uint32_t MAX_FUZZY_DISTANCE = 2;
+// Наибольшее число слов в запросе из слов и в булевом запросе
+static constexpr size_t MAX_REQUEST_WORDS = 10;
+static constexpr size_t MAX_BOOLEAN_WORDS = 32;
+
+// Шаблон из слова запроса: * - любые символы, ? - один символ (? в конце слова - знак вопроса),
+// слово~N - термы на расстоянии Левенштейна до N. Части шаблона нормализуются как слова,
+// основа нечеткого слова еще и стеммером. false - слово не шаблон
+static bool parsePattern(std::string_view word, Tokenizer& tokenizer, const Analyzer& analyzer,
+                         TermPattern& pattern) {
+    size_t wildcard = word.find_first_of("*?");
+    if (wildcard == word.size() - 1 && word.back() == '?') {
+        wildcard = std::string_view::npos;
+    }
+    size_t tilde = word.rfind('~');
+    if (wildcard == std::string_view::npos && tilde != std::string_view::npos) {
+        uint32_t distance = MAX_FUZZY_DISTANCE;
+        if (tilde + 1 < word.size()) {
+            distance = 0;
+            for (char c : word.substr(tilde + 1)) {
+                if (c < '0' || c > '9') {
+                    return false;
+                }
+                distance = std::min<uint32_t>(distance * 10 + (c - '0'), MAX_FUZZY_DISTANCE);
+            }
+        }
+        std::string_view base = tokenizer.fold(word.substr(0, tilde));
+        if (base.empty()) {
+            return false;
+        }
+        std::string stemBuffer;
+        pattern.kind = PatternKind::Fuzzy;
+        pattern.text = analyzer.stems() ? analyzer.stem(base, stemBuffer) : base;
+        pattern.distance = distance;
+        return true;
+    }
+    if (wildcard == std::string_view::npos) {
+        return false;
     }
-    return tokens;
-}
 
-// Метод для приведения слов к нижнему регистру
-void SearchServer::toLowercase(std::vector<std::string>& tokens) {
-    for (auto& word : tokens) {
-        std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+    pattern.kind = PatternKind::Wildcard;
+    pattern.text.clear();
+    pattern.distance = 0;
+    bool literal = false;
+    size_t start = 0;
+    for (size_t i = 0; i <= word.size(); ++i) {
+        bool last = i == word.size() || (i + 1 == word.size() && word[i] == '?');
+        if (!last && word[i] != '*' && word[i] != '?') {
+            continue;
+        }
+        std::string_view piece = tokenizer.fold(word.substr(start, i - start));
+        literal = literal || !piece.empty();
+        pattern.text += piece;
+        // Подряд идущие * равны одной
+        if (!last && !(word[i] == '*' && !pattern.text.empty() && pattern.text.back() == '*')) {
+            pattern.text += word[i];
+        }
+        start = i + 1;
+        if (last) {
+            break;
+        }
     }
+    return literal;
 }
 
-// Метод удаления стоп-слов
-void SearchServer::removeStopWords(std::vector<std::string>& tokens) {
-    tokens.erase(std::remove_if(tokens.begin(), tokens.end(), [this](const std::string& word) {
-        return stopWords.find(word) != stopWords.end();
-    }), tokens.end());
-}
+// Слова вне кавычек: шаблоны отдельно, остальное - токенизатором
+static void addWords(std::string_view text, Tokenizer& tokenizer, const Analyzer& analyzer,
+                     SearchQuery& query, size_t& wordCount) {
+    std::string_view token;
+    size_t position = 0;
+    while (position < text.size()) {
+        while (position < text.size() && Tokenizer::isSpace(text[position])) {
+            ++position;
+        }
+        size_t wordEnd = position;
+        while (wordEnd < text.size() && !Tokenizer::isSpace(text[wordEnd])) {
+            ++wordEnd;
+        }
+        if (wordEnd == position) {
+            break;
+        }
+        std::string_view word = text.substr(position, wordEnd - position);
+        position = wordEnd;
 
-// предварительная обработка запросов
-std::vector<std::vector<std::string>> SearchServer::processRequests(std::vector<std::string>& listRequests) {
-    // Ограничение размера вектора до 1000
-    if (listRequests.size() > 1000) {
-        listRequests.resize(1000);
+        TermPattern pattern;
+        if (parsePattern(word, tokenizer, analyzer, pattern)) {
+            query.patterns.push_back(std::move(pattern));
+            ++wordCount;
+            continue;
+        }
+        tokenizer.reset(word);
+        while (tokenizer.next(token)) {
+            query.terms.emplace_back(token);
+        }
+        wordCount += tokenizer.wordCount();
     }
+}
 
-    // Результирующий список обработанных запросов
-    std::vector<std::vector<std::string>> processedRequests;
+// ~N после закрывающей кавычки фразы: возвращает позицию за числом, без числа - position
+static size_t parseSlop(std::string_view request, size_t position, uint32_t& slop) {
+    if (position >= request.size() || request[position] != '~') {
+        return position;
+    }
+    size_t digits = position + 1;
+    uint32_t value = 0;
+    while (digits < request.size() && request[digits] >= '0' && request[digits] <= '9') {
+        value = std::min<uint32_t>(value * 10 + (request[digits] - '0'), 1000);
+        ++digits;
+    }
+    if (digits == position + 1) {
+        return position;
+    }
+    slop = value;
+    return digits;
+}
 
-    // Обработка каждого запроса
-    for (auto& request : listRequests) {
-        // Токенизация строки
-        std::vector<std::string> tokens = tokenize(request);
+// Разбор запроса: слова вне кавычек, шаблоны, "фраза" и "фраза"~N (слова фразы в окне с N лишними словами)
+static SearchQuery parseRequest(std::string_view request, const Analyzer& analyzer, size_t& wordCount) {
+    SearchQuery query;
+    Tokenizer tokenizer(analyzer);
+    std::string_view token;
+    wordCount = 0;
+
+    size_t position = 0;
+    while (position < request.size()) {
+        size_t open = request.find('"', position);
+        size_t close = open == std::string_view::npos ? open : request.find('"', open + 1);
+
+        // Текст до кавычек, а без закрывающей кавычки - весь остаток как обычные слова
+        addWords(request.substr(position, close == std::string_view::npos ? close : open - position),
+                 tokenizer, analyzer, query, wordCount);
+        if (close == std::string_view::npos) {
+            break;
+        }
 
-        // Проверка количества слов до удаления стоп-слов
-        if (tokens.size() < 1 || tokens.size() > 10) {
-            continue; // Пропустить запись
+        QueryPhrase phrase;
+        tokenizer.reset(request.substr(open + 1, close - open - 1));
+        while (tokenizer.next(token)) {
+            phrase.terms.emplace_back(token);
         }
+        wordCount += tokenizer.wordCount();
+        position = close + 1;
 
-        // Удаление стоп-слов
-        removeStopWords(tokens);
+        position = parseSlop(request, position, phrase.slop);
 
-        // Добавление обработанного запроса в итоговый список
-        processedRequests.push_back(tokens);
+        query.terms.insert(query.terms.end(), phrase.terms.begin(), phrase.terms.end());
+        if (phrase.terms.size() > 1) {
+            query.phrases.push_back(std::move(phrase));
+        }
     }
-    return processedRequests;
+    return query;
 }
 
-
-// Функция для поиска ID токена в базе индексов
-int SearchServer::findTermID(const json& indexJson, const std::string& token) {
-    if (indexJson.contains("term_index") && indexJson["term_index"].contains("term_to_id")) {
-        const auto& termToID = indexJson["term_index"]["term_to_id"];
-        auto it = termToID.find(token);
-        if (it != termToID.end()) {
-            return it.value(); // Возвращаем ID терма
+namespace {
+
+// Лексема булева запроса: слово, фраза в кавычках, скобка или оператор
+enum class LexemeKind {
+    Word,
+    Phrase,
+    Open,
+    Close,
+    And,
+    Or,
+    Not
+};
+
+struct Lexeme {
+    LexemeKind kind;
+    std::string_view text;
+    uint32_t slop = 0;
+};
+
+// Деление запроса на лексемы. Операторы - только слова AND, OR, NOT заглавными буквами,
+// кавычка без пары считается обычным символом
+std::vector<Lexeme> splitLexemes(std::string_view request) {
+    std::vector<Lexeme> lexemes;
+    size_t position = 0;
+    while (position < request.size()) {
+        char c = request[position];
+        if (Tokenizer::isSpace(c)) {
+            ++position;
+            continue;
+        }
+        if (c == '(' || c == ')') {
+            lexemes.push_back({c == '(' ? LexemeKind::Open : LexemeKind::Close, request.substr(position, 1)});
+            ++position;
+            continue;
+        }
+        size_t close = c == '"' ? request.find('"', position + 1) : std::string_view::npos;
+        if (close != std::string_view::npos) {
+            Lexeme phrase {LexemeKind::Phrase, request.substr(position + 1, close - position - 1)};
+            position = parseSlop(request, close + 1, phrase.slop);
+            lexemes.push_back(phrase);
+            continue;
+        }
+        size_t wordEnd = position + 1;
+        while (wordEnd < request.size() && !Tokenizer::isSpace(request[wordEnd]) &&
+               request[wordEnd] != '(' && request[wordEnd] != ')' && request[wordEnd] != '"') {
+            ++wordEnd;
         }
+        std::string_view word = request.substr(position, wordEnd - position);
+        LexemeKind kind = word == "AND" ? LexemeKind::And
+                        : word == "OR" ? LexemeKind::Or
+                        : word == "NOT" ? LexemeKind::Not
+                        : LexemeKind::Word;
+        lexemes.push_back({kind, word});
+        position = wordEnd;
     }
-    return 0; // Возвращаем 0, если терм не найден
+    return lexemes;
 }
 
-// Выясняет для каждого токена запроса в каких док айди они содержатся
-SearchServer::RequestData SearchServer::findDocumentIdsForTokens() {
-    json requestsJson;
-    json indexJson;
-    RequestData requestDocIds;
+// Узел op над left и right; left того же оператора дополняется (AND и OR ассоциативны)
+void joinNodes(QueryOperator op, QueryNode& left, QueryNode right) {
+    if (left.op != op) {
+        QueryNode node;
+        node.op = op;
+        node.children.push_back(std::move(left));
+        left = std::move(node);
+    }
+    left.children.push_back(std::move(right));
+}
 
-    // Загрузка данных из файлов requests.json и index.json
-    std::ifstream requestsFile("../requests.json");
-    if (requestsFile.is_open()) {
-        if (requestsFile.peek() == std::ifstream::traits_type::eof()) {
-            std::cerr << "Error: requests.json is empty" << std::endl;
-            return {};
-        }
-        requestsFile >> requestsJson;
-        requestsFile.close();
-    } else {
-        std::cerr << "Error: Unable to open requests.json" << std::endl;
-        return {};
+/*
+ Рекурсивный спуск по лексемам булева запроса. Приоритет: NOT, AND, OR;
+ выражения подряд без оператора соединяются оператором по умолчанию
+ (OR или AND по режиму сервера). Лишние операторы и непарные скобки
+ пропускаются, слова из одних стоп-слов выпадают из дерева вместе со
+ своим местом в выражении. NOT остается в дереве как есть, а план
+ (QueryEvaluator::plan) делает его фильтром соседей, поэтому
+ a OR NOT b ищет то же, что a AND NOT b.
+*/
+class BooleanParser {
+private:
+    const std::vector<Lexeme>& lexemes;
+    size_t position = 0;
+    QueryOperator implicitOperator;
+    Tokenizer tokenizer;
+    const Analyzer& analyzer;
+    SearchQuery& query;
+    size_t& wordCount;
+    bool tooDeep = false;
+
+    bool at(LexemeKind kind) const { return position < lexemes.size() && lexemes[position].kind == kind; }
+
+    bool addTerm(std::string_view term, QueryNode& node) {
+        node.op = QueryOperator::Term;
+        node.index = static_cast<uint32_t>(query.terms.size());
+        query.terms.emplace_back(term);
+        return true;
     }
 
-    std::ifstream indexFile("../index.json");
-    if (indexFile.is_open()) {
-        if (indexFile.peek() == std::ifstream::traits_type::eof()) {
-            std::cerr << "Error: index.json is empty" << std::endl;
-            return {};
+    bool addWord(std::string_view word, QueryNode& node) {
+        TermPattern pattern;
+        if (parsePattern(word, tokenizer, analyzer, pattern)) {
+            node.op = QueryOperator::Pattern;
+            node.index = static_cast<uint32_t>(query.patterns.size());
+            query.patterns.push_back(std::move(pattern));
+            ++wordCount;
+            return true;
         }
-        indexFile >> indexJson;
-        indexFile.close();
-    } else {
-        std::cerr << "Error: Unable to open index.json" << std::endl;
-        return {};
+        std::string_view token;
+        tokenizer.reset(word);
+        bool found = tokenizer.next(token) && addTerm(token, node);
+        wordCount += tokenizer.wordCount();
+        return found;
     }
 
-    // Создание и сортировка вектора для каждого токена
-    for (const auto& [requestKey, tokens] : requestsJson.items()) {
-        std::vector<std::vector<int>> docIdList;
+    bool addPhrase(const Lexeme& lexeme, QueryNode& node) {
+        QueryPhrase phrase;
+        phrase.slop = lexeme.slop;
+        std::string_view token;
+        tokenizer.reset(lexeme.text);
+        while (tokenizer.next(token)) {
+            phrase.terms.emplace_back(token);
+        }
+        wordCount += tokenizer.wordCount();
+        if (phrase.terms.size() < 2) {
+            return !phrase.terms.empty() && addTerm(phrase.terms.front(), node);
+        }
+        query.terms.insert(query.terms.end(), phrase.terms.begin(), phrase.terms.end());
+        node.op = QueryOperator::Phrase;
+        node.index = static_cast<uint32_t>(query.phrases.size());
+        query.phrases.push_back(std::move(phrase));
+        return true;
+    }
 
-        for (const auto& token : tokens) {
-            int tokenId = token["id"];
-            std::vector<int> documentIds;
+    bool parseUnary(size_t depth, QueryNode& node) {
+        while (at(LexemeKind::And) || at(LexemeKind::Or)) {
+            ++position;
+        }
+        if (position >= lexemes.size() || at(LexemeKind::Close)) {
+            return false;
+        }
+        if (depth > MAX_QUERY_DEPTH) {
+            tooDeep = true;
+            position = lexemes.size();
+            return false;
+        }
+        const Lexeme& lexeme = lexemes[position++];
+        switch (lexeme.kind) {
+        case LexemeKind::Not: {
+            QueryNode operand;
+            if (!parseUnary(depth + 1, operand)) {
+                return false;
+            }
+            node = QueryNode();
+            node.op = QueryOperator::Not;
+            node.children.push_back(std::move(operand));
+            return true;
+        }
+        case LexemeKind::Open: {
+            bool found = parseList(depth + 1, node);
+            if (at(LexemeKind::Close)) {
+                ++position;
+            }
+            return found;
+        }
+        case LexemeKind::Phrase:
+            return addPhrase(lexeme, node);
+        default:
+            return addWord(lexeme.text, node);
+        }
+    }
 
-            if (tokenId == 0) {
+    bool parseBinary(size_t depth, QueryNode& node, LexemeKind kind) {
+        QueryOperator op = kind == LexemeKind::Or ? QueryOperator::Or : QueryOperator::And;
+        auto parseOperand = [&](QueryNode& operand) {
+            return kind == LexemeKind::Or ? parseBinary(depth, operand, LexemeKind::And) : parseUnary(depth, operand);
+        };
+        bool found = parseOperand(node);
+        while (at(kind)) {
+            ++position;
+            QueryNode right;
+            if (!parseOperand(right)) {
                 continue;
             }
+            if (found) {
+                joinNodes(op, node, std::move(right));
+            } else {
+                node = std::move(right);
+                found = true;
+            }
+        }
+        return found;
+    }
 
-            // Ищем tokenId в positional_index и собираем id документов
-            if (indexJson.contains("positional_index") &&
-                indexJson["positional_index"].contains(std::to_string(tokenId))) {
+    // Выражения до закрывающей скобки или конца запроса
+    bool parseList(size_t depth, QueryNode& node) {
+        bool found = false;
+        while (position < lexemes.size() && !at(LexemeKind::Close)) {
+            QueryNode item;
+            if (!parseBinary(depth, item, LexemeKind::Or)) {
+                continue;
+            }
+            if (found) {
+                joinNodes(implicitOperator, node, std::move(item));
+            } else {
+                node = std::move(item);
+                found = true;
+            }
+        }
+        return found;
+    }
 
-                for (const auto& [docId, positionInfo] : indexJson["positional_index"][std::to_string(tokenId)].items()) {
-                    documentIds.push_back(std::stoi(docId));
+public:
+    // Глубина вложенности скобок и NOT, глубже запрос считается ошибочным
+    static constexpr size_t MAX_QUERY_DEPTH = 16;
+
+    BooleanParser(const std::vector<Lexeme>& lexemes, QueryOperator implicitOperator, const Analyzer& analyzer,
+                  SearchQuery& query, size_t& wordCount)
+            : lexemes(lexemes), implicitOperator(implicitOperator), tokenizer(analyzer), analyzer(analyzer),
+              query(query), wordCount(wordCount) {}
+
+    // Дерево всего запроса, false - в запросе не осталось слов или он слишком глубок
+    bool parse(QueryNode& root) {
+        bool found = false;
+        while (position < lexemes.size()) {
+            QueryNode item;
+            if (parseList(0, item)) {
+                if (found) {
+                    joinNodes(implicitOperator, root, std::move(item));
+                } else {
+                    root = std::move(item);
+                    found = true;
                 }
-
-                // Сортируем documentIds по возрастанию
-                std::sort(documentIds.begin(), documentIds.end());
             }
-
-            docIdList.push_back(documentIds);
+            if (at(LexemeKind::Close)) {
+                ++position; // закрывающая скобка без открывающей
+            }
         }
+        return found && !tooDeep;
+    }
+};
+
+}
 
-        requestDocIds[requestKey] = docIdList;
+// Запрос с AND, OR, NOT или скобками разбирается в дерево, остальные - как слова и фразы
+static SearchQuery parseQuery(std::string_view request, const Analyzer& analyzer, QueryOperator implicitOperator,
+                              size_t& wordCount) {
+    std::vector<Lexeme> lexemes = splitLexemes(request);
+    bool boolean = std::any_of(lexemes.begin(), lexemes.end(), [](const Lexeme& lexeme) {
+        return lexeme.kind != LexemeKind::Word && lexeme.kind != LexemeKind::Phrase;
+    });
+    if (!boolean) {
+        return parseRequest(request, analyzer, wordCount);
     }
 
-    return requestDocIds;
+    SearchQuery query;
+    wordCount = 0;
+    auto root = std::make_shared<QueryNode>();
+    if (!BooleanParser(lexemes, implicitOperator, analyzer, query, wordCount).parse(*root)) {
+        return SearchQuery();
+    }
+    query.tree = std::move(root);
+    return query;
 }
 
-// Считает общие док айди токенов из запроса
-void SearchServer::countDocumentMatches(const std::unordered_map<std::string, std::vector<std::vector<int>>>& requestData) {
-    for (const auto& [requestKey, docIdLists] : requestData) {
-        std::cout << "Processing " << requestKey << ":\n";
-        if (docIdLists.size() <= 1) {
-            std::cout << "No matches to count." << std::endl;
-            continue;
-        }
+// Дерево запроса в ключ кэша: слова текстом, фразы и шаблоны номерами
+static void appendNode(std::string& key, const SearchQuery& query, const QueryNode& node) {
+    switch (node.op) {
+    case QueryOperator::Term:
+        key += 't';
+        key += query.terms[node.index];
+        key += '\x1F';
+        return;
+    case QueryOperator::Phrase:
+        key += 'p' + std::to_string(node.index) + '\x1F';
+        return;
+    case QueryOperator::Pattern:
+        key += 'w' + std::to_string(node.index) + '\x1F';
+        return;
+    case QueryOperator::And:
+        key += '&';
+        break;
+    case QueryOperator::Or:
+        key += '|';
+        break;
+    case QueryOperator::Not:
+        key += '!';
+        break;
+    }
+    key += '(';
+    for (const auto& child : node.children) {
+        appendNode(key, query, child);
+    }
+    key += ')';
+}
 
-        std::unordered_map<int, int> docCount;
+// предварительная обработка запросов
+std::vector<SearchQuery> SearchServer::processRequests(std::vector<std::string>& listRequests,
+                                                      const Analyzer& analyzer) {
+    // Ограничение размера вектора до 1000
+    if (listRequests.size() > 1000) {
+        listRequests.resize(1000);
+    }
 
-        // Подсчитываем вхождения каждого id документа
-        for (const auto& docIds : docIdLists) {
-            for (int docId : docIds) {
-                docCount[docId]++;
-            }
+    // Результирующий список обработанных запросов
+    std::vector<SearchQuery> processedRequests;
+
+    // Обработка каждого запроса
+    for (auto& request : listRequests) {
+        // Токенизация строки тем же токенизатором, что и при индексации
+        size_t wordCount = 0;
+        SearchQuery query = parseQuery(request, analyzer,
+                                       matchMode == MatchMode::All ? QueryOperator::And : QueryOperator::Or,
+                                       wordCount);
+
+        // Проверка количества слов до удаления стоп-слов (операторы и скобки не считаются),
+        // пустой запрос оставляем, чтобы ответы совпадали с запросами по номеру
+        if (wordCount < 1 || wordCount > (query.tree ? MAX_BOOLEAN_WORDS : MAX_REQUEST_WORDS)) {
+            query = SearchQuery();
         }
 
-        // Переносим данные из docCount в вектор пар для сортировки
-        std::vector<std::pair<int, int>> sortedDocCount(docCount.begin(), docCount.end());
+        // Добавление обработанного запроса в итоговый список
+        processedRequests.push_back(std::move(query));
+    }
+    return processedRequests;
+}
 
-        // Сортируем по убыванию количества совпадений
-        std::sort(sortedDocCount.begin(), sortedDocCount.end(),
-                  [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
-                      return a.second > b.second;
-                  });
+// Ранжирование документов одного запроса
+std::vector<std::pair<int, float>> SearchServer::searchRequest(const IndexSnapshot& snapshot,
+                                                               const SearchQuery& query,
+                                                               size_t responsesLimit) {
+    // Обход списков документ за документом с отсечением по WAND
+    QueryEvaluator evaluator(snapshot);
+    std::vector<ScoredDocument> best = query.tree ? evaluator.matchTree(query, responsesLimit, pruning)
+                                       : matchMode == MatchMode::All
+                                       ? evaluator.matchAll(query, responsesLimit)
+                                       : evaluator.matchAny(query, responsesLimit, pruning);
+
+    std::vector<std::pair<int, float>> result;
+    result.reserve(best.size());
+    for (const auto& [documentId, score] : best) {
+        result.emplace_back(static_cast<int>(documentId), static_cast<float>(score));
+    }
 
-        // Выводим отсортированный результат
-        for (const auto& [docId, count] : sortedDocCount) {
-            std::cout << "Document ID: " << docId << " - Matches: " << count << "\n";
+    // Ранг - релевантность относительно лучшего документа запроса
+    if (!result.empty() && result.front().second > 0) {
+        float maxScore = result.front().second;
+        for (auto& [documentId, rank] : result) {
+            rank /= maxScore;
         }
     }
+    return result;
 }
 
-// Подсчет позиций токенов в документах
-void SearchServer::calculatePositionDifference(const json& requestsJson, const json& indexJson) {
-    for (const auto& [requestKey, tokens] : requestsJson.items()) {
-        if (tokens.size() < 2) {
-            continue;
+std::string SearchServer::cacheKey(const SearchQuery& query, size_t responsesLimit) const {
+    // Повторы слова читаются одним курсором и не меняют ответ, поэтому в ключ идет
+    // только первое вхождение. Порядок слов сохраняется: от него зависит бонус близости
+    std::string key;
+    key += matchMode == MatchMode::All ? 'A' : 'O';
+    key += pruning ? 'W' : 'E';
+    key += std::to_string(responsesLimit);
+    std::vector<std::string_view> seen;
+    for (const auto& term : query.terms) {
+        if (std::find(seen.begin(), seen.end(), term) == seen.end()) {
+            seen.push_back(term);
+            key += '\x1F';
+            key += term;
         }
+    }
+    for (const auto& pattern : query.patterns) {
+        key += '\x1D';
+        key += pattern.kind == PatternKind::Fuzzy ? '~' : '*';
+        key += std::to_string(pattern.distance);
+        key += '\x1F';
+        key += pattern.text;
+    }
+    for (const auto& phrase : query.phrases) {
+        key += '\x1E';
+        key += std::to_string(phrase.slop);
+        for (const auto& term : phrase.terms) {
+            key += '\x1F';
+            key += term;
+        }
+    }
+    if (query.tree) {
+        key += '\x1C';
+        appendNode(key, query, *query.tree);
+    }
+    return key;
+}
 
-        std::cout << "Processing request for: " << requestKey << std::endl;
-
-        for (size_t i = 0; i < tokens.size(); ++i) {
-            int tokenId = tokens[i]["id"];
-            if (tokenId == 0) continue;
+void SearchServer::setThreadCount(unsigned count) {
+    threadCount = count;
+    pool.reset();
+}
 
-            // Ищем позицию токенов в positional_index
-            if (indexJson.contains("positional_index") &&
-                indexJson["positional_index"].contains(std::to_string(tokenId))) {
+unsigned SearchServer::getThreadCount() const {
+    if (threadCount > 0) {
+        return threadCount;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
 
-                for (const auto& [docId, positions] : indexJson["positional_index"][std::to_string(tokenId)].items()) {
-                    std::cout << "Token " << tokenId << " in doc " << docId << " positions: ";
-                    for (const auto& position : positions) {
-                        std::cout << position << " ";
-                    }
-                    std::cout << std::endl;
-                }
+std::vector<std::vector<std::pair<int, float>>> SearchServer::search(const IndexSnapshot& snapshot,
+                                                                     const std::vector<SearchQuery>& requests,
+                                                                     int responsesLimit) {
+    if (!pool) {
+        pool = std::make_unique<ThreadPool>(getThreadCount());
+    }
+    size_t limit = static_cast<size_t>(std::max(responsesLimit, 0));
+
+    // Запросы только читают снимок, поэтому каждый пишет лишь в свою ячейку ответа
+    std::vector<std::vector<std::pair<int, float>>> answers(requests.size());
+    latencies.assign(requests.size(), 0.0);
+    auto batchStart = std::chrono::steady_clock::now();
+    pool->run(requests.size(), [&](size_t index, unsigned) {
+        auto start = std::chrono::steady_clock::now();
+        const SearchQuery& query = requests[index];
+        if ((query.terms.empty() && query.patterns.empty()) || !cache.enabled()) {
+            answers[index] = searchRequest(snapshot, query, limit);
+        } else {
+            std::string key = cacheKey(query, limit);
+            if (!cache.lookup(key, snapshot.generation(), answers[index])) {
+                answers[index] = searchRequest(snapshot, query, limit);
+                cache.store(key, snapshot.generation(), answers[index]);
             }
         }
-    }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        latencies[index] = std::chrono::duration<double, std::milli>(elapsed).count();
+        Metrics::global().recordQuery(static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    });
+    batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    return answers;
 }
 
-// Метод для обработки запросов
-void SearchServer::processQueries() {
-    // handleUserQueryAndSave();
-
-    auto requestData = findDocumentIdsForTokens();
-    countDocumentMatches(requestData);
-
-    json requestsJson;
-    json indexJson;
+std::vector<std::vector<std::string>> SearchServer::snippets(
+        const IndexSnapshot& snapshot, const std::vector<SearchQuery>& requests,
+        const std::vector<std::vector<std::pair<int, float>>>& answers) {
+    if (!pool) {
+        pool = std::make_unique<ThreadPool>(getThreadCount());
+    }
+    SnippetBuilder builder(snapshot);
+    std::vector<std::vector<std::string>> result(requests.size());
+    pool->run(std::min(requests.size(), answers.size()), [&](size_t index, unsigned) {
+        result[index] = builder.build(requests[index], answers[index]);
+    });
+    return result;
+}
 
-    std::ifstream requestsFile("../requests.json");
-    if (requestsFile.is_open()) {
-        requestsFile >> requestsJson;
-        requestsFile.close();
+// Вывод времени пакета, QPS и самого долгого запроса
+void SearchServer::printStatistics() const {
+    if (latencies.empty()) {
+        return;
     }
+    auto slowest = std::max_element(latencies.begin(), latencies.end());
+    double total = 0;
+    for (double latency : latencies) {
+        total += latency;
+    }
+    std::cout << "Processed " << latencies.size() << " requests on " << pool->size() << " threads in "
+              << batchSeconds * 1000 << " ms, " << (batchSeconds > 0 ? latencies.size() / batchSeconds : 0.0)
+              << " QPS, latency avg " << total / latencies.size() << " ms, max " << *slowest
+              << " ms (request" << (slowest - latencies.begin()) << ")" << std::endl;
+}
 
-    std::ifstream indexFile("../index.json");
-    if (indexFile.is_open()) {
-        indexFile >> indexJson;
-        indexFile.close();
+// Метод для обработки запросов
+void SearchServer::processQueries(ConverterJSON& converter) {
+    // Сегменты отображаются в память, списки читаются по требованию
+    IndexSnapshot snapshot;
+    if (!snapshot.openPublished()) {
+        std::cerr << "Error: Unable to open the index published in index.manifest" << std::endl;
+        return;
+    }
+    if (!snapshot.setAnalyzer(converter.getAnalyzer())) {
+        std::cerr << "Error: The index was built with analyzer settings other than in config.json" << std::endl;
+        return;
     }
+    if (converter.getSnippets() && !snapshot.loadDocuments()) {
+        std::cerr << "Error: Unable to load the document state, snippets are empty" << std::endl;
+    }
+
+    std::vector<std::string> listRequests = converter.GetRequests();
+    std::vector<SearchQuery> requests = processRequests(listRequests, snapshot.analyzer());
 
-    calculatePositionDifference(requestsJson, indexJson);
-}
\ No newline at end of file
+    cache.setCapacity(converter.getQueryCacheLimit());
+    auto answers = search(snapshot, requests, converter.GetResponsesLimit());
+    if (converter.getSnippets()) {
+        auto answerSnippets = snippets(snapshot, requests, answers);
+        converter.putAnswers(answers, &answerSnippets);
+    } else {
+        converter.putAnswers(answers);
+    }
+    printStatistics();
+}
@@ -15,26 +15,78 @@
 #include <thread>
 #include <mutex>
 #include <future>
+#include <chrono>
+#include <cmath>
+#include <queue>
+#include "IndexSnapshot.h"
+#include "QueryCache.h"
+#include "QueryEvaluator.h"
+#include "SnippetBuilder.h"
+#include "ThreadPool.h"
+#include "Tokenizer.h"
+#include "ConverterJSON.h"
 
 using json = nlohmann::json;
 
+// Any - документ содержит хотя бы одно слово запроса, All - все слова
+enum class MatchMode {
+    Any,
+    All
+};
+
 class SearchServer {
 private:
     std::mutex mutex;
-    using RequestData = std::unordered_map<std::string, std::vector<std::vector<int>>>;
-    std::unordered_set<std::string> stopWords = {"the", "is", "at", "which", "on", "in", "and", "a", "to", "ah"};
-    void countDocumentMatches(const std::unordered_map<std::string, std::vector<std::vector<int>>>& requestData);
-    void calculatePositionDifference(const json& requestsJson, const json& indexJson);
+    MatchMode matchMode = MatchMode::Any;
+    bool pruning = true;
+    unsigned threadCount = 0;
+    // Пул создается при первом пакете и живет между пакетами
+    std::unique_ptr<ThreadPool> pool;
+    // Готовые ответы по нормализованному запросу для текущего снимка
+    QueryCache cache;
+    // Время выполнения каждого запроса последнего пакета (мс) и всего пакета (с)
+    std::vector<double> latencies;
+    double batchSeconds = 0;
+
+    std::vector<std::pair<int, float>> searchRequest(const IndexSnapshot& snapshot,
+                                                     const SearchQuery& query,
+                                                     size_t responsesLimit);
+    // Ключ кэша: запрос после токенизации и все настройки, от которых зависит ответ
+    std::string cacheKey(const SearchQuery& query, size_t responsesLimit) const;
 
 public:
     SearchServer() = default;
-    std::vector<std::vector<std::string>> processRequests(std::vector<std::string>& listRequests);
-    int findTermID(const json& indexJson, const std::string& token);
-    void toLowercase(std::vector<std::string>& tokens);
-    void removeStopWords(std::vector<std::string>& tokens);
-    std::vector<std::string> tokenize(const std::string& text);
-    void processQueries();
-    RequestData findDocumentIdsForTokens();
+    void setMatchMode(MatchMode mode) { matchMode = mode; }
+    // false - оценка всех документов без WAND, для сравнения результатов и скорости
+    void setPruning(bool enabled) { pruning = enabled; }
+    // Количество потоков поиска (0 - по числу ядер)
+    void setThreadCount(unsigned count);
+    unsigned getThreadCount() const;
+    // Бюджет кэша ответов в байтах, 0 - без кэша
+    void setCacheCapacity(size_t bytes) { cache.setCapacity(bytes); }
+    QueryCache& getCache() { return cache; }
+    // Запросы из requests.json: слова, фразы в кавычках и шаблоны (слово*, сл?во, слово~N),
+    // связанные операторами AND, OR, NOT и скобками; без оператора - по режиму сервера.
+    // NOT всегда вычитает из соседних выражений, даже под OR: a OR NOT b выполняется
+    // как a AND NOT b, а запрос из одних NOT ничего не находит.
+    // Слова нормализуются тем же Analyzer, что и документы индекса
+    std::vector<SearchQuery> processRequests(std::vector<std::string>& listRequests, const Analyzer& analyzer);
+    // Ранжирование документов по BM25 и близости слов, не более responsesLimit документов на запрос.
+    // Запросы пакета выполняются параллельно, ответы идут в порядке запросов
+    std::vector<std::vector<std::pair<int, float>>> search(const IndexSnapshot& snapshot,
+                                                           const std::vector<SearchQuery>& requests,
+                                                           int responsesLimit);
+    // Сниппеты документов каждого ответа с выделенными словами запроса (SnippetBuilder),
+    // запросы пакета обрабатываются параллельно
+    std::vector<std::vector<std::string>> snippets(const IndexSnapshot& snapshot,
+                                                   const std::vector<SearchQuery>& requests,
+                                                   const std::vector<std::vector<std::pair<int, float>>>& answers);
+    // Статистика последнего пакета
+    const std::vector<double>& getLatencies() const { return latencies; }
+    double getBatchSeconds() const { return batchSeconds; }
+    void printStatistics() const;
+    // Поиск по requests.json и запись ответов в answers.json
+    void processQueries(ConverterJSON& converter);
 };
 
 #endif // SEARCH_SERVER_H
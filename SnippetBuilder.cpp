@@ -0,0 +1,314 @@
+#include "SnippetBuilder.h"
+#include "MappedFile.h"
+#include "Tokenizer.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <numeric>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr const char* REPLACEMENT_CHARACTER = "\xEF\xBF\xBD";
+
+// Слова и шаблоны листьев дерева, кроме стоящих под NOT
+void collectWords(const SearchQuery& query, const QueryNode& node, bool negated,
+                  std::vector<std::string>& terms, std::vector<const TermPattern*>& patterns) {
+    switch (node.op) {
+        case QueryOperator::Term:
+            if (!negated) {
+                terms.push_back(query.terms[node.index]);
+            }
+            break;
+        case QueryOperator::Phrase:
+            if (!negated) {
+                const auto& phraseTerms = query.phrases[node.index].terms;
+                terms.insert(terms.end(), phraseTerms.begin(), phraseTerms.end());
+            }
+            break;
+        case QueryOperator::Pattern:
+            if (!negated) {
+                patterns.push_back(&query.patterns[node.index]);
+            }
+            break;
+        case QueryOperator::Not:
+            for (const QueryNode& child : node.children) {
+                collectWords(query, child, !negated, terms, patterns);
+            }
+            break;
+        default:
+            for (const QueryNode& child : node.children) {
+                collectWords(query, child, negated, terms, patterns);
+            }
+            break;
+    }
+}
+
+// Пунктуация ASCII по краям слова в выделение не попадает
+bool isPunctuation(char c) {
+    return static_cast<unsigned char>(c) < 0x80 && std::ispunct(static_cast<unsigned char>(c));
+}
+
+// Длина правильной последовательности UTF-8 с первого байта >= 0x80, 0 - последовательность
+// ошибочна: лишнее продолжение, обрыв, избыточная запись, суррогат или символ за U+10FFFF
+size_t sequenceLength(const uint8_t* data, const uint8_t* end) {
+    uint8_t lead = data[0];
+    size_t length = 0;
+    uint8_t low = 0x80;
+    uint8_t high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        length = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        length = 3;
+        low = lead == 0xE0 ? 0xA0 : low;
+        high = lead == 0xED ? 0x9F : high;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        length = 4;
+        low = lead == 0xF0 ? 0x90 : low;
+        high = lead == 0xF4 ? 0x8F : high;
+    } else {
+        return 0;
+    }
+    if (static_cast<size_t>(end - data) < length || data[1] < low || data[1] > high) {
+        return 0;
+    }
+    for (size_t i = 2; i < length; ++i) {
+        if ((data[i] & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return length;
+}
+
+// Текст документа в сниппет. Сниппет - HTML с тегами выделения, поэтому &, <, > и "
+// документа экранируются и не смешиваются с ними. Ответы - JSON, поэтому байты, которые
+// не складываются в UTF-8 (документ в Latin-1 и т. п.), заменяются на U+FFFD
+void appendText(std::string& out, const char* begin, const char* end) {
+    const auto* data = reinterpret_cast<const uint8_t*>(begin);
+    const auto* dataEnd = reinterpret_cast<const uint8_t*>(end);
+    while (data < dataEnd) {
+        if (*data < 0x80) {
+            switch (*data) {
+                case '&': out += "&amp;"; break;
+                case '<': out += "&lt;"; break;
+                case '>': out += "&gt;"; break;
+                case '"': out += "&quot;"; break;
+                default: out += static_cast<char>(*data); break;
+            }
+            ++data;
+            continue;
+        }
+        size_t length = sequenceLength(data, dataEnd);
+        if (length == 0) {
+            out += REPLACEMENT_CHARACTER;
+            ++data;
+            continue;
+        }
+        out.append(reinterpret_cast<const char*>(data), length);
+        data += length;
+    }
+}
+
+// Файл тот же, что при индексации: размер и время изменения совпали, а при другом
+// времени - хеш содержимого, как при инкрементальном обновлении
+bool unchangedSinceIndexing(const std::string& path, const MappedFile& file, const DocumentRecord& record) {
+    if (file.size() != record.size) {
+        return false;
+    }
+    std::error_code error;
+    int64_t modified = fs::last_write_time(path, error).time_since_epoch().count();
+    if (!error && modified == record.modified) {
+        return true;
+    }
+    return DocumentState::hashContent(file.view()) == record.contentHash;
+}
+
+} // namespace
+
+SnippetBuilder::SnippetBuilder(const IndexSnapshot& snapshot) : snapshot(snapshot) {}
+
+// Курсор на каждое слово запроса; шаблон раскрывается так же, как при поиске, и читается одним курсором
+std::vector<SnapshotPostings> SnippetBuilder::queryWords(const SearchQuery& query) const {
+    std::vector<std::string> terms;
+    std::vector<const TermPattern*> patterns;
+    if (query.tree) {
+        collectWords(query, *query.tree, false, terms, patterns);
+    } else {
+        terms = query.terms;
+        for (const TermPattern& pattern : query.patterns) {
+            patterns.push_back(&pattern);
+        }
+    }
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    std::vector<SnapshotPostings> words;
+    words.reserve(terms.size() + patterns.size());
+    for (const std::string& term : terms) {
+        words.push_back(snapshot.postings(term));
+    }
+    for (const TermPattern* pattern : patterns) {
+        words.push_back(snapshot.postings(snapshot.expand(*pattern, QueryEvaluator::MAX_EXPANSIONS)));
+    }
+    return words;
+}
+
+void SnippetBuilder::densestWindow(const std::vector<Match>& matches, size_t wordCount, uint32_t length,
+                                   uint32_t& first, uint32_t& last) {
+    first = 0;
+    last = std::min(length, SNIPPET_TOKENS);
+    if (matches.empty()) {
+        return;
+    }
+    // Скользящее окно по вхождениям: сначала больше разных слов, затем больше вхождений
+    std::vector<uint32_t> counts(wordCount, 0);
+    size_t distinct = 0;
+    size_t begin = 0;
+    size_t bestDistinct = 0;
+    size_t bestCount = 0;
+    size_t bestBegin = 0;
+    size_t bestEnd = 0;
+    for (size_t end = 0; end < matches.size(); ++end) {
+        if (counts[matches[end].word]++ == 0) {
+            ++distinct;
+        }
+        while (matches[end].position - matches[begin].position >= SNIPPET_TOKENS) {
+            if (--counts[matches[begin].word] == 0) {
+                --distinct;
+            }
+            ++begin;
+        }
+        size_t count = end - begin + 1;
+        if (distinct > bestDistinct || (distinct == bestDistinct && count > bestCount)) {
+            bestDistinct = distinct;
+            bestCount = count;
+            bestBegin = begin;
+            bestEnd = end;
+        }
+    }
+
+    // Вхождения ставятся в середину окна, у границ документа окно сдвигается внутрь
+    uint32_t from = matches[bestBegin].position;
+    uint32_t to = matches[bestEnd].position + 1;
+    uint32_t spare = SNIPPET_TOKENS - (to - from);
+    first = from > spare / 2 ? from - spare / 2 : 0;
+    last = std::min(length, first + SNIPPET_TOKENS);
+    first = last > SNIPPET_TOKENS ? std::min(first, last - SNIPPET_TOKENS) : 0;
+}
+
+std::string SnippetBuilder::cut(uint32_t documentId, const std::vector<Match>& matches, size_t wordCount) const {
+    uint32_t length = 0;
+    const uint8_t* record = snapshot.tokenOffsets(documentId, length);
+    const std::string& path = snapshot.documentPath(documentId);
+    const DocumentRecord* state = snapshot.documentRecord(documentId);
+    if (record == nullptr || state == nullptr) {
+        return {};
+    }
+    uint32_t first = 0;
+    uint32_t last = 0;
+    densestWindow(matches, wordCount, length, first, last);
+    MappedFile file;
+    // Границы токенов верны только для той версии файла, которая проиндексирована
+    if (first >= last || !file.open(path) || !unchangedSinceIndexing(path, file, *state)) {
+        return {};
+    }
+    const char* text = file.view().data();
+
+    // Запись читается от ближайшей контрольной точки до конца окна
+    TokenOffsetReader reader(record);
+    reader.seek(first);
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    std::string snippet = first > 0 ? "... " : "";
+    size_t match = 0;
+    uint64_t previousEnd = 0;
+    for (uint32_t position = first; position < last; ++position) {
+        reader.next(begin, end);
+        if (end > file.size()) {
+            return {}; // запись не от этой версии файла
+        }
+        // Между токенами - пробелы и стоп-слова, пробельные символы сжимаются в один пробел
+        if (position > first) {
+            uint64_t i = previousEnd;
+            while (i < begin) {
+                if (Tokenizer::isSpace(text[i])) {
+                    if (snippet.back() != ' ') {
+                        snippet += ' ';
+                    }
+                    ++i;
+                    continue;
+                }
+                uint64_t wordEnd = i;
+                while (wordEnd < begin && !Tokenizer::isSpace(text[wordEnd])) {
+                    ++wordEnd;
+                }
+                appendText(snippet, text + i, text + wordEnd);
+                i = wordEnd;
+            }
+        }
+        previousEnd = end;
+
+        while (match < matches.size() && matches[match].position < position) {
+            ++match;
+        }
+        if (match == matches.size() || matches[match].position != position) {
+            appendText(snippet, text + begin, text + end);
+            continue;
+        }
+        uint64_t wordBegin = begin;
+        uint64_t wordEnd = end;
+        while (wordBegin < wordEnd && isPunctuation(text[wordBegin])) {
+            ++wordBegin;
+        }
+        while (wordEnd > wordBegin && isPunctuation(text[wordEnd - 1])) {
+            --wordEnd;
+        }
+        if (wordBegin == wordEnd) {
+            wordBegin = begin;
+            wordEnd = end;
+        }
+        appendText(snippet, text + begin, text + wordBegin);
+        snippet += HIGHLIGHT_BEGIN;
+        appendText(snippet, text + wordBegin, text + wordEnd);
+        snippet += HIGHLIGHT_END;
+        appendText(snippet, text + wordEnd, text + end);
+    }
+    if (last < length) {
+        snippet += " ...";
+    }
+    return snippet;
+}
+
+std::vector<std::string> SnippetBuilder::build(const SearchQuery& query,
+                                               const std::vector<std::pair<int, float>>& answer) const {
+    std::vector<std::string> snippets(answer.size());
+    std::vector<SnapshotPostings> words = queryWords(query);
+
+    // Курсоры идут только вперед, поэтому документы обходятся по возрастанию id
+    std::vector<size_t> order(answer.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return answer[a].first < answer[b].first;
+    });
+    std::vector<Match> matches;
+    std::vector<uint32_t> positions;
+    for (size_t index : order) {
+        uint32_t documentId = static_cast<uint32_t>(answer[index].first);
+        matches.clear();
+        for (size_t word = 0; word < words.size(); ++word) {
+            if (!words[word].advance(documentId) || words[word].documentId() != documentId) {
+                continue;
+            }
+            words[word].readPositions(positions);
+            for (uint32_t position : positions) {
+                matches.push_back({position, static_cast<uint32_t>(word)});
+            }
+        }
+        std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+            return a.position < b.position;
+        });
+        snippets[index] = cut(documentId, matches, words.size());
+    }
+    return snippets;
+}
@@ -0,0 +1,56 @@
+#ifndef SNIPPETBUILDER_H
+#define SNIPPETBUILDER_H
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "IndexSnapshot.h"
+#include "QueryEvaluator.h"
+
+/*
+ Сниппеты найденных документов с выделенными словами запроса.
+
+ Позиции слов в документе берутся из списков индекса (один advance на слово),
+ из них выбирается окно SNIPPET_TOKENS токенов, где больше всего разных слов
+ запроса. Границы токенов окна читаются из записи TokenOffsets сегмента от
+ ближайшей контрольной точки, а текст вырезается прямо из отображения файла
+ документа, без повторного разбора. Сниппет - HTML: текст документа экранирован,
+ теги в нем - только выделение. Слова под NOT не выделяются. Если сегмент
+ хранит индекс без границ токенов или файл изменился после индексации (размер,
+ время изменения и хеш из index.state снимка), сниппет пустой.
+*/
+class SnippetBuilder {
+private:
+    // Длина окна сниппета в токенах
+    static constexpr uint32_t SNIPPET_TOKENS = 24;
+
+    const IndexSnapshot& snapshot;
+
+    // Вхождение слова запроса: позиция в документе и номер слова
+    struct Match {
+        uint32_t position;
+        uint32_t word;
+    };
+
+    std::vector<SnapshotPostings> queryWords(const SearchQuery& query) const;
+    // Начало и конец окна [first, last) с самым плотным скоплением разных слов
+    static void densestWindow(const std::vector<Match>& matches, size_t wordCount, uint32_t length,
+                              uint32_t& first, uint32_t& last);
+    std::string cut(uint32_t documentId, const std::vector<Match>& matches, size_t wordCount) const;
+
+public:
+    // Выделение слов запроса в тексте сниппета; других тегов в сниппете нет
+    static constexpr const char* HIGHLIGHT_BEGIN = "<b>";
+    static constexpr const char* HIGHLIGHT_END = "</b>";
+
+    // Файлы документов и их состояние берутся из снимка (IndexSnapshot::loadDocuments)
+    explicit SnippetBuilder(const IndexSnapshot& snapshot);
+
+    // Сниппеты документов ответа в его порядке, пустая строка - сниппета нет
+    std::vector<std::string> build(const SearchQuery& query, const std::vector<std::pair<int, float>>& answer) const;
+};
+
+#endif // SNIPPETBUILDER_H
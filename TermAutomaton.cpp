@@ -0,0 +1,395 @@
+#include "TermAutomaton.h"
+#include <algorithm>
+#include <cstring>
+
+// uint32 число термов, uint8 флаг конечного, uint16 число переходов
+static constexpr size_t STATE_HEADER = 7;
+
+template <typename T>
+static T readValue(const uint8_t* position) {
+    T value;
+    std::memcpy(&value, position, sizeof(T));
+    return value;
+}
+
+template <typename T>
+static void appendValue(std::string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// FNV-1a по записи состояния
+static uint64_t hashRecord(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static size_t recordSize(const std::string& states, uint32_t offset) {
+    uint16_t transitionCount;
+    std::memcpy(&transitionCount, states.data() + offset + 5, sizeof(transitionCount));
+    return STATE_HEADER + transitionCount * 5u;
+}
+
+TermAutomatonBuilder::TermAutomatonBuilder() : states(sizeof(uint32_t), '\0'), registry(1024, 0) {
+    path.emplace_back();
+}
+
+void TermAutomatonBuilder::add(std::string_view term) {
+    size_t common = 0;
+    while (common < previous.size() && common < term.size() && previous[common] == term[common]) {
+        ++common;
+    }
+    if (common == term.size() && common == previous.size() && path.size() == term.size() + 1 &&
+        path.back().final) {
+        return;
+    }
+    // Суффикс предыдущего терма после общего префикса уже не изменится
+    freezeTail(common);
+    for (size_t i = common; i < term.size(); ++i) {
+        path.back().transitions.emplace_back(static_cast<uint8_t>(term[i]), 0);
+        path.emplace_back();
+    }
+    path.back().final = true;
+    previous.assign(term);
+}
+
+void TermAutomatonBuilder::freezeTail(size_t depth) {
+    while (path.size() > depth + 1) {
+        uint32_t offset = freeze(path.back());
+        path.pop_back();
+        path.back().transitions.back().second = offset;
+    }
+}
+
+// Запись состояния; такое же уже записанное состояние используется повторно
+uint32_t TermAutomatonBuilder::freeze(const PendingState& state) {
+    uint32_t words = state.final ? 1 : 0;
+    for (const auto& [label, target] : state.transitions) {
+        words += readValue<uint32_t>(reinterpret_cast<const uint8_t*>(states.data()) + target);
+    }
+    record.clear();
+    appendValue(record, words);
+    appendValue(record, static_cast<uint8_t>(state.final));
+    appendValue(record, static_cast<uint16_t>(state.transitions.size()));
+    for (const auto& [label, target] : state.transitions) {
+        record.push_back(static_cast<char>(label));
+    }
+    for (const auto& [label, target] : state.transitions) {
+        appendValue(record, target);
+    }
+
+    size_t mask = registry.size() - 1;
+    size_t slot = hashRecord(record.data(), record.size()) & mask;
+    while (registry[slot] != 0) {
+        uint32_t offset = registry[slot] - 1;
+        if (recordSize(states, offset) == record.size() &&
+            std::memcmp(states.data() + offset, record.data(), record.size()) == 0) {
+            return offset;
+        }
+        slot = (slot + 1) & mask;
+    }
+    uint32_t offset = static_cast<uint32_t>(states.size());
+    states += record;
+    registry[slot] = offset + 1;
+    if (++registered * 2 > registry.size()) {
+        growRegistry();
+    }
+    return offset;
+}
+
+void TermAutomatonBuilder::growRegistry() {
+    std::vector<uint32_t> old(registry.size() * 2, 0);
+    old.swap(registry);
+    size_t mask = registry.size() - 1;
+    for (uint32_t entry : old) {
+        if (entry == 0) {
+            continue;
+        }
+        size_t slot = hashRecord(states.data() + entry - 1, recordSize(states, entry - 1)) & mask;
+        while (registry[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        registry[slot] = entry;
+    }
+}
+
+std::string TermAutomatonBuilder::finish() {
+    freezeTail(0);
+    uint32_t root = freeze(path.front());
+    std::memcpy(states.data(), &root, sizeof(root));
+
+    std::string result = std::move(states);
+    states.assign(sizeof(uint32_t), '\0');
+    registry.assign(1024, 0);
+    registered = 0;
+    path.assign(1, PendingState());
+    previous.clear();
+    return result;
+}
+
+TermAutomaton::TermAutomaton(const uint8_t* data, size_t size) {
+    if (data == nullptr || size < sizeof(uint32_t) + STATE_HEADER) {
+        return;
+    }
+    uint32_t rootOffset = readValue<uint32_t>(data);
+    if (rootOffset + STATE_HEADER <= size) {
+        this->data = data;
+        this->size = size;
+        root = rootOffset;
+    }
+}
+
+uint32_t TermAutomaton::State::target(uint32_t index) const {
+    return readValue<uint32_t>(targets + index * sizeof(uint32_t));
+}
+
+TermAutomaton::State TermAutomaton::state(uint32_t offset) const {
+    const uint8_t* position = data + offset;
+    State result {};
+    result.words = readValue<uint32_t>(position);
+    result.final = position[4] != 0;
+    result.transitionCount = readValue<uint16_t>(position + 5);
+    result.labels = position + STATE_HEADER;
+    result.targets = result.labels + result.transitionCount;
+    return result;
+}
+
+uint32_t TermAutomaton::wordCount(uint32_t offset) const {
+    return readValue<uint32_t>(data + offset);
+}
+
+bool TermAutomaton::find(std::string_view term, uint32_t& ordinal) const {
+    if (empty()) {
+        return false;
+    }
+    // Номер терма - число термов, которые меньше него: конечные состояния на пути
+    // и все термы под переходами с меньшими метками
+    uint32_t offset = root;
+    uint32_t base = 0;
+    for (char c : term) {
+        State current = state(offset);
+        base += current.final ? 1 : 0;
+        uint8_t label = static_cast<uint8_t>(c);
+        uint32_t index = 0;
+        while (index < current.transitionCount && current.labels[index] < label) {
+            base += wordCount(current.target(index));
+            ++index;
+        }
+        if (index == current.transitionCount || current.labels[index] != label) {
+            return false;
+        }
+        offset = current.target(index);
+    }
+    if (!state(offset).final) {
+        return false;
+    }
+    ordinal = base;
+    return true;
+}
+
+namespace {
+
+bool isContinuation(uint8_t byte) {
+    return (byte & 0xC0) == 0x80;
+}
+
+/*
+ Обход автомата вместе с НКА шаблона: узел 2p - шаблон прочитан до позиции p,
+ 2p + 1 - то же, но '?' на позиции p - 1 еще дочитывает байты продолжения
+ своего символа UTF-8. Ветка автомата отбрасывается, как только множество
+ узлов НКА становится пустым.
+*/
+class WildcardWalk {
+private:
+    const TermAutomaton& automaton;
+    std::string_view pattern;
+    size_t limit;
+    std::vector<TermMatch>& matches;
+    std::vector<std::vector<uint32_t>> sets;
+
+    void close(std::vector<uint32_t>& set, uint32_t node) const {
+        if (std::find(set.begin(), set.end(), node) != set.end()) {
+            return;
+        }
+        set.push_back(node);
+        uint32_t position = node / 2;
+        if (node % 2 == 1) {
+            close(set, position * 2);
+        } else if (position < pattern.size() && pattern[position] == '*') {
+            close(set, (position + 1) * 2);
+        }
+    }
+
+    void step(const std::vector<uint32_t>& set, uint8_t byte, std::vector<uint32_t>& next) const {
+        next.clear();
+        for (uint32_t node : set) {
+            uint32_t position = node / 2;
+            if (node % 2 == 1) {
+                if (isContinuation(byte)) {
+                    close(next, node);
+                }
+                continue;
+            }
+            if (position >= pattern.size()) {
+                continue;
+            }
+            char symbol = pattern[position];
+            if (symbol == '*') {
+                close(next, node);
+            } else if (symbol == '?') {
+                if (!isContinuation(byte)) {
+                    close(next, (position + 1) * 2 + 1);
+                }
+            } else if (static_cast<uint8_t>(symbol) == byte) {
+                close(next, (position + 1) * 2);
+            }
+        }
+    }
+
+    bool accepts(const std::vector<uint32_t>& set) const {
+        return std::find(set.begin(), set.end(), static_cast<uint32_t>(pattern.size() * 2)) != set.end();
+    }
+
+public:
+    WildcardWalk(const TermAutomaton& automaton, std::string_view pattern, size_t limit,
+                 std::vector<TermMatch>& matches)
+            : automaton(automaton), pattern(pattern), limit(limit), matches(matches) {}
+
+    void run(uint32_t root) {
+        sets.resize(1);
+        close(sets[0], 0);
+        walk(root, 0, 0);
+    }
+
+    void walk(uint32_t offset, uint32_t ordinal, size_t depth) {
+        TermAutomaton::State current = automaton.state(offset);
+        if (current.final && accepts(sets[depth])) {
+            matches.push_back({ordinal, 0});
+        }
+        if (sets.size() < depth + 2) {
+            sets.resize(depth + 2);
+        }
+        uint32_t base = ordinal + (current.final ? 1 : 0);
+        for (uint32_t i = 0; i < current.transitionCount && matches.size() < limit; ++i) {
+            uint32_t target = current.target(i);
+            step(sets[depth], current.labels[i], sets[depth + 1]);
+            if (!sets[depth + 1].empty()) {
+                walk(target, base, depth + 1);
+            }
+            base += automaton.wordCount(target);
+        }
+    }
+};
+
+/*
+ Обход автомата с автоматом Левенштейна в виде строк таблицы динамического
+ программирования: строка после каждого символа пути - расстояния от
+ прочитанного префикса до всех префиксов слова. Если минимум строки больше
+ допустимого расстояния, ни одно продолжение ветки не подойдет. Строки
+ считаются по символам UTF-8, байты символа копятся до его конца.
+ Обход отбирает термы ровно на расстоянии maxDistance: более близкие
+ находят обходы с меньшим расстоянием.
+*/
+class FuzzyWalk {
+private:
+    const TermAutomaton& automaton;
+    std::vector<uint32_t> word;
+    uint32_t maxDistance;
+    size_t limit;
+    std::vector<TermMatch>& matches;
+    std::vector<std::vector<uint32_t>> rows;
+
+    // Строка row + 1 после символа codePoint, false - ветку можно отбросить
+    bool advanceRow(size_t row, uint32_t codePoint) {
+        if (rows.size() < row + 2) {
+            rows.resize(row + 2);
+        }
+        const std::vector<uint32_t>& previous = rows[row];
+        std::vector<uint32_t>& next = rows[row + 1];
+        next.resize(word.size() + 1);
+        next[0] = previous[0] + 1;
+        uint32_t best = next[0];
+        for (size_t j = 1; j <= word.size(); ++j) {
+            uint32_t substitution = previous[j - 1] + (word[j - 1] == codePoint ? 0 : 1);
+            next[j] = std::min({previous[j] + 1, next[j - 1] + 1, substitution});
+            best = std::min(best, next[j]);
+        }
+        return best <= maxDistance;
+    }
+
+public:
+    FuzzyWalk(const TermAutomaton& automaton, std::string_view text, uint32_t maxDistance, size_t limit,
+              std::vector<TermMatch>& matches)
+            : automaton(automaton), maxDistance(maxDistance), limit(limit), matches(matches) {
+        // Слово раскладывается на символы: расстояние считается в символах, а не в байтах
+        for (size_t i = 0; i < text.size();) {
+            uint8_t lead = static_cast<uint8_t>(text[i]);
+            size_t length = lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+            uint32_t codePoint = lead < 0x80 ? lead : lead < 0xE0 ? lead & 0x1F : lead < 0xF0 ? lead & 0x0F : lead & 0x07;
+            for (size_t k = 1; k < length && i + k < text.size(); ++k) {
+                codePoint = (codePoint << 6) | (static_cast<uint8_t>(text[i + k]) & 0x3F);
+            }
+            word.push_back(codePoint);
+            i += length;
+        }
+        rows.resize(1);
+        rows[0].resize(word.size() + 1);
+        for (size_t j = 0; j <= word.size(); ++j) {
+            rows[0][j] = static_cast<uint32_t>(j);
+        }
+    }
+
+    // row - строка после последнего целого символа, codePoint и remaining - недочитанный символ
+    void walk(uint32_t offset, uint32_t ordinal, size_t row, uint32_t codePoint, uint32_t remaining) {
+        TermAutomaton::State current = automaton.state(offset);
+        if (current.final && remaining == 0 && rows[row][word.size()] == maxDistance) {
+            matches.push_back({ordinal, rows[row][word.size()]});
+        }
+        uint32_t base = ordinal + (current.final ? 1 : 0);
+        for (uint32_t i = 0; i < current.transitionCount && matches.size() < limit; ++i) {
+            uint32_t target = current.target(i);
+            uint8_t byte = current.labels[i];
+            uint32_t nextCodePoint;
+            uint32_t nextRemaining;
+            if (remaining == 0) {
+                nextRemaining = byte < 0xC0 ? 0 : byte < 0xE0 ? 1 : byte < 0xF0 ? 2 : 3;
+                nextCodePoint = byte < 0x80 ? byte : byte < 0xE0 ? byte & 0x1F : byte < 0xF0 ? byte & 0x0F : byte & 0x07;
+            } else {
+                nextRemaining = remaining - 1;
+                nextCodePoint = (codePoint << 6) | (byte & 0x3F);
+            }
+            if (nextRemaining > 0) {
+                walk(target, base, row, nextCodePoint, nextRemaining);
+            } else if (advanceRow(row, nextCodePoint)) {
+                walk(target, base, row + 1, 0, 0);
+            }
+            base += automaton.wordCount(target);
+        }
+    }
+};
+
+}
+
+void TermAutomaton::matchWildcard(std::string_view pattern, size_t limit, std::vector<TermMatch>& matches) const {
+    if (empty() || limit == 0) {
+        return;
+    }
+    WildcardWalk walk(*this, pattern, matches.size() + limit, matches);
+    walk.run(root);
+}
+
+void TermAutomaton::matchFuzzy(std::string_view word, uint32_t maxDistance, size_t limit,
+                               std::vector<TermMatch>& matches) const {
+    if (empty() || limit == 0) {
+        return;
+    }
+    // Обход в порядке словаря со своим limit на каждое расстояние: иначе далекие термы,
+    // которые стоят в словаре раньше (a, aa, ab для cat~2), вытеснили бы само слово и соседей
+    for (uint32_t distance = 0; distance <= maxDistance; ++distance) {
+        FuzzyWalk walk(*this, word, distance, matches.size() + limit, matches);
+        walk.walk(root, 0, 0, 0, 0);
+    }
+}
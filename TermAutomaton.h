@@ -0,0 +1,114 @@
+#ifndef TERMAUTOMATON_H
+#define TERMAUTOMATON_H
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Шаблон терма в запросе: Wildcard - * (любые символы) и ? (один символ UTF-8),
+// Fuzzy - термы на расстоянии Левенштейна не больше distance (в символах)
+enum class PatternKind : uint8_t {
+    Wildcard,
+    Fuzzy
+};
+
+struct TermPattern {
+    PatternKind kind = PatternKind::Wildcard;
+    std::string text;        // нормализован тем же Analyzer, что и термы
+    uint32_t distance = 0;
+};
+
+// Терм словаря, подошедший под шаблон: номер терма по возрастанию и расстояние до шаблона
+struct TermMatch {
+    uint32_t ordinal;
+    uint32_t distance;
+};
+
+/*
+ Словарь сегмента как минимальный ациклический автомат (DAWG).
+
+ Термы подаются в порядке возрастания байтов, и автомат строится за один
+ проход (Daciuk и др.): хвост предыдущего терма, который больше не
+ изменится, замораживается, а одинаковые состояния хранятся один раз,
+ поэтому общие и префиксы, и окончания термов занимают место однократно.
+
+ Формат (little-endian): uint32 смещение корня, затем состояния:
+   uint32 число термов, которые принимаются из состояния (вместе с ним самим)
+   uint8  1 - терм заканчивается в состоянии
+   uint16 число переходов n
+   uint8[n]  метки переходов по возрастанию
+   uint32[n] смещения целевых состояний
+
+ По числу термов в состояниях при спуске считается номер терма - тот же,
+ что у TermEntry в словаре сегмента, поэтому автомат хранит только связи.
+*/
+class TermAutomatonBuilder {
+private:
+    // Незамороженное состояние на пути последнего терма: у последнего перехода
+    // цель - следующее состояние пути, ее смещение появится при заморозке
+    struct PendingState {
+        bool final = false;
+        std::vector<std::pair<uint8_t, uint32_t>> transitions;
+    };
+
+    std::vector<PendingState> path;
+    std::string previous;
+    std::string states;
+    std::string record;
+    // Открытая адресация: смещение состояния + 1, 0 - пусто
+    std::vector<uint32_t> registry;
+    size_t registered = 0;
+
+    uint32_t freeze(const PendingState& state);
+    void freezeTail(size_t depth);
+    void growRegistry();
+
+public:
+    TermAutomatonBuilder();
+
+    // Термы строго по возрастанию байтов, повтор пропускается
+    void add(std::string_view term);
+    // Готовый автомат; построитель после этого пуст
+    std::string finish();
+};
+
+class TermAutomaton {
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    uint32_t root = 0;
+
+public:
+    // Разобранное состояние
+    struct State {
+        uint32_t words;
+        bool final;
+        uint32_t transitionCount;
+        const uint8_t* labels;
+        const uint8_t* targets;
+
+        uint32_t target(uint32_t index) const;
+    };
+
+    TermAutomaton() = default;
+    TermAutomaton(const uint8_t* data, size_t size);
+
+    bool empty() const { return data == nullptr; }
+    State state(uint32_t offset) const;
+    // Число термов, принимаемых из состояния
+    uint32_t wordCount(uint32_t offset) const;
+
+    // Номер терма, false - терма нет
+    bool find(std::string_view term, uint32_t& ordinal) const;
+    // Термы под шаблон с * и ?, не больше limit: первые по возрастанию, а не самые частые
+    void matchWildcard(std::string_view pattern, size_t limit, std::vector<TermMatch>& matches) const;
+    // Термы на расстоянии Левенштейна не больше maxDistance символов от word по возрастанию
+    // расстояния, не больше limit на каждое расстояние
+    void matchFuzzy(std::string_view word, uint32_t maxDistance, size_t limit,
+                    std::vector<TermMatch>& matches) const;
+};
+
+#endif // TERMAUTOMATON_H
@@ -0,0 +1,141 @@
+#include "TermDictionary.h"
+#include <cstring>
+#include <mutex>
+
+TermDictionary::TermDictionary() : shards(new Shard[SHARD_COUNT]) {}
+
+uint64_t TermDictionary::hashTerm(std::string_view term) {
+    // FNV-1a с финальным перемешиванием, чтобы младшие биты были равномерными
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : term) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+const TermDictionary::Slot* TermDictionary::findSlot(const Shard& shard, uint64_t hash, std::string_view term) {
+    if (shard.slots.empty()) {
+        return nullptr;
+    }
+    size_t mask = shard.slots.size() - 1;
+    for (size_t i = (hash >> SHARD_BITS) & mask;; i = (i + 1) & mask) {
+        const Slot& slot = shard.slots[i];
+        if (slot.id == 0) {
+            return &slot;
+        }
+        if (slot.hash == hash && slot.length == term.size() &&
+            std::memcmp(slot.data, term.data(), term.size()) == 0) {
+            return &slot;
+        }
+    }
+}
+
+void TermDictionary::grow(Shard& shard) {
+    size_t capacity = shard.slots.empty() ? 256 : shard.slots.size() * 2;
+    std::vector<Slot> slots(capacity);
+    size_t mask = capacity - 1;
+    for (const Slot& slot : shard.slots) {
+        if (slot.id == 0) {
+            continue;
+        }
+        size_t i = (slot.hash >> SHARD_BITS) & mask;
+        while (slots[i].id != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = slot;
+    }
+    shard.slots.swap(slots);
+}
+
+const char* TermDictionary::store(Shard& shard, std::string_view term) {
+    if (term.size() > ARENA_BLOCK / 4) {
+        // Длинные термы получают собственный блок
+        // и встают перед текущим блоком, чтобы он остался последним
+        std::unique_ptr<char[]> block(new char[term.size()]);
+        std::memcpy(block.get(), term.data(), term.size());
+        const char* data = block.get();
+        shard.arena.insert(shard.arena.end() - (shard.arena.empty() ? 0 : 1), std::move(block));
+        return data;
+    }
+    if (shard.arenaUsed + term.size() > ARENA_BLOCK) {
+        shard.arena.emplace_back(new char[ARENA_BLOCK]);
+        shard.arenaUsed = 0;
+    }
+    char* data = shard.arena.back().get() + shard.arenaUsed;
+    std::memcpy(data, term.data(), term.size());
+    shard.arenaUsed += term.size();
+    return data;
+}
+
+uint32_t TermDictionary::intern(std::string_view term) {
+    uint64_t hash = hashTerm(term);
+    Shard& shard = shards[hash & (SHARD_COUNT - 1)];
+
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        const Slot* slot = findSlot(shard, hash, term);
+        if (slot != nullptr && slot->id != 0) {
+            return slot->id;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    // Повторная проверка: терм мог добавить другой поток
+    const Slot* slot = findSlot(shard, hash, term);
+    if (slot != nullptr && slot->id != 0) {
+        return slot->id;
+    }
+    if ((shard.used + 1) * 10 > shard.slots.size() * 7) {
+        grow(shard);
+        slot = findSlot(shard, hash, term);
+    }
+
+    Slot& target = const_cast<Slot&>(*slot);
+    target.hash = hash;
+    target.data = store(shard, term);
+    target.length = static_cast<uint32_t>(term.size());
+    target.id = nextId.fetch_add(1, std::memory_order_relaxed);
+    ++shard.used;
+    return target.id;
+}
+
+uint32_t TermDictionary::find(std::string_view term) const {
+    uint64_t hash = hashTerm(term);
+    const Shard& shard = shards[hash & (SHARD_COUNT - 1)];
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    const Slot* slot = findSlot(shard, hash, term);
+    return slot != nullptr ? slot->id : 0;
+}
+
+size_t TermDictionary::size() const {
+    return nextId.load(std::memory_order_relaxed) - 1;
+}
+
+void TermDictionary::clear() {
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        std::unique_lock<std::shared_mutex> lock(shards[i].mutex);
+        shards[i].slots.clear();
+        shards[i].used = 0;
+        shards[i].arena.clear();
+        shards[i].arenaUsed = ARENA_BLOCK;
+    }
+    nextId = 1;
+}
+
+std::vector<std::pair<std::string_view, uint32_t>> TermDictionary::terms() const {
+    std::vector<std::pair<std::string_view, uint32_t>> result;
+    result.reserve(size());
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+        for (const Slot& slot : shards[i].slots) {
+            if (slot.id != 0) {
+                result.emplace_back(std::string_view(slot.data, slot.length), slot.id);
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,71 @@
+#ifndef TERMDICTIONARY_H
+#define TERMDICTIONARY_H
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+
+/*
+ Потокобезопасный словарь термов: терм -> стабильный uint32_t id.
+
+ Словарь разбит на шарды по хешу терма, у каждого шарда своя
+ открытая адресация и свой shared_mutex: поиск уже известного терма
+ идет под разделяемой блокировкой, вставка - только внутри одного шарда.
+ Id выдаются общим атомарным счетчиком и не меняются до clear().
+ Хеш считается один раз и хранится в ячейке, повторно не вычисляется.
+*/
+class TermDictionary {
+private:
+    static constexpr size_t SHARD_BITS = 6;
+    static constexpr size_t SHARD_COUNT = size_t(1) << SHARD_BITS;
+    static constexpr size_t ARENA_BLOCK = 64 * 1024;
+
+    struct Slot {
+        uint64_t hash = 0;
+        const char* data = nullptr;
+        uint32_t length = 0;
+        uint32_t id = 0;      // 0 - пустая ячейка
+    };
+
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::vector<Slot> slots;
+        size_t used = 0;
+        // Строки термов хранятся в блоках, указатели на них не инвалидируются
+        std::vector<std::unique_ptr<char[]>> arena;
+        size_t arenaUsed = ARENA_BLOCK;
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<uint32_t> nextId{1};
+
+    static const Slot* findSlot(const Shard& shard, uint64_t hash, std::string_view term);
+    static void grow(Shard& shard);
+    static const char* store(Shard& shard, std::string_view term);
+
+public:
+    TermDictionary();
+    TermDictionary(const TermDictionary&) = delete;
+    TermDictionary& operator=(const TermDictionary&) = delete;
+
+    // Id терма, новый терм получает следующий свободный id
+    uint32_t intern(std::string_view term);
+    // Id терма или 0, если терм не встречался
+    uint32_t find(std::string_view term) const;
+    size_t size() const;
+    void clear();
+
+    // Снимок всех пар терм - id (строки живут пока жив словарь)
+    std::vector<std::pair<std::string_view, uint32_t>> terms() const;
+
+    // Хеш терма, им же пользуются таблицы поиска в сегментах
+    static uint64_t hashTerm(std::string_view term);
+};
+
+#endif // TERMDICTIONARY_H
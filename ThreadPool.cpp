@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned worker = 0; worker < threadCount; ++worker) {
+        ranges.push_back(std::make_unique<Range>());
+    }
+    for (unsigned worker = 1; worker < threadCount; ++worker) {
+        threads.emplace_back(&ThreadPool::workerLoop, this, worker);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::run(size_t count, const Task& runTask) {
+    if (count == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> runLock(runMutex);
+    // Одну задачу незачем раздавать потокам
+    if (count == 1 || ranges.size() == 1) {
+        for (size_t index = 0; index < count; ++index) {
+            runTask(index, 0);
+        }
+        return;
+    }
+
+    // Номера делятся поровну, остаток достается первым потокам
+    size_t workers = ranges.size();
+    size_t begin = 0;
+    for (size_t worker = 0; worker < workers; ++worker) {
+        size_t length = count / workers + (worker < count % workers ? 1 : 0);
+        std::lock_guard<std::mutex> lock(ranges[worker]->mutex);
+        ranges[worker]->begin = begin;
+        ranges[worker]->end = begin + length;
+        begin += length;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &runTask;
+        active = static_cast<unsigned>(threads.size());
+        ++generation;
+    }
+    wake.notify_all();
+
+    drain(0);
+
+    // Задача живет до возврата из run, поэтому ждем выхода всех потоков из drain
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return active == 0; });
+    task = nullptr;
+}
+
+void ThreadPool::workerLoop(unsigned worker) {
+    size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+
+        drain(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--active == 0) {
+            finished.notify_one();
+        }
+    }
+}
+
+// Выполнение своих задач, затем чужих, пока есть что забрать
+void ThreadPool::drain(unsigned worker) {
+    size_t index = 0;
+    while (take(worker, index) || (steal(worker) && take(worker, index))) {
+        (*task)(index, worker);
+    }
+}
+
+bool ThreadPool::take(unsigned worker, size_t& index) {
+    Range& range = *ranges[worker];
+    std::lock_guard<std::mutex> lock(range.mutex);
+    if (range.begin >= range.end) {
+        return false;
+    }
+    index = range.begin++;
+    return true;
+}
+
+// Перенос второй половины диапазона первого непустого соседа в свой диапазон
+bool ThreadPool::steal(unsigned worker) {
+    size_t workers = ranges.size();
+    for (size_t step = 1; step < workers; ++step) {
+        Range& victim = *ranges[(worker + step) % workers];
+        size_t begin = 0;
+        size_t end = 0;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin >= victim.end) {
+                continue;
+            }
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+        Range& own = *ranges[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,62 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ Пул потоков с перехватом работы для пакетов независимых задач.
+
+ Задачи пакета - номера [0, count). Каждый поток получает свой непрерывный
+ диапазон номеров и берет задачи с его начала; опустевший поток забирает
+ вторую половину диапазона другого потока. Так долгие задачи не оставляют
+ остальные потоки без работы, а короткие почти не трогают общие блокировки.
+ Вызывающий поток работает как поток с номером 0.
+*/
+class ThreadPool {
+public:
+    using Task = std::function<void(size_t index, unsigned worker)>;
+
+    // 0 - по числу ядер
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Число потоков вместе с вызывающим
+    unsigned size() const { return static_cast<unsigned>(ranges.size()); }
+    // Выполнение task для всех номеров [0, count), возврат после завершения всех задач
+    void run(size_t count, const Task& task);
+
+private:
+    // Невыполненные номера потока, их забирают и владелец, и другие потоки
+    struct Range {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<std::unique_ptr<Range>> ranges;
+    std::mutex runMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const Task* task = nullptr;
+    size_t generation = 0;
+    unsigned active = 0;
+    bool stopping = false;
+
+    void workerLoop(unsigned worker);
+    void drain(unsigned worker);
+    bool take(unsigned worker, size_t& index);
+    bool steal(unsigned worker);
+};
+
+#endif // THREADPOOL_H
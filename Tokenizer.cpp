@@ -0,0 +1,167 @@
+#include "Tokenizer.h"
+#include <array>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TOKENIZER_SSE2 1
+#endif
+
+namespace {
+
+enum ByteClass : uint8_t {
+    WORD = 0,
+    SPACE = 1,
+    UPPER = 2,
+    PUNCT = 4,
+    HIGH = 8    // байт символа UTF-8 вне ASCII
+};
+
+// Классы байтов как у isspace/isupper/ispunct в локали "C"; байты >= 0x80 - часть слова,
+// при приведении регистра UTF-8 они тоже требуют нормализации
+constexpr std::array<uint8_t, 256> makeByteClasses() {
+    std::array<uint8_t, 256> classes {};
+    for (int c = 0; c < 256; ++c) {
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            classes[c] = SPACE;
+        } else if (c >= 'A' && c <= 'Z') {
+            classes[c] = UPPER;
+        } else if ((c >= 0x21 && c <= 0x2F) || (c >= 0x3A && c <= 0x40) ||
+                   (c >= 0x5B && c <= 0x60) || (c >= 0x7B && c <= 0x7E)) {
+            classes[c] = PUNCT;
+        } else if (c >= 0x80) {
+            classes[c] = HIGH;
+        }
+    }
+    return classes;
+}
+
+constexpr std::array<uint8_t, 256> BYTE_CLASSES = makeByteClasses();
+
+inline uint8_t classOf(char c) {
+    return BYTE_CLASSES[static_cast<unsigned char>(c)];
+}
+
+#ifdef TOKENIZER_SSE2
+// Маска байтов из диапазона [low, high] без знаковых сравнений
+inline __m128i inRange(__m128i bytes, char low, char high) {
+    __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+    __m128i over = _mm_subs_epu8(shifted, _mm_set1_epi8(static_cast<char>(high - low)));
+    return _mm_cmpeq_epi8(over, _mm_setzero_si128());
+}
+
+inline unsigned countTrailingZeros(unsigned value) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return static_cast<unsigned>(__builtin_ctz(value));
+#endif
+}
+#endif
+
+// Конец слова (первый пробельный символ) и признак того, что слово нужно нормализовать;
+// unicode - байты вне ASCII тоже требуют нормализации
+inline const char* scanWord(const char* position, const char* end, bool unicode, bool& special) {
+#ifdef TOKENIZER_SSE2
+    while (end - position >= 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')), inRange(bytes, '\t', '\r'));
+        // Заглавные буквы и пунктуация: 0x21-0x2F, 0x3A-0x60 (включая A-Z), 0x7B-0x7E
+        __m128i marks = _mm_or_si128(_mm_or_si128(inRange(bytes, 0x21, 0x2F), inRange(bytes, 0x3A, 0x60)),
+                                     inRange(bytes, 0x7B, 0x7E));
+        unsigned spaceMask = static_cast<unsigned>(_mm_movemask_epi8(space));
+        unsigned markMask = static_cast<unsigned>(_mm_movemask_epi8(marks));
+        if (unicode) {
+            markMask |= static_cast<unsigned>(_mm_movemask_epi8(bytes));
+        }
+        if (spaceMask != 0) {
+            unsigned length = countTrailingZeros(spaceMask);
+            special |= (markMask & ((1u << length) - 1)) != 0;
+            return position + length;
+        }
+        special |= markMask != 0;
+        position += 16;
+    }
+#endif
+    const uint8_t marks = unicode ? UPPER | PUNCT | HIGH : UPPER | PUNCT;
+    while (position < end) {
+        uint8_t byteClass = classOf(*position);
+        if (byteClass == SPACE) {
+            break;
+        }
+        special |= (byteClass & marks) != 0;
+        ++position;
+    }
+    return position;
+}
+
+}
+
+// Стандартный Analyzer живет до конца процесса
+Tokenizer::Tokenizer() : analyzer(Analyzer::standard().get()) {}
+
+Tokenizer::Tokenizer(const Analyzer& analyzer) : analyzer(&analyzer) {}
+
+Tokenizer::Tokenizer(std::string_view text) : Tokenizer() {
+    reset(text);
+}
+
+void Tokenizer::reset(std::string_view newText) {
+    text = newText.data();
+    position = newText.data();
+    wordBegin = newText.data();
+    end = newText.data() + newText.size();
+    words = 0;
+}
+
+// Удаление пунктуации и приведение к нижнему регистру во внутренний буфер
+std::string_view Tokenizer::normalize(const char* begin, const char* wordEnd) {
+    buffer.clear();
+    const bool unicode = analyzer->caseFolding() == CaseFolding::Unicode;
+    for (const char* c = begin; c < wordEnd;) {
+        uint8_t byteClass = classOf(*c);
+        if (byteClass == UPPER) {
+            buffer.push_back(static_cast<char>(*c + ('a' - 'A')));
+        } else if (byteClass == HIGH && unicode) {
+            Analyzer::foldCharacter(c, wordEnd, buffer);
+            continue;
+        } else if (byteClass != PUNCT) {
+            buffer.push_back(*c);
+        }
+        ++c;
+    }
+    return buffer;
+}
+
+bool Tokenizer::next(std::string_view& token) {
+    while (position < end) {
+        // Пропуск пробельных символов
+        while (position < end && classOf(*position) == SPACE) {
+            ++position;
+        }
+        if (position >= end) {
+            break;
+        }
+
+        const char* begin = position;
+        bool special = false;
+        position = scanWord(position, end, analyzer->caseFolding() == CaseFolding::Unicode, special);
+        ++words;
+
+        std::string_view word = special ? normalize(begin, position)
+                                        : std::string_view(begin, static_cast<size_t>(position - begin));
+        if (word.empty() || analyzer->isStopWord(word)) {
+            continue;
+        }
+        token = analyzer->stems() ? analyzer->stem(word, stemBuffer) : word;
+        wordBegin = begin;
+        return true;
+    }
+    return false;
+}
+
+bool Tokenizer::isSpace(char c) {
+    return classOf(c) == SPACE;
+}
@@ -0,0 +1,59 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "Analyzer.h"
+
+/*
+ Потоковый токенизатор, общий для индексации и запросов.
+
+ За один проход по буферу (строка или mmap файла) делит текст по
+ пробельным символам, убирает пунктуацию, приводит слова к нижнему
+ регистру, отбрасывает стоп-слова и снимает окончания - по настройкам
+ Analyzer. Токены выдаются как string_view: если слово не требует
+ нормализации, view указывает прямо в исходный буфер, иначе - во
+ внутренний буфер, который живет до следующего next().
+ Поиск границ слов идет блоками по 16 байт (SSE2), хвост - по байтам.
+ Слово из одних строчных ASCII-букв и цифр нормализации не требует.
+*/
+class Tokenizer {
+private:
+    const Analyzer* analyzer;
+    const char* text = nullptr;
+    const char* position = nullptr;
+    const char* end = nullptr;
+    // Начало слова последнего токена в тексте
+    const char* wordBegin = nullptr;
+    std::string buffer;
+    std::string stemBuffer;
+    size_t words = 0;
+
+    std::string_view normalize(const char* begin, const char* wordEnd);
+
+public:
+    // Analyzer должен жить дольше токенизатора
+    Tokenizer();
+    explicit Tokenizer(const Analyzer& analyzer);
+    explicit Tokenizer(std::string_view text);
+    void setAnalyzer(const Analyzer& settings) { analyzer = &settings; }
+
+    // Новый текст, внутренний буфер переиспользуется без выделений памяти
+    void reset(std::string_view text);
+    // Следующий нормализованный токен, false - текст закончился
+    bool next(std::string_view& token);
+    // Число слов, включая стоп-слова и слова из одной пунктуации
+    size_t wordCount() const { return words; }
+    // Байтовые границы последнего токена от начала текста: слово как оно записано, с пунктуацией
+    size_t tokenBegin() const { return static_cast<size_t>(wordBegin - text); }
+    size_t tokenEnd() const { return static_cast<size_t>(position - text); }
+    // Слово в нижнем регистре без пунктуации, без стоп-слов и стеммера (части шаблонов запроса)
+    std::string_view fold(std::string_view word) { return normalize(word.data(), word.data() + word.size()); }
+
+    // Пробельный символ: по нему текст можно резать на части, не разрывая токенов
+    static bool isSpace(char c);
+};
+
+#endif // TOKENIZER_H
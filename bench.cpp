@@ -0,0 +1,741 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <cstdlib>
+#include <filesystem>
+#include <unordered_set>
+#include "InvertedIndex.h"
+#include "IndexSnapshot.h"
+#include "JsonStream.h"
+#include "Metrics.h"
+#include "SearchServer.h"
+#include "Tokenizer.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Пиковый объем памяти процесса в мегабайтах, 0 - платформа не сообщает
+static double peakMemoryMegabytes() {
+#ifdef _WIN32
+    return 0;
+#else
+    rusage usage {};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+/*
+ Детерминированный генератор: только mt19937_64, выход которого задан стандартом,
+ без std::*_distribution, которые в разных библиотеках дают разные числа.
+ Поэтому корпус и запросы одинаковы на любой платформе при тех же параметрах.
+*/
+class BenchRandom {
+private:
+    std::mt19937_64 engine;
+
+public:
+    explicit BenchRandom(uint64_t seed) : engine(seed) {}
+    // Равномерно в [0, 1)
+    double uniform() { return static_cast<double>(engine() >> 11) * (1.0 / 9007199254740992.0); }
+    // Равномерно в [0, count)
+    uint64_t below(uint64_t count) { return static_cast<uint64_t>(uniform() * count); }
+};
+
+// Словарь с частотами по закону Ципфа: слово ранга r встречается пропорционально 1/r^exponent
+class ZipfVocabulary {
+private:
+    std::vector<std::string> words;
+    std::vector<double> cumulative;
+
+public:
+    ZipfVocabulary(size_t size, double exponent) {
+        BenchRandom random(7);
+        std::unordered_set<std::string> used;
+        while (words.size() < size) {
+            std::string word(2 + random.below(9), 'a');
+            for (auto& c : word) {
+                c = static_cast<char>('a' + random.below(26));
+            }
+            if (used.insert(word).second) {
+                words.push_back(word);
+            }
+        }
+        double total = 0;
+        for (size_t rank = 1; rank <= size; ++rank) {
+            total += 1.0 / std::pow(static_cast<double>(rank), exponent);
+            cumulative.push_back(total);
+        }
+        for (auto& value : cumulative) {
+            value /= total;
+        }
+    }
+
+    // Слово по рангу частоты, 0 - самое частое
+    const std::string& word(size_t rank) const {
+        return words[std::min(rank, words.size() - 1)];
+    }
+
+    const std::string& sample(BenchRandom& random) const {
+        size_t rank = std::upper_bound(cumulative.begin(), cumulative.end(), random.uniform()) - cumulative.begin();
+        return words[std::min(rank, words.size() - 1)];
+    }
+};
+
+struct BenchOptions {
+    std::vector<int> scales {1000, 10000};
+    int wordsPerDocument = 300;
+    size_t vocabularySize = 50000;
+    double zipfExponent = 1.0;
+    int queryCount = 1000;
+    int rounds = 3;
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    int memoryLimit = 64;
+    std::string jsonPath;
+};
+
+// Корпус во временной папке: длина документа равномерна в [words/2, 3*words/2].
+// Первые два слова части документов сохраняются как фразы для запросов
+static std::vector<std::string> generateCorpus(const fs::path& directory, int documents, int wordsPerDocument,
+                                               const ZipfVocabulary& vocabulary,
+                                               std::unordered_map<std::string, int>& documentIdMap,
+                                               std::vector<std::string>& phrases) {
+    fs::remove_all(directory);
+    fs::create_directories(directory);
+
+    BenchRandom random(42);
+    std::vector<std::string> files;
+    std::string text;
+    for (int d = 1; d <= documents; ++d) {
+        size_t length = wordsPerDocument / 2 + random.below(wordsPerDocument + 1);
+        text.clear();
+        std::string phrase;
+        for (size_t w = 0; w < length; ++w) {
+            std::string word = vocabulary.sample(random);
+            if (w < 2 && d % 16 == 0) {
+                phrase += (w == 0 ? "" : " ") + word;
+            }
+            // Часть слов с заглавной буквой и знаками препинания, как в обычном тексте
+            uint64_t kind = random.below(20);
+            if (kind == 0) {
+                word[0] = static_cast<char>(word[0] - 'a' + 'A');
+            } else if (kind == 1) {
+                word += ',';
+            } else if (kind == 2) {
+                word += ".\n";
+            }
+            text += word;
+            text += ' ';
+        }
+        if (!phrase.empty()) {
+            phrases.push_back(phrase);
+        }
+
+        // Документы раскладываются по подкаталогам, чтобы в одном каталоге не было миллиона файлов
+        fs::path subdirectory = directory / std::to_string(d / 1000);
+        if (d % 1000 == 0 || d == 1) {
+            fs::create_directories(subdirectory);
+        }
+        fs::path filePath = subdirectory / ("doc" + std::to_string(d) + ".txt");
+        std::ofstream file(filePath, std::ios::binary);
+        file << text;
+        files.push_back(filePath.string());
+        documentIdMap[filePath.string()] = d;
+    }
+    return files;
+}
+
+// Запросы из 1-4 слов по тому же распределению, что и корпус, каждый десятый - фраза из корпуса
+static std::vector<std::string> generateQueries(int count, const ZipfVocabulary& vocabulary,
+                                                const std::vector<std::string>& phrases) {
+    BenchRandom random(1234);
+    std::vector<std::string> queries;
+    for (int q = 0; q < count; ++q) {
+        if (q % 10 == 9 && !phrases.empty()) {
+            queries.push_back("\"" + phrases[random.below(phrases.size())] + "\"");
+            continue;
+        }
+        std::string query;
+        uint64_t words = 1 + random.below(4);
+        for (uint64_t w = 0; w < words; ++w) {
+            query += (w == 0 ? "" : " ") + vocabulary.sample(random);
+        }
+        queries.push_back(query);
+    }
+    return queries;
+}
+
+// Запросы-шаблоны из слов корпуса: слово с одной опечаткой и ~1, с двумя и ~2, первые три буквы и *,
+// overlap - слово рядом с шаблоном, который раскрывается и в него тоже
+static std::vector<std::string> generatePatternQueries(int count, const ZipfVocabulary& vocabulary,
+                                                       const std::string& kind) {
+    BenchRandom random(4321);
+    std::vector<std::string> queries;
+    for (int q = 0; q < count; ++q) {
+        std::string word = vocabulary.sample(random);
+        if (kind == "prefix") {
+            queries.push_back(word.substr(0, 3) + "*");
+            continue;
+        }
+        if (kind == "overlap") {
+            queries.push_back(word + " " + word.substr(0, 3) + "*");
+            continue;
+        }
+        int typos = kind == "fuzzy2" ? 2 : 1;
+        for (int t = 0; t < typos; ++t) {
+            word[random.below(word.size())] = static_cast<char>('a' + random.below(26));
+        }
+        queries.push_back(word + "~" + std::to_string(typos));
+    }
+    return queries;
+}
+
+// Булевы запросы вокруг слова средней частоты: rarest - само слово, boolean - оно же
+// в пересечении с дизъюнкцией частых слов и с частым словом под NOT
+static std::vector<std::string> generateBooleanQueries(int count, const ZipfVocabulary& vocabulary,
+                                                       const std::string& kind) {
+    BenchRandom random(5678);
+    std::vector<std::string> queries;
+    for (int q = 0; q < count; ++q) {
+        const std::string& rare = vocabulary.word(200 + random.below(5000));
+        const std::string& first = vocabulary.word(random.below(50));
+        const std::string& second = vocabulary.word(random.below(50));
+        const std::string& excluded = vocabulary.word(random.below(50));
+        queries.push_back(kind == "rarest" ? rare
+                          : "(" + first + " OR " + second + ") AND " + rare + " NOT " + excluded);
+    }
+    return queries;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Значение перцентиля по отсортированным задержкам
+static double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(q * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+// Размер и скорость чтения сегмента, перекодированного каждым кодеком:
+// полный обход списков без позиций и с позициями
+static json compareCodecs(const std::string& segmentPath) {
+    json result = json::array();
+    IndexSegment source;
+    if (!source.open(segmentPath)) {
+        return result;
+    }
+    std::string codecPath = segmentPath + ".codec";
+    for (CodecType type : {CodecType::Varint, CodecType::GroupVarint, CodecType::PFor}) {
+        const char* name = IntegerCodec::get(type).name();
+        IndexSegment segment;
+        if (!IndexSegment::merge(source, IndexSegment(), codecPath, type) || !segment.open(codecPath)) {
+            std::cerr << "Error: Unable to write segment with codec " << name << std::endl;
+            continue;
+        }
+
+        uint64_t postings = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const TermEntry* entry = segment.begin(); entry != segment.end(); ++entry) {
+            PostingList list = segment.postings(*entry);
+            while (list.next()) {
+                ++postings;
+            }
+        }
+        double postingsSeconds = secondsSince(start);
+
+        uint64_t positions = 0;
+        std::vector<uint32_t> buffer;
+        start = std::chrono::steady_clock::now();
+        for (const TermEntry* entry = segment.begin(); entry != segment.end(); ++entry) {
+            PostingList list = segment.postings(*entry);
+            while (list.next()) {
+                list.readPositions(buffer);
+                positions += buffer.size();
+            }
+        }
+        double positionsSeconds = secondsSince(start);
+
+        double postingBytes = postings > 0 ? static_cast<double>(segment.postingsBytes()) / postings : 0;
+        double positionBytes = positions > 0 ? static_cast<double>(segment.positionsBytes()) / positions : 0;
+        std::cout << "codec=" << name
+                  << " segment MB=" << fs::file_size(codecPath) / (1024.0 * 1024.0)
+                  << " bytes/posting=" << postingBytes
+                  << " bytes/position=" << positionBytes
+                  << " postings M/s=" << postings / postingsSeconds / 1e6
+                  << " with positions M/s=" << positions / positionsSeconds / 1e6 << std::endl;
+        result.push_back({{"codec", name},
+                          {"segment_bytes", fs::file_size(codecPath)},
+                          {"postings_bytes", segment.postingsBytes()},
+                          {"positions_bytes", segment.positionsBytes()},
+                          {"bytes_per_posting", postingBytes},
+                          {"bytes_per_position", positionBytes},
+                          {"postings_per_second", postings / postingsSeconds},
+                          {"positions_per_second", positions / positionsSeconds}});
+    }
+    fs::remove(codecPath);
+    return result;
+}
+
+// Замеры одного размера корпуса: запись сегмента, загрузка снимка, пакеты запросов
+static json runScale(const BenchOptions& options, const ZipfVocabulary& vocabulary, int documents, bool sweep) {
+    fs::path corpus = fs::temp_directory_path() / "search_engine_bench";
+    std::unordered_map<std::string, int> documentIdMap;
+    std::vector<std::string> phrases;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::string> files = generateCorpus(corpus, documents, options.wordsPerDocument, vocabulary,
+                                                    documentIdMap, phrases);
+    double generateSeconds = secondsSince(start);
+    std::vector<std::string> queries = generateQueries(options.queryCount, vocabulary, phrases);
+
+    uintmax_t corpusBytes = 0;
+    for (const auto& filePath : files) {
+        corpusBytes += fs::file_size(filePath);
+    }
+    std::cout << "Corpus: " << documents << " documents, " << corpusBytes / (1024.0 * 1024.0) << " MB, "
+              << "generated in " << generateSeconds << " s" << std::endl;
+
+    json result;
+    result["documents"] = documents;
+    result["corpus_bytes"] = corpusBytes;
+    Metrics::global().reset();
+
+    // Запись сегмента с ограничением памяти
+    std::string segmentPath = (corpus / "index.bin").string();
+    {
+        InvertedIndex invertedIndex;
+        invertedIndex.setThreadCount(options.maxThreads);
+        std::vector<uint64_t> contentHashes;
+
+        start = std::chrono::steady_clock::now();
+        bool written = invertedIndex.writeIndex(files, documentIdMap, segmentPath, {},
+                                                static_cast<size_t>(options.memoryLimit) << 20, contentHashes);
+        double seconds = secondsSince(start);
+
+        std::error_code error;
+        uintmax_t segmentBytes = fs::file_size(segmentPath, error);
+        std::cout << "segment threads=" << options.maxThreads
+                  << " memory limit MB=" << options.memoryLimit
+                  << " written=" << written
+                  << " segment MB=" << segmentBytes / (1024.0 * 1024.0)
+                  << " peak RSS MB=" << peakMemoryMegabytes()
+                  << " seconds=" << seconds
+                  << " docs/sec=" << static_cast<long>(documents / seconds)
+                  << " MB/sec=" << corpusBytes / (1024.0 * 1024.0) / seconds << std::endl;
+        result["build"] = {{"written", written},
+                           {"seconds", seconds},
+                           {"docs_per_second", documents / seconds},
+                           {"bytes_per_second", corpusBytes / seconds},
+                           {"segment_bytes", segmentBytes},
+                           {"peak_rss_mb", peakMemoryMegabytes()}};
+    }
+
+    // Масштабирование построения в памяти по числу потоков
+    if (sweep) {
+        for (unsigned threads = 1; threads <= options.maxThreads; ++threads) {
+            InvertedIndex invertedIndex;
+            invertedIndex.setThreadCount(threads);
+
+            start = std::chrono::steady_clock::now();
+            IndexData index = invertedIndex.buildIndex(files, documentIdMap);
+            double seconds = secondsSince(start);
+
+            std::cout << "threads=" << threads
+                      << " terms=" << index.idCount() - 1
+                      << " postings=" << index.postings.size()
+                      << " index MB=" << index.memoryUsage() / (1024.0 * 1024.0)
+                      << " peak RSS MB=" << peakMemoryMegabytes()
+                      << " seconds=" << seconds
+                      << " docs/sec=" << static_cast<long>(documents / seconds) << std::endl;
+            result["thread_scaling"].push_back({{"threads", threads}, {"seconds", seconds}});
+        }
+    }
+
+    result["codecs"] = compareCodecs(segmentPath);
+
+    // Открытие снимка: файлы уже в кеше страниц, поэтому это время разбора заголовков и словаря
+    const int loads = 5;
+    double loadSeconds = 0;
+    IndexSnapshot snapshot;
+    for (int i = 0; i < loads; ++i) {
+        start = std::chrono::steady_clock::now();
+        snapshot.open(segmentPath, "");
+        loadSeconds += secondsSince(start);
+    }
+    result["load_ms"] = loadSeconds * 1000 / loads;
+
+    // Пакеты запросов: первый прогревает страницы, задержки берутся со всех
+    SearchServer searchServer;
+    searchServer.setThreadCount(options.maxThreads);
+    std::vector<SearchQuery> requests = searchServer.processRequests(queries, snapshot.analyzer());
+    searchServer.search(snapshot, requests, 5);
+    std::vector<double> latencies;
+    double batchSeconds = 0;
+    for (int round = 0; round < options.rounds; ++round) {
+        searchServer.search(snapshot, requests, 5);
+        latencies.insert(latencies.end(), searchServer.getLatencies().begin(), searchServer.getLatencies().end());
+        batchSeconds += searchServer.getBatchSeconds();
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double qps = batchSeconds > 0 ? latencies.size() / batchSeconds : 0;
+    std::cout << "queries=" << latencies.size()
+              << " load ms=" << result["load_ms"].get<double>()
+              << " QPS=" << qps
+              << " p50 ms=" << percentile(latencies, 0.5)
+              << " p99 ms=" << percentile(latencies, 0.99)
+              << " max ms=" << (latencies.empty() ? 0 : latencies.back()) << std::endl;
+    result["queries"] = {{"count", latencies.size()},
+                         {"threads", searchServer.getThreadCount()},
+                         {"qps", qps},
+                         {"p50_ms", percentile(latencies, 0.5)},
+                         {"p99_ms", percentile(latencies, 0.99)},
+                         {"max_ms", latencies.empty() ? 0 : latencies.back()}};
+
+    // Один поток, без кэша: полный перебор, WAND по оценкам слов и Block-Max WAND по оценкам блоков
+    {
+        QueryEvaluator evaluator(snapshot);
+        const char* names[] = {"exhaustive", "wand", "block_max"};
+        double exhaustiveTotal = 0;
+        for (int mode = 0; mode < 3; ++mode) {
+            std::vector<double> modeLatencies;
+            for (int round = 0; round < options.rounds; ++round) {
+                for (const auto& request : requests) {
+                    start = std::chrono::steady_clock::now();
+                    evaluator.matchAny(request, 5, mode > 0, mode == 2);
+                    modeLatencies.push_back(secondsSince(start) * 1000);
+                }
+            }
+            double total = 0;
+            for (double latency : modeLatencies) {
+                total += latency;
+            }
+            if (mode == 0) {
+                exhaustiveTotal = total;
+            }
+            std::sort(modeLatencies.begin(), modeLatencies.end());
+            double speedup = total > 0 ? exhaustiveTotal / total : 0;
+            std::cout << names[mode] << ": avg ms=" << (modeLatencies.empty() ? 0 : total / modeLatencies.size())
+                      << " p50 ms=" << percentile(modeLatencies, 0.5)
+                      << " p99 ms=" << percentile(modeLatencies, 0.99)
+                      << " speedup=" << speedup << std::endl;
+            result["pruning"][names[mode]] = {{"avg_ms", modeLatencies.empty() ? 0 : total / modeLatencies.size()},
+                                              {"p50_ms", percentile(modeLatencies, 0.5)},
+                                              {"p99_ms", percentile(modeLatencies, 0.99)},
+                                              {"speedup", speedup}};
+        }
+    }
+
+    // Те же пакеты с кэшем ответов: первый пакет попадает в кэш только на повторах
+    // внутри себя, следующие целиком отвечаются из кэша
+    searchServer.setCacheCapacity(static_cast<size_t>(ConverterJSON::DEFAULT_QUERY_CACHE_MEMORY) << 20);
+    json countersBefore = Metrics::global().toJson()["counters"];
+    searchServer.search(snapshot, requests, 5);
+    double coldSeconds = searchServer.getBatchSeconds();
+    json countersAfter = Metrics::global().toJson()["counters"];
+    uint64_t coldHits = countersAfter["cache_hits"].get<uint64_t>() - countersBefore["cache_hits"].get<uint64_t>();
+    double warmSeconds = 0;
+    for (int round = 0; round < options.rounds; ++round) {
+        searchServer.search(snapshot, requests, 5);
+        warmSeconds += searchServer.getBatchSeconds();
+    }
+    double coldQps = coldSeconds > 0 ? requests.size() / coldSeconds : 0;
+    double warmQps = warmSeconds > 0 ? requests.size() * options.rounds / warmSeconds : 0;
+    double coldHitRate = requests.empty() ? 0 : static_cast<double>(coldHits) / requests.size();
+    std::cout << "cache: first batch QPS=" << coldQps << " hit rate=" << coldHitRate
+              << ", repeated QPS=" << warmQps << ", entries=" << searchServer.getCache().size()
+              << ", bytes=" << searchServer.getCache().bytes() << std::endl;
+    result["cache"] = {{"first_batch_qps", coldQps},
+                       {"first_batch_hit_rate", coldHitRate},
+                       {"repeated_qps", warmQps},
+                       {"entries", searchServer.getCache().size()},
+                       {"bytes", searchServer.getCache().bytes()}};
+
+    // Шаблоны без кэша: раскрытие по словарю сегмента и поиск по объединенным спискам
+    searchServer.setCacheCapacity(0);
+    for (const std::string kind : {"fuzzy1", "fuzzy2", "prefix", "overlap"}) {
+        std::vector<std::string> patternQueries = generatePatternQueries(options.queryCount, vocabulary, kind);
+        std::vector<SearchQuery> patternRequests = searchServer.processRequests(patternQueries, snapshot.analyzer());
+        size_t expanded = 0;
+        start = std::chrono::steady_clock::now();
+        for (const auto& request : patternRequests) {
+            for (const auto& pattern : request.patterns) {
+                expanded += snapshot.expand(pattern, 64).size();
+            }
+        }
+        double expandMs = patternRequests.empty() ? 0 : secondsSince(start) * 1000 / patternRequests.size();
+        std::vector<double> patternLatencies;
+        size_t nonFinite = 0;
+        for (int round = 0; round < options.rounds; ++round) {
+            auto answers = searchServer.search(snapshot, patternRequests, 5);
+            patternLatencies.insert(patternLatencies.end(), searchServer.getLatencies().begin(),
+                                    searchServer.getLatencies().end());
+            // Ранги всегда конечны, даже когда курсоры шаблона и слова читают одни и те же позиции
+            for (const auto& answer : answers) {
+                for (const auto& [documentId, rank] : answer) {
+                    nonFinite += std::isfinite(rank) ? 0 : 1;
+                }
+            }
+        }
+        if (nonFinite > 0) {
+            std::cerr << "Error: " << nonFinite << " non-finite ranks in " << kind << " queries" << std::endl;
+        }
+        std::sort(patternLatencies.begin(), patternLatencies.end());
+        double averageTerms = patternRequests.empty() ? 0 : static_cast<double>(expanded) / patternRequests.size();
+        std::cout << kind << ": expansion ms=" << expandMs << " terms=" << averageTerms
+                  << " p50 ms=" << percentile(patternLatencies, 0.5)
+                  << " p99 ms=" << percentile(patternLatencies, 0.99)
+                  << " non-finite ranks=" << nonFinite << std::endl;
+        result["patterns"][kind] = {{"expansion_ms", expandMs},
+                                    {"expanded_terms", averageTerms},
+                                    {"p50_ms", percentile(patternLatencies, 0.5)},
+                                    {"p99_ms", percentile(patternLatencies, 0.99)},
+                                    {"non_finite_ranks", nonFinite}};
+    }
+
+    // Булев запрос должен стоить почти столько же, сколько его самое редкое слово
+    for (const std::string kind : {"rarest", "boolean"}) {
+        std::vector<std::string> booleanQueries = generateBooleanQueries(options.queryCount, vocabulary, kind);
+        std::vector<SearchQuery> booleanRequests = searchServer.processRequests(booleanQueries, snapshot.analyzer());
+        std::vector<double> booleanLatencies;
+        for (int round = 0; round < options.rounds; ++round) {
+            searchServer.search(snapshot, booleanRequests, 5);
+            booleanLatencies.insert(booleanLatencies.end(), searchServer.getLatencies().begin(),
+                                    searchServer.getLatencies().end());
+        }
+        std::sort(booleanLatencies.begin(), booleanLatencies.end());
+        std::cout << kind << ": p50 ms=" << percentile(booleanLatencies, 0.5)
+                  << " p99 ms=" << percentile(booleanLatencies, 0.99) << std::endl;
+        result["boolean"][kind] = {{"p50_ms", percentile(booleanLatencies, 0.5)},
+                                   {"p99_ms", percentile(booleanLatencies, 0.99)}};
+    }
+
+    // Сниппеты: тот же корпус с границами токенов, размер сегмента и время на один найденный документ
+    {
+        // Еще один документ не в UTF-8 (Latin-1 и обрывки последовательностей) и с разметкой:
+        // ответы со сниппетами из него должны оставаться правильным JSON, а в сниппете
+        // не должно быть других тегов, кроме выделения
+        fs::path fixturePath = corpus / "snippet_fixture.txt";
+        {
+            std::ofstream fixture(fixturePath, std::ios::binary);
+            fixture << "Caf\xE9 cr\xC3\xA8me <script>alert(1)</script> & \"quoted\" \xFF\xFE snippetfixture "
+                    << "\xE2\x82 end\xC3\n";
+        }
+        std::vector<std::string> snippetFiles = files;
+        snippetFiles.push_back(fixturePath.string());
+        std::unordered_map<std::string, int> snippetIds = documentIdMap;
+        snippetIds[fixturePath.string()] = documents + 1;
+
+        std::string offsetsPath = (corpus / "index.offsets.bin").string();
+        InvertedIndex invertedIndex;
+        invertedIndex.setThreadCount(options.maxThreads);
+        invertedIndex.setTokenOffsets(true);
+        std::vector<uint64_t> contentHashes;
+        invertedIndex.writeIndex(snippetFiles, snippetIds, offsetsPath, {},
+                                 static_cast<size_t>(options.memoryLimit) << 20, contentHashes);
+        std::error_code error;
+        uintmax_t offsetsBytes = fs::file_size(offsetsPath, error);
+        uintmax_t plainBytes = fs::file_size(segmentPath, error);
+
+        IndexSnapshot offsetsSnapshot;
+        offsetsSnapshot.open(offsetsPath, "");
+        // Состояние файлов, как его записывает createIndex: по нему сниппет проверяет, что файл не менялся
+        DocumentState state;
+        for (size_t i = 0; i < snippetFiles.size(); ++i) {
+            DocumentRecord record;
+            record.documentId = static_cast<uint32_t>(snippetIds[snippetFiles[i]]);
+            record.size = fs::file_size(snippetFiles[i], error);
+            record.modified = fs::last_write_time(snippetFiles[i], error).time_since_epoch().count();
+            record.contentHash = contentHashes[i];
+            state.documents()[snippetFiles[i]] = record;
+        }
+        offsetsSnapshot.setDocuments(state);
+        auto answers = searchServer.search(offsetsSnapshot, requests, 5);
+        size_t results = 0;
+        for (const auto& answer : answers) {
+            results += answer.size();
+        }
+        std::vector<double> snippetLatencies;
+        for (int round = 0; round < options.rounds; ++round) {
+            start = std::chrono::steady_clock::now();
+            searchServer.snippets(offsetsSnapshot, requests, answers);
+            snippetLatencies.push_back(results > 0 ? secondsSince(start) * 1e6 / results : 0);
+        }
+        std::sort(snippetLatencies.begin(), snippetLatencies.end());
+
+        // Ответы пакета и запроса к документу-образцу записываются, как в answers.json, и разбираются обратно
+        std::vector<std::string> fixtureQueries {"snippetfixture"};
+        std::vector<SearchQuery> checkRequests = requests;
+        for (auto& request : searchServer.processRequests(fixtureQueries, offsetsSnapshot.analyzer())) {
+            checkRequests.push_back(std::move(request));
+        }
+        auto checkAnswers = searchServer.search(offsetsSnapshot, checkRequests, 5);
+        auto checkSnippets = searchServer.snippets(offsetsSnapshot, checkRequests, checkAnswers);
+        size_t invalidAnswers = 0;
+        for (size_t i = 0; i < checkAnswers.size(); ++i) {
+            std::string line;
+            AnswersWriter::appendAnswer(line, checkAnswers[i], &checkSnippets[i]);
+            invalidAnswers += json::accept(line) ? 0 : 1;
+        }
+        bool fixtureFound = !checkSnippets.back().empty() && !checkSnippets.back().front().empty();
+        bool fixtureEscaped = fixtureFound && checkSnippets.back().front().find("<script") == std::string::npos &&
+                              checkSnippets.back().front().find("&lt;script&gt;") != std::string::npos;
+        if (invalidAnswers > 0 || !fixtureFound || !fixtureEscaped) {
+            std::cerr << "Error: " << invalidAnswers << " answers with snippets are not valid JSON"
+                      << (fixtureFound ? "" : ", no snippet for the fixture document")
+                      << (fixtureFound && !fixtureEscaped ? ", markup of the fixture document is not escaped" : "")
+                      << std::endl;
+        }
+
+        double extra = plainBytes > 0 ? static_cast<double>(offsetsBytes) / plainBytes - 1 : 0;
+        std::cout << "snippets: segment MB=" << offsetsBytes / (1024.0 * 1024.0)
+                  << " extra=" << extra * 100 << "% us/result=" << percentile(snippetLatencies, 0.5)
+                  << " invalid JSON answers=" << invalidAnswers << std::endl;
+        result["snippets"] = {{"segment_bytes", offsetsBytes},
+                              {"extra_fraction", extra},
+                              {"us_per_result", percentile(snippetLatencies, 0.5)},
+                              {"invalid_json_answers", invalidAnswers}};
+    }
+
+    // Пропускная способность токенизатора на том же корпусе, не больше 64 МБ текста
+    std::string text;
+    for (const auto& filePath : files) {
+        if (text.size() >= (64u << 20)) {
+            break;
+        }
+        std::ifstream file(filePath);
+        text.append(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        text.push_back(' ');
+    }
+    Tokenizer tokenizer;
+    size_t tokens = 0;
+    const int iterations = 5;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        tokenizer.reset(text);
+        std::string_view token;
+        while (tokenizer.next(token)) {
+            ++tokens;
+        }
+    }
+    double seconds = secondsSince(start);
+    double megabytes = static_cast<double>(text.size()) * iterations / (1024.0 * 1024.0);
+    std::cout << "Tokenizer: " << static_cast<size_t>(text.size()) << " bytes"
+              << " tokens=" << tokens / iterations
+              << " MB/s=" << megabytes / seconds << std::endl;
+    result["tokenizer_mb_per_second"] = megabytes / seconds;
+
+    result["metrics"] = Metrics::global().toJson();
+    snapshot = IndexSnapshot();
+    fs::remove_all(corpus);
+    return result;
+}
+
+// Список размеров корпуса через запятую: 1000,10000,100000
+static bool parseScales(const std::string& value, std::vector<int>& scales) {
+    scales.clear();
+    size_t position = 0;
+    while (position <= value.size()) {
+        size_t comma = std::min(value.find(',', position), value.size());
+        int scale = std::atoi(value.substr(position, comma - position).c_str());
+        if (scale <= 0) {
+            return false;
+        }
+        scales.push_back(scale);
+        position = comma + 1;
+    }
+    return !scales.empty();
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    const char* usage = "Usage: search_engine_bench [--docs N | --scales N,N,...] [--words N] [--vocabulary N] "
+                        "[--zipf S] [--queries N] [--rounds N] [--threads N] [--memory MB] [--json FILE]";
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << usage << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::string value = argv[++i];
+        int number = std::atoi(value.c_str());
+        bool valid = number > 0;
+        if (arg == "--docs") {
+            options.scales = {number};
+        } else if (arg == "--scales") {
+            valid = parseScales(value, options.scales);
+        } else if (arg == "--words") {
+            options.wordsPerDocument = number;
+        } else if (arg == "--vocabulary") {
+            options.vocabularySize = static_cast<size_t>(number);
+        } else if (arg == "--zipf") {
+            options.zipfExponent = std::atof(value.c_str());
+            valid = options.zipfExponent > 0;
+        } else if (arg == "--queries") {
+            options.queryCount = number;
+        } else if (arg == "--rounds") {
+            options.rounds = number;
+        } else if (arg == "--threads") {
+            options.maxThreads = static_cast<unsigned>(number);
+        } else if (arg == "--memory") {
+            options.memoryLimit = number;
+        } else if (arg == "--json") {
+            options.jsonPath = value;
+            valid = !value.empty();
+        } else {
+            std::cerr << usage << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (!valid) {
+            std::cerr << "Invalid value for " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Фазы и счетчики каждого размера попадают в результаты
+    Metrics::global().setEnabled(true);
+    ZipfVocabulary vocabulary(options.vocabularySize, options.zipfExponent);
+
+    json report;
+    report["version"] = VERSION_APP;
+    report["parameters"] = {{"words_per_document", options.wordsPerDocument},
+                            {"vocabulary", options.vocabularySize},
+                            {"zipf", options.zipfExponent},
+                            {"queries", options.queryCount},
+                            {"rounds", options.rounds},
+                            {"threads", options.maxThreads},
+                            {"memory_limit_mb", options.memoryLimit}};
+    report["results"] = json::array();
+    for (size_t i = 0; i < options.scales.size(); ++i) {
+        std::cout << "Index build: " << options.scales[i] << " documents, "
+                  << options.wordsPerDocument << " words each on average" << std::endl;
+        // Перебор потоков только на первом размере: построение в памяти на больших корпусах не влезет в память
+        report["results"].push_back(runScale(options, vocabulary, options.scales[i], i == 0));
+    }
+
+    if (!options.jsonPath.empty()) {
+        std::ofstream output(options.jsonPath);
+        output << report.dump(2) << std::endl;
+        if (!output) {
+            std::cerr << "Error: Unable to write to " << options.jsonPath << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
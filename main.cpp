@@ -1,26 +1,79 @@
 #include <iostream>
+#include <string>
+#include <cstdlib>
 #include "SearchServer.h"
 #include "InvertedIndex.h"
 #include "ConverterJSON.h"
+#include "SearchDaemon.h"
+#include "Metrics.h"
 
+// Итоговые метрики работы процесса в выбранном формате
+static void printStats(std::ostream& output, const std::string& format) {
+    if (format == "prometheus") {
+        output << Metrics::global().toPrometheus();
+    } else if (format == "json") {
+        output << Metrics::global().toJson().dump(2) << std::endl;
+    }
+}
 
-int main() {
+int main(int argc, char* argv[]) {
     ConverterJSON converterJson;
     InvertedIndex invertedIndex;
     SearchServer searchServer;
+    bool serve = false;
+    // Формат вывода метрик, пустой - метрики не собираются
+    std::string statsFormat;
+
+    // Разбор аргументов командной строки
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            int threads = std::atoi(argv[++i]);
+            if (threads <= 0) {
+                std::cerr << "Invalid --threads value. It must be a positive integer." << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            converterJson.setThreadCount(static_cast<unsigned>(threads));
+            invertedIndex.setThreadCount(static_cast<unsigned>(threads));
+            searchServer.setThreadCount(static_cast<unsigned>(threads));
+        } else if (arg == "--serve") {
+            serve = true;
+        } else if (arg == "--stats") {
+            statsFormat = "json";
+            if (i + 1 < argc && (std::string(argv[i + 1]) == "json" || std::string(argv[i + 1]) == "prometheus")) {
+                statsFormat = argv[++i];
+            }
+            Metrics::global().setEnabled(true);
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            std::cerr << "Usage: search_engine [--threads N] [--serve] [--stats [json|prometheus]]" << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
 
     if (!converterJson.loadConfig()) {
         std::cerr << "Failed to load configuration." << std::endl;
         std::exit(EXIT_FAILURE);
     }
-    std::cout << "Starting "<< converterJson.getName() << std::endl;
+    // В резидентном режиме stdout занят ответами, сообщения идут в stderr
+    (serve ? std::cerr : std::cout) << "Starting "<< converterJson.getName() << std::endl;
     invertedIndex.manageIndex(converterJson);
 
-    // Получение списка запросов из JSON
-    std::vector<std::string> listRequests = converterJson.GetRequests();
-    // Обработка запросов и получение результата
-    std::vector<std::vector<std::string>> processedRequests = searchServer.processRequests(listRequests);
+    if (serve) {
+        // Запросы построчно из stdin, ответы построчно в stdout
+        SearchDaemon daemon(converterJson, invertedIndex, searchServer);
+        if (!daemon.start()) {
+            std::exit(EXIT_FAILURE);
+        }
+        daemon.serve(std::cin, std::cout);
+        daemon.stop();
+        printStats(std::cerr, statsFormat);
+        return 0;
+    }
 
+    // Поиск по запросам из requests.json и запись результата в answers.json
+    searchServer.processQueries(converterJson);
+    printStats(std::cout, statsFormat);
 
     return 0;
 }